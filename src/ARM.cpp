@@ -22,9 +22,11 @@
 #include "DSi.h"
 #include "ARM.h"
 #include "ARMInterpreter.h"
+#include "ARMDecodeCache.h"
 #include "AREngine.h"
 #include "ARMJIT.h"
 #include "Platform.h"
+#include "Profiler.h"
 
 #ifdef JIT_ENABLED
 #include "ARMJIT.h"
@@ -86,6 +88,10 @@ ARMv5::ARMv5() : ARM(0)
     DTCM = new u8[DTCMPhysicalSize];
 #endif
 
+    // the timings can be set up before the PU is reset
+    memset(PU_PageRegion, PU_NoRegion, sizeof(PU_PageRegion));
+    memset(PU_PrivMap, 0, sizeof(PU_PrivMap));
+    memset(PU_UserMap, 0, sizeof(PU_UserMap));
     PU_Map = PU_PrivMap;
 }
 
@@ -337,7 +343,7 @@ void ARMv5::JumpTo(u32 addr, bool restorecpsr)
         CPSR &= ~0x20;
     }
 
-    if (!(PU_Map[addr>>12] & 0x04))
+    if (!(PU_Map[PU_PageRegion[addr>>12]] & 0x04))
     {
         PrefetchAbort();
         return;
@@ -545,7 +551,7 @@ void ARMv5::PrefetchAbort()
 
     // this shouldn't happen, but if it does, we're stuck in some nasty endless loop
     // so better take care of it
-    if (!(PU_Map[ExceptionBase>>12] & 0x04))
+    if (!(PU_Map[PU_PageRegion[ExceptionBase>>12]] & 0x04))
     {
         Log(LogLevel::Error, "!!!!! EXCEPTION REGION NOT EXECUTABLE. THIS IS VERY BAD!!\n");
         NDS::Stop();
@@ -573,6 +579,8 @@ void ARMv5::DataAbort()
 
 void ARMv5::Execute()
 {
+    PROFILE_SCOPE(Profiler::Counter_ARM9);
+
     if (Halted)
     {
         if (Halted == 2)
@@ -592,8 +600,24 @@ void ARMv5::Execute()
         }
     }
 
+    ARMDecodeCache::Block* prevBlock = nullptr;
     while (NDS::ARM9Timestamp < NDS::ARM9Target)
     {
+        if (NDS::EnableDecodeCache)
+        {
+            ARMDecodeCache::Block* block = ARMDecodeCache::LookUpBlock(this, prevBlock);
+            if (block)
+            {
+                u32 generation = ARMDecodeCache::Generation;
+                if (!ExecuteBlock(block))
+                    break;
+                // it might have been thrown away while running
+                prevBlock = ARMDecodeCache::Generation == generation ? block : nullptr;
+                continue;
+            }
+            prevBlock = nullptr;
+        }
+
         if (CPSR & 0x20) // THUMB
         {
             // prefetch
@@ -653,9 +677,108 @@ void ARMv5::Execute()
         Halted = 0;
 }
 
+// runs a decoded block, the same way Execute() would run its instructions
+// stops early when the code takes another path, when the block might
+// have been thrown away, or when it's time to leave the loop
+// returns false if the CPU got halted
+bool ARMv5::ExecuteBlock(ARMDecodeCache::Block* block)
+{
+    u32 generation = ARMDecodeCache::Generation;
+    u32 numinstrs = block->NumInstrs;
+
+    if (CPSR & 0x20) // THUMB
+    {
+        u32 pc = R[15];
+        for (u32 i = 0; i < numinstrs; i++)
+        {
+            // prefetch
+            R[15] += 2;
+            CurInstr = NextInstr[0];
+            NextInstr[0] = NextInstr[1];
+            if (R[15] & 0x2) { NextInstr[1] >>= 16; CodeCycles = 0; }
+            else
+            {
+                NextInstr[1] = block->Instrs[i+2] | (block->Instrs[i+3] << 16);
+                CodeReadCycles(R[15]);
+            }
+
+            // actually execute
+            block->Handlers[i](this);
+
+            if (Halted)
+            {
+                if (Halted == 1 && NDS::ARM9Timestamp < NDS::ARM9Target)
+                {
+                    NDS::ARM9Timestamp = NDS::ARM9Target;
+                }
+                return false;
+            }
+            if (IRQ) TriggerIRQ();
+
+            NDS::ARM9Timestamp += Cycles;
+            Cycles = 0;
+
+            pc += 2;
+            if (R[15] != pc || !(CPSR & 0x20) || ARMDecodeCache::Generation != generation
+                || NDS::ARM9Timestamp >= NDS::ARM9Target)
+                break;
+        }
+    }
+    else
+    {
+        u32 pc = R[15];
+        for (u32 i = 0; i < numinstrs; i++)
+        {
+            // prefetch
+            R[15] += 4;
+            CurInstr = NextInstr[0];
+            NextInstr[0] = NextInstr[1];
+            NextInstr[1] = block->Instrs[i+2];
+            CodeReadCycles(R[15]);
+
+            // actually execute
+            if (CheckCondition(block->Conds[i]))
+                block->Handlers[i](this);
+            else
+                AddCycles_C();
+
+            if (Halted)
+            {
+                if (Halted == 1 && NDS::ARM9Timestamp < NDS::ARM9Target)
+                {
+                    NDS::ARM9Timestamp = NDS::ARM9Target;
+                }
+                return false;
+            }
+            if (IRQ) TriggerIRQ();
+
+            NDS::ARM9Timestamp += Cycles;
+            Cycles = 0;
+
+            pc += 4;
+            if (R[15] != pc || (CPSR & 0x20) || ARMDecodeCache::Generation != generation
+                || NDS::ARM9Timestamp >= NDS::ARM9Target)
+                break;
+        }
+    }
+
+    // an idle loop went around once without anything changing, which
+    // won't happen until the next event or the other CPU catches up
+    if (ARMDecodeCache::Generation == generation && block->IdleLoop
+        && ((R[15] - ((CPSR & 0x20) ? 2 : 4)) | ((CPSR & 0x20) >> 5)) == block->Addr
+        && NDS::ARM9Timestamp < NDS::ARM9Target)
+    {
+        NDS::ARM9Timestamp = NDS::ARM9Target;
+    }
+
+    return true;
+}
+
 #ifdef JIT_ENABLED
 void ARMv5::ExecuteJIT()
 {
+    PROFILE_SCOPE(Profiler::Counter_ARM9JIT);
+
     if (Halted)
     {
         if (Halted == 2)
@@ -723,6 +846,8 @@ void ARMv5::ExecuteJIT()
 
 void ARMv4::Execute()
 {
+    PROFILE_SCOPE(Profiler::Counter_ARM7);
+
     if (Halted)
     {
         if (Halted == 2)
@@ -742,8 +867,24 @@ void ARMv4::Execute()
         }
     }
 
+    ARMDecodeCache::Block* prevBlock = nullptr;
     while (NDS::ARM7Timestamp < NDS::ARM7Target)
     {
+        if (NDS::EnableDecodeCache)
+        {
+            ARMDecodeCache::Block* block = ARMDecodeCache::LookUpBlock(this, prevBlock);
+            if (block)
+            {
+                u32 generation = ARMDecodeCache::Generation;
+                if (!ExecuteBlock(block))
+                    break;
+                // it might have been thrown away while running
+                prevBlock = ARMDecodeCache::Generation == generation ? block : nullptr;
+                continue;
+            }
+            prevBlock = nullptr;
+        }
+
         if (CPSR & 0x20) // THUMB
         {
             // prefetch
@@ -804,9 +945,98 @@ void ARMv4::Execute()
     }
 }
 
+bool ARMv4::ExecuteBlock(ARMDecodeCache::Block* block)
+{
+    u32 generation = ARMDecodeCache::Generation;
+    u32 numinstrs = block->NumInstrs;
+
+    if (CPSR & 0x20) // THUMB
+    {
+        u32 pc = R[15];
+        for (u32 i = 0; i < numinstrs; i++)
+        {
+            // prefetch
+            R[15] += 2;
+            CurInstr = NextInstr[0];
+            NextInstr[0] = NextInstr[1];
+            NextInstr[1] = block->Instrs[i+2];
+
+            // actually execute
+            block->Handlers[i](this);
+
+            if (Halted)
+            {
+                if (Halted == 1 && NDS::ARM7Timestamp < NDS::ARM7Target)
+                {
+                    NDS::ARM7Timestamp = NDS::ARM7Target;
+                }
+                return false;
+            }
+            if (IRQ) TriggerIRQ();
+
+            NDS::ARM7Timestamp += Cycles;
+            Cycles = 0;
+
+            pc += 2;
+            if (R[15] != pc || !(CPSR & 0x20) || ARMDecodeCache::Generation != generation
+                || NDS::ARM7Timestamp >= NDS::ARM7Target)
+                break;
+        }
+    }
+    else
+    {
+        u32 pc = R[15];
+        for (u32 i = 0; i < numinstrs; i++)
+        {
+            // prefetch
+            R[15] += 4;
+            CurInstr = NextInstr[0];
+            NextInstr[0] = NextInstr[1];
+            NextInstr[1] = block->Instrs[i+2];
+
+            // actually execute
+            if (CheckCondition(block->Conds[i]))
+                block->Handlers[i](this);
+            else
+                AddCycles_C();
+
+            if (Halted)
+            {
+                if (Halted == 1 && NDS::ARM7Timestamp < NDS::ARM7Target)
+                {
+                    NDS::ARM7Timestamp = NDS::ARM7Target;
+                }
+                return false;
+            }
+            if (IRQ) TriggerIRQ();
+
+            NDS::ARM7Timestamp += Cycles;
+            Cycles = 0;
+
+            pc += 4;
+            if (R[15] != pc || (CPSR & 0x20) || ARMDecodeCache::Generation != generation
+                || NDS::ARM7Timestamp >= NDS::ARM7Target)
+                break;
+        }
+    }
+
+    // an idle loop went around once without anything changing, which
+    // won't happen until the next event or the other CPU catches up
+    if (ARMDecodeCache::Generation == generation && block->IdleLoop
+        && ((R[15] - ((CPSR & 0x20) ? 2 : 4)) | ((CPSR & 0x20) >> 5)) == block->Addr
+        && NDS::ARM7Timestamp < NDS::ARM7Target)
+    {
+        NDS::ARM7Timestamp = NDS::ARM7Target;
+    }
+
+    return true;
+}
+
 #ifdef JIT_ENABLED
 void ARMv4::ExecuteJIT()
 {
+    PROFILE_SCOPE(Profiler::Counter_ARM7JIT);
+
     if (Halted)
     {
         if (Halted == 2)
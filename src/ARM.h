@@ -38,6 +38,17 @@ enum
 const u32 ITCMPhysicalSize = 0x8000;
 const u32 DTCMPhysicalSize = 0x4000;
 
+// ARMv5::PU_PageRegion value for pages outside of any PU region
+const u8 PU_NoRegion = 8;
+
+// access timing for cached code regions, see CP15.cpp
+const int kCodeCacheTiming = 3;//5;
+
+namespace ARMDecodeCache
+{
+struct Block;
+}
+
 class ARM
 {
 public:
@@ -188,10 +199,25 @@ public:
 #ifdef JIT_ENABLED
     void ExecuteJIT();
 #endif
+    bool ExecuteBlock(ARMDecodeCache::Block* block);
 
     // all code accesses are forced nonseq 32bit
     u32 CodeRead32(u32 addr, bool branch);
 
+    // the timing part of a sequential CodeRead32, for when the code is already known
+    void CodeReadCycles(u32 addr)
+    {
+        if (addr < ITCMSize)
+        {
+            CodeCycles = 1;
+            return;
+        }
+
+        CodeCycles = RegionCodeCycles;
+        if (CodeCycles == 0xFF)
+            CodeCycles = (addr & 0x1F) ? 1 : kCodeCacheTiming;
+    }
+
     void DataRead8(u32 addr, u32* val);
     void DataRead16(u32 addr, u32* val);
     void DataRead32(u32 addr, u32* val);
@@ -248,7 +274,10 @@ public:
     void UpdateDTCMSetting();
     void UpdateITCMSetting();
 
+    bool UpdatePURegionMasks(u32 n);
+    void UpdatePUPages(u32 start, u32 end);
     void UpdatePURegion(u32 n);
+    void UpdatePURegionRange(u32 n, u32 oldrgn);
     void UpdatePURegions(bool update_all);
 
     u32 RandomLineIndex();
@@ -288,9 +317,14 @@ public:
 
     u32 PU_Region[8];
 
+    // PU region each page belongs to (the highest numbered one covering it)
+    // or PU_NoRegion
+    u8 PU_PageRegion[0x100000];
+
+    // per region, PU_NoRegion last
     // 0=dataR 1=dataW 2=codeR 4=datacache 5=datawrite 6=codecache
-    u8 PU_PrivMap[0x100000];
-    u8 PU_UserMap[0x100000];
+    u8 PU_PrivMap[9];
+    u8 PU_UserMap[9];
 
     // games operate under system mode, generally
     //#define PU_Map PU_PrivMap
@@ -319,20 +353,28 @@ public:
 #ifdef JIT_ENABLED
     void ExecuteJIT();
 #endif
+    bool ExecuteBlock(ARMDecodeCache::Block* block);
 
     u16 CodeRead16(u32 addr)
     {
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7ReadTLB, addr))
+            return *(u16*)mem;
         return BusRead16(addr);
     }
 
     u32 CodeRead32(u32 addr)
     {
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7ReadTLB, addr))
+            return *(u32*)mem;
         return BusRead32(addr);
     }
 
     void DataRead8(u32 addr, u32* val)
     {
-        *val = BusRead8(addr);
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7ReadTLB, addr))
+            *val = *(u8*)mem;
+        else
+            *val = BusRead8(addr);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][0];
     }
@@ -341,7 +383,10 @@ public:
     {
         addr &= ~1;
 
-        *val = BusRead16(addr);
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7ReadTLB, addr))
+            *val = *(u16*)mem;
+        else
+            *val = BusRead16(addr);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][0];
     }
@@ -350,7 +395,10 @@ public:
     {
         addr &= ~3;
 
-        *val = BusRead32(addr);
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7ReadTLB, addr))
+            *val = *(u32*)mem;
+        else
+            *val = BusRead32(addr);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][2];
     }
@@ -359,13 +407,22 @@ public:
     {
         addr &= ~3;
 
-        *val = BusRead32(addr);
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7ReadTLB, addr))
+            *val = *(u32*)mem;
+        else
+            *val = BusRead32(addr);
         DataCycles += NDS::ARM7MemTimings[addr >> 15][3];
     }
 
     void DataWrite8(u32 addr, u8 val)
     {
-        BusWrite8(addr, val);
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7WriteTLB, addr))
+        {
+            *(u8*)mem = val;
+            NDS::MarkPageDirty(NDS::ARM7WriteTLBPage[addr >> 12]);
+        }
+        else
+            BusWrite8(addr, val);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][0];
     }
@@ -374,7 +431,13 @@ public:
     {
         addr &= ~1;
 
-        BusWrite16(addr, val);
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7WriteTLB, addr))
+        {
+            *(u16*)mem = val;
+            NDS::MarkPageDirty(NDS::ARM7WriteTLBPage[addr >> 12]);
+        }
+        else
+            BusWrite16(addr, val);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][0];
     }
@@ -383,7 +446,13 @@ public:
     {
         addr &= ~3;
 
-        BusWrite32(addr, val);
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7WriteTLB, addr))
+        {
+            *(u32*)mem = val;
+            NDS::MarkPageDirty(NDS::ARM7WriteTLBPage[addr >> 12]);
+        }
+        else
+            BusWrite32(addr, val);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][2];
     }
@@ -392,7 +461,13 @@ public:
     {
         addr &= ~3;
 
-        BusWrite32(addr, val);
+        if (u8* mem = NDS::LookUpTLB(NDS::ARM7WriteTLB, addr))
+        {
+            *(u32*)mem = val;
+            NDS::MarkPageDirty(NDS::ARM7WriteTLBPage[addr >> 12]);
+        }
+        else
+            BusWrite32(addr, val);
         DataCycles += NDS::ARM7MemTimings[addr >> 15][3];
     }
 
@@ -0,0 +1,428 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "ARMDecodeCache.h"
+#include "ARMInterpreter.h"
+#include "ARM_InstrInfo.h"
+#include "NDS.h"
+#include "DSi.h"
+#include "Platform.h"
+
+namespace ARMDecodeCache
+{
+
+// blocks are found through a direct mapped table per CPU
+// a block which gets pushed out of it is deleted right away
+const u32 TableBits = 14;
+const u32 TableSize = 1 << TableBits;
+
+// for memory blocks can't be made from
+const u32 Uncached = 0xFFFFFFFE;
+
+u32 Generation = 0;
+
+bool IdleLoopSkip;
+
+Block* Table[2][TableSize];
+
+std::vector<Block*> PageBlocks[NDS::CodePages_Count];
+std::vector<Block*> ReadOnlyBlocks;
+
+inline u32 HashAddr(u32 addr)
+{
+    return (addr * 2654435761U) >> (32 - TableBits);
+}
+
+// instructions which are never a good idea to decode past
+bool EndsBlock(u32 instr, bool thumb)
+{
+    if (thumb)
+    {
+        return (instr & 0xF800) == 0xE000 // B
+            || (instr & 0xFF00) == 0x4700 // BX/BLX
+            || (instr & 0xFF00) == 0xBD00 // POP {PC}
+            || (instr & 0xE800) == 0xE800 // second half of BL/BLX
+            || (instr & 0xFF00) == 0xDF00 // SVC
+            || (instr & 0xFC87) == 0x4487; // hi register op to PC
+    }
+
+    if ((instr >> 28) < 0xE)
+        return false;
+
+    return (instr & 0x0E000000) == 0x0A000000 // B/BL/BLX
+        || (instr & 0x0FFFFFD0) == 0x012FFF10 // BX/BLX
+        || (instr & 0x0F000000) == 0x0F000000 // SVC
+        || (instr & 0x0E108000) == 0x08108000 // LDM with PC
+        || (instr & 0x0C10F000) == 0x0410F000 // LDR PC
+        || (instr & 0x0C00F000) == 0x0000F000; // ALU op to PC
+}
+
+// whether instr is a branch back to the start of the block
+bool BranchesToStart(u32 instr, bool thumb, u32 offset)
+{
+    if (thumb)
+    {
+        s32 target;
+        if ((instr & 0xF000) == 0xD000 && ((instr >> 8) & 0xF) < 0xE) // B<cond>
+            target = (s32)(instr << 24) >> 23;
+        else if ((instr & 0xF800) == 0xE000) // B
+            target = (s32)(instr << 21) >> 20;
+        else
+            return false;
+
+        return offset + 4 + target == 0;
+    }
+
+    if ((instr & 0x0F000000) != 0x0A000000 || (instr >> 28) == 0xF) // B<cond>
+        return false;
+
+    s32 target = (s32)(instr << 8) >> 6;
+    return offset + 8 + target == 0;
+}
+
+// same rules as the JIT uses to find idle loops (see ARMJIT::IsIdleLoop)
+// the loop may only read memory, and no iteration may depend on
+// registers or flags the one before it has written
+bool IsIdleLoop(bool thumb, u32 num, const u32* instrs, u32 count)
+{
+    u16 regsWrittenTo = 0;
+    u16 regsDisallowedToWrite = 0;
+    u8 flagsWrittenTo = 0;
+    u8 flagsDisallowedToWrite = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+        ARMInstrInfo::Info info = ARMInstrInfo::Decode(thumb, num, instrs[i]);
+
+        if (info.SpecialKind == ARMInstrInfo::special_WriteMem
+            || info.SpecialKind == ARMInstrInfo::special_WaitForInterrupt)
+            return false;
+        if (!thumb && info.Kind >= ARMInstrInfo::ak_MSR_IMM && info.Kind <= ARMInstrInfo::ak_MRC)
+            return false;
+        if (i < count - 1 && info.Branches())
+            return false;
+
+        u16 srcRegs = info.SrcRegs & ~(1 << 15);
+        u16 dstRegs = info.DstRegs & ~(1 << 15);
+
+        regsDisallowedToWrite |= srcRegs & ~regsWrittenTo;
+        if (dstRegs & regsDisallowedToWrite)
+            return false;
+        regsWrittenTo |= dstRegs;
+
+        // the upper half are the flags which are only written sometimes
+        u8 flagsWritten = (info.WriteFlags | (info.WriteFlags >> 4)) & 0xF;
+
+        flagsDisallowedToWrite |= info.ReadFlags & ~flagsWrittenTo;
+        if (flagsWritten & flagsDisallowedToWrite)
+            return false;
+        flagsWrittenTo |= info.WriteFlags & 0xF;
+    }
+    return true;
+}
+
+template <typename T>
+void NotExecuted(ARM* cpu)
+{
+    ((T*)cpu)->AddCycles_C();
+}
+
+u32 GetPage(u8* mem)
+{
+    if (mem >= NDS::MainRAM && mem < NDS::MainRAM + NDS::MainRAMMaxSize)
+        return NDS::DirtyPages_MainRAM + ((mem - NDS::MainRAM) >> 12);
+    if (mem >= NDS::SharedWRAM && mem < NDS::SharedWRAM + NDS::SharedWRAMSize)
+        return NDS::DirtyPages_SharedWRAM + ((mem - NDS::SharedWRAM) >> 12);
+    if (mem >= NDS::ARM7WRAM && mem < NDS::ARM7WRAM + NDS::ARM7WRAMSize)
+        return NDS::DirtyPages_ARM7WRAM + ((mem - NDS::ARM7WRAM) >> 12);
+    if (mem >= NDS::ARM9->ITCM && mem < NDS::ARM9->ITCM + ITCMPhysicalSize)
+        return NDS::CodePages_ITCM + ((mem - NDS::ARM9->ITCM) >> 12);
+
+    if (mem >= NDS::ARM9BIOS && mem < NDS::ARM9BIOS + sizeof(NDS::ARM9BIOS))
+        return NoPage;
+    if (mem >= NDS::ARM7BIOS && mem < NDS::ARM7BIOS + sizeof(NDS::ARM7BIOS))
+        return NoPage;
+
+    return Uncached;
+}
+
+void DeleteBlock(Block* block)
+{
+    for (u32 num = 0; num < 2; num++)
+    {
+        Block*& entry = Table[num][HashAddr(block->Addr)];
+        if (entry == block)
+            entry = nullptr;
+    }
+
+    delete block;
+}
+
+void Reset()
+{
+    for (u32 i = 0; i < NDS::CodePages_Count; i++)
+    {
+        for (Block* block : PageBlocks[i])
+            delete block;
+        PageBlocks[i].clear();
+    }
+    for (Block* block : ReadOnlyBlocks)
+        delete block;
+    ReadOnlyBlocks.clear();
+
+    memset(Table, 0, sizeof(Table));
+    memset(NDS::CodePages, 0, sizeof(NDS::CodePages));
+
+    Generation++;
+
+    IdleLoopSkip = Platform::GetConfigBool(Platform::DecodeCache_IdleLoops);
+}
+
+void InvalidatePage(u32 page)
+{
+    for (Block* block : PageBlocks[page])
+        DeleteBlock(block);
+    PageBlocks[page].clear();
+
+    NDS::CodePages[page] = 0;
+    Generation++;
+}
+
+// takes the block out of its page, when it was pushed out of the table
+void EvictBlock(Block* block)
+{
+    std::vector<Block*>& blocks = block->Page == NoPage
+        ? ReadOnlyBlocks
+        : PageBlocks[block->Page];
+
+    auto it = std::find(blocks.begin(), blocks.end(), block);
+    *it = blocks.back();
+    blocks.pop_back();
+
+    delete block;
+
+    // other blocks might still be linked to it
+    Generation++;
+}
+
+template <u32 num>
+Block* CreateBlock(u32 key, u8* mem, u32 avail, u32 page)
+{
+    bool thumb = key & 0x1;
+    u32 size = thumb ? 2 : 4;
+    // the prefetch reads two instructions ahead, for THUMB on the ARM9
+    // it's done in 32-bit units so we need one more halfword
+    u32 lookahead = thumb ? 3 : 2;
+
+    u32 count = avail / size;
+    if (count <= lookahead)
+        return nullptr;
+
+    Block* block = new Block;
+    block->Addr = key;
+    block->Mem = mem;
+    block->Page = page;
+    block->IdleLoop = false;
+    block->Next = nullptr;
+    block->NextGeneration = Generation - 1;
+
+    u32 numinstrs = std::min(count - lookahead, MaxBlockInstrs);
+    for (u32 i = 0; i < numinstrs + lookahead; i++)
+    {
+        if (thumb)
+        {
+            u16 instr;
+            memcpy(&instr, &mem[i * 2], 2);
+            block->Instrs[i] = instr;
+        }
+        else
+            memcpy(&block->Instrs[i], &mem[i * 4], 4);
+    }
+
+    for (u32 i = 0; i < numinstrs; i++)
+    {
+        u32 instr = block->Instrs[i];
+
+        if (thumb)
+        {
+            block->Handlers[i] = ARMInterpreter::THUMBInstrTable[(instr >> 6) & 0x3FF];
+            block->Conds[i] = 0xE;
+        }
+        else if ((instr >> 28) == 0xF)
+        {
+            // never executed, except for BLX on the ARM9
+            if (num == 0 && (instr & 0xFE000000) == 0xFA000000)
+                block->Handlers[i] = ARMInterpreter::A_BLX_IMM;
+            else if (num == 0)
+                block->Handlers[i] = NotExecuted<ARMv5>;
+            else
+                block->Handlers[i] = NotExecuted<ARMv4>;
+            block->Conds[i] = 0xE;
+        }
+        else
+        {
+            u32 icode = ((instr >> 4) & 0xF) | ((instr >> 16) & 0xFF0);
+            block->Handlers[i] = ARMInterpreter::ARMInstrTable[icode];
+            block->Conds[i] = instr >> 28;
+        }
+
+        if (IdleLoopSkip && BranchesToStart(instr, thumb, i * size)
+            && IsIdleLoop(thumb, num, block->Instrs, i + 1))
+        {
+            block->IdleLoop = true;
+            numinstrs = i + 1;
+            break;
+        }
+
+        if (EndsBlock(instr, thumb))
+        {
+            numinstrs = i + 1;
+            break;
+        }
+    }
+
+    block->NumInstrs = numinstrs;
+
+    if (page == NoPage)
+        ReadOnlyBlocks.push_back(block);
+    else
+    {
+        PageBlocks[page].push_back(block);
+        NDS::CodePages[page] = 1;
+    }
+
+    return block;
+}
+
+template <u32 num>
+Block* FindBlock(u32 key, u8* mem, u32 avail)
+{
+    Block*& entry = Table[num][HashAddr(key)];
+    Block* block = entry;
+    if (!block || block->Addr != key || block->Mem != mem)
+    {
+        u32 page = GetPage(mem);
+        if (page == Uncached)
+            return nullptr;
+
+        block = CreateBlock<num>(key, mem, avail, page);
+        if (!block)
+            return nullptr;
+
+        if (entry)
+            EvictBlock(entry);
+        entry = block;
+    }
+
+    return block;
+}
+
+template <u32 num>
+Block* CheckPipeline(ARM* cpu, Block* block)
+{
+    bool thumb = block->Addr & 0x1;
+
+    // the pipeline might have been filled before the code was overwritten
+    u32 mask = thumb ? 0xFFFF : 0xFFFFFFFF;
+    if ((cpu->NextInstr[0] & mask) != block->Instrs[0] || (cpu->NextInstr[1] & mask) != block->Instrs[1])
+        return nullptr;
+
+    // the ARM9 fetches THUMB code 32 bits at a time, so the third
+    // instruction might already be in the pipeline too
+    if (num == 0 && thumb && ((cpu->R[15] + 2) & 0x2) && (cpu->NextInstr[1] >> 16) != block->Instrs[2])
+        return nullptr;
+
+    return block;
+}
+
+template <u32 num>
+Block* LookUpBlock(ARM* cpu, Block* prev, u32 key, u8* mem, u32 avail)
+{
+    u32 generation = Generation;
+    Block* block = FindBlock<num>(key, mem, avail);
+    if (!block)
+        return nullptr;
+
+    // unless making it pushed a block out, which could've been prev
+    if (prev && Generation == generation)
+    {
+        prev->Next = block;
+        prev->NextGeneration = generation;
+    }
+
+    return CheckPipeline<num>(cpu, block);
+}
+
+Block* LookUpBlock(ARMv5* cpu, Block* prev)
+{
+    bool thumb = cpu->CPSR & 0x20;
+    u32 addr = cpu->R[15] - (thumb ? 2 : 4);
+    u32 key = addr | (thumb ? 0x1 : 0x0);
+
+    if (prev && prev->NextGeneration == Generation && prev->Next->Addr == key)
+        return CheckPipeline<0>(cpu, prev->Next);
+
+    u32 avail = 0x1000 - (addr & 0xFFF);
+    u8* mem;
+
+    // same as CodeRead32
+    if (addr < cpu->ITCMSize)
+    {
+        mem = &cpu->ITCM[addr & (ITCMPhysicalSize - 1)];
+        avail = std::min(avail, cpu->ITCMSize - addr);
+    }
+    else if (cpu->CodeMem.Mem)
+        mem = &cpu->CodeMem.Mem[addr & cpu->CodeMem.Mask];
+    else
+        return nullptr;
+
+    return LookUpBlock<0>(cpu, prev, key, mem, avail);
+}
+
+Block* LookUpBlock(ARMv4* cpu, Block* prev)
+{
+    bool thumb = cpu->CPSR & 0x20;
+    u32 addr = cpu->R[15] - (thumb ? 2 : 4);
+    u32 key = addr | (thumb ? 0x1 : 0x0);
+
+    if (prev && prev->NextGeneration == Generation && prev->Next->Addr == key)
+        return CheckPipeline<1>(cpu, prev->Next);
+
+    u32 avail = 0x1000 - (addr & 0xFFF);
+
+    NDS::MemRegion region;
+    bool mapped = NDS::ConsoleType == 1
+        ? DSi::ARM7GetMemRegion(addr, false, &region)
+        : NDS::ARM7GetMemRegion(addr, false, &region);
+
+    // shared WRAM isn't covered by ARM7GetMemRegion, but we only ever work on single pages
+    if (!mapped && NDS::ConsoleType == 0 && (addr & 0xFF800000) == 0x03000000 && NDS::SWRAM_ARM7.Mem)
+    {
+        region = NDS::SWRAM_ARM7;
+        mapped = true;
+    }
+
+    if (!mapped)
+        return nullptr;
+
+    return LookUpBlock<1>(cpu, prev, key, &region.Mem[addr & region.Mask], avail);
+}
+
+}
@@ -0,0 +1,99 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ARMDECODECACHE_H
+#define ARMDECODECACHE_H
+
+#include "types.h"
+#include "ARM.h"
+
+// decoded instruction cache for the interpreter
+//
+// runs of guest code are decoded once into blocks which hold the instructions
+// and the handler for each of them. the interpreter then runs the blocks without
+// going through the memory handlers or instruction tables for every instruction.
+// the pipeline is still emulated the same way, so timings don't change.
+//
+// blocks are only made from memory whose writes are tracked (main RAM, WRAM,
+// ITCM, see NDS::CodePages) or which can't be written (BIOS). writing to a page
+// throws away every block decoded from it.
+//
+// blocks which are a loop that can't get anywhere on its own (an idle loop, like
+// waiting for VCount or an IPC flag) are noticed too, when running them the CPU
+// skips ahead to its target, as nothing will change before then.
+//
+// each block remembers the one which ran after it, so most of the time the next
+// block is found without hashing the address or resolving its memory. such a
+// link is only followed while Generation is the same as when it was made.
+//
+// this is experimental and off by default: operands are still decoded by the
+// handlers every time, and with the memory handlers going through the TLB,
+// fetching from a block isn't faster than fetching from memory. on its own
+// it's a few percent slower than the plain interpreter, it's only worthwhile
+// for games which spend a lot of time in idle loops.
+
+namespace ARMDecodeCache
+{
+
+typedef void (*InstrHandler)(ARM* cpu);
+
+const u32 MaxBlockInstrs = 32;
+
+// for blocks from memory which is never written to
+const u32 NoPage = 0xFFFFFFFF;
+
+struct Block
+{
+    u32 Addr;       // of the first instruction, bit 0 set for THUMB
+    u8* Mem;        // host memory it was decoded from, to notice when the mapping changed
+    u32 Page;       // NDS::CodePages index, or NoPage
+    u32 NumInstrs;
+    bool IdleLoop;  // the last instruction branches back to the start, see above
+
+    // the block which ran after this one, see above
+    Block* Next;
+    u32 NextGeneration;
+
+    // the instructions (16-bit ones for THUMB), followed by
+    // the ones fetched ahead of them by the pipeline
+    u32 Instrs[MaxBlockInstrs + 3];
+    InstrHandler Handlers[MaxBlockInstrs];
+    u8 Conds[MaxBlockInstrs];
+};
+
+// increased every time blocks are thrown away or the memory code
+// is fetched from is mapped differently. a running block has to stop
+// when it changes, it might be one of them
+extern u32 Generation;
+
+extern bool IdleLoopSkip;
+
+void Reset();
+
+void InvalidatePage(u32 page);
+
+// finds or decodes the block starting at the next instruction
+// returns nullptr when the code can't be cached, or when the pipeline
+// doesn't hold what the block starts with (it was fetched before a write)
+// prev is the block which ran right before, if it still exists
+Block* LookUpBlock(ARMv5* cpu, Block* prev);
+Block* LookUpBlock(ARMv4* cpu, Block* prev);
+
+}
+
+#endif // ARMDECODECACHE_H
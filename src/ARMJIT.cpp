@@ -20,16 +20,22 @@
 
 #include <string.h>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
 #include <unordered_map>
 
 #define XXH_STATIC_LINKING_ONLY
 #include "xxhash/xxhash.h"
 
 #include "Platform.h"
+#include "Profiler.h"
 
 #include "ARMJIT_Internal.h"
 #include "ARMJIT_Memory.h"
 #include "ARMJIT_Compiler.h"
+#ifdef JIT_PERF_ENABLED
+#include "ARMJIT_Perf.h"
+#endif
 
 #include "ARMInterpreter_ALU.h"
 #include "ARMInterpreter_LoadStore.h"
@@ -64,6 +70,7 @@ int MaxBlockSize;
 bool LiteralOptimizations;
 bool BranchOptimizations;
 bool FastMemory;
+bool BackgroundCompilation;
 
 
 std::unordered_map<u32, JitBlock*> JitBlocks9;
@@ -71,6 +78,53 @@ std::unordered_map<u32, JitBlock*> JitBlocks7;
 
 std::unordered_map<u32, JitBlock*> RestoreCandidates;
 
+PendingExit PendingExits[2];
+ReturnStack ReturnStacks[2];
+
+u32 CurrentCheckpoint = 0;
+
+Stats CurrentStats;
+
+// when each code segment was last entered from the dispatcher
+u64 CodeSegmentLastUse[Compiler::NumCodeSegments];
+u64 CodeSegmentUses;
+
+// with background compilation, new blocks are queued for the compilation thread.
+// until their code is done they're in the block maps and code index, but without
+// an entry point, and the CPU runs them in the interpreter (the same way a block
+// is run while it's made). if one is thrown away before it's done, it's deleted
+// once it comes back from the compilation thread.
+struct CompileJob
+{
+    JitBlock* Block;
+    u32 Num;
+    bool Thumb;
+    bool HasMemoryInstr;
+    int NumInstrs;
+    FetchedInstr Instrs[32];
+};
+
+struct CompiledBlock
+{
+    JitBlock* Block;
+    JitBlockEntry Entry; // NULL if the code memory was full
+    u64 CompileTime;
+    u32 CodeSize;
+};
+
+const int CompileQueueSize = 64;
+CompileJob CompileQueue[CompileQueueSize];
+int CompileQueueStart, CompileQueueLength;
+CompiledBlock CompiledBlocks[CompileQueueSize];
+std::atomic_int NumCompiledBlocks;
+
+Platform::Thread* CompileThread;
+Platform::Semaphore* Sema_CompileStart;
+Platform::Mutex* CompileQueueLock;
+std::atomic_bool CompileThreadRunning;
+
+Platform::Mutex* CompilerLock;
+
 TinyVector<u32> InvalidLiterals;
 
 AddressRange CodeIndexITCM[ITCMPhysicalSize / 512];
@@ -316,20 +370,65 @@ void SlowBlockTransfer7(u32 addr, u64* data, u32 num)
 INSTANTIATE_SLOWMEM(0)
 INSTANTIATE_SLOWMEM(1)
 
+void CompileThreadFunc();
+
+void StartCompileThread()
+{
+    if (CompileThreadRunning) return;
+
+    Platform::Semaphore_Reset(Sema_CompileStart);
+    CompileThreadRunning = true;
+    CompileThread = Platform::Thread_Create(CompileThreadFunc);
+}
+
+void StopCompileThread()
+{
+    if (!CompileThreadRunning) return;
+
+    CompileThreadRunning = false;
+    Platform::Semaphore_Post(Sema_CompileStart);
+    Platform::Thread_Wait(CompileThread);
+    Platform::Thread_Free(CompileThread);
+    CompileThread = nullptr;
+}
+
 void Init()
 {
+#ifdef JIT_PERF_ENABLED
+    ARMJIT_Perf::Init();
+#endif
+
     JITCompiler = new Compiler();
 
+    CompileThread = nullptr;
+    CompileThreadRunning = false;
+    Sema_CompileStart = Platform::Semaphore_Create();
+    CompileQueueLock = Platform::Mutex_Create();
+    CompilerLock = Platform::Mutex_Create();
+    CompileQueueStart = 0;
+    CompileQueueLength = 0;
+    NumCompiledBlocks = 0;
+
     ARMJIT_Memory::Init();
 }
 
 void DeInit()
 {
+    StopCompileThread();
+
     JitEnableWrite();
     ResetBlockCache();
     ARMJIT_Memory::DeInit();
 
+    Platform::Semaphore_Free(Sema_CompileStart);
+    Platform::Mutex_Free(CompileQueueLock);
+    Platform::Mutex_Free(CompilerLock);
+
     delete JITCompiler;
+
+#ifdef JIT_PERF_ENABLED
+    ARMJIT_Perf::DeInit();
+#endif
 }
 
 void Reset()
@@ -338,16 +437,23 @@ void Reset()
     LiteralOptimizations = Platform::GetConfigBool(Platform::JIT_LiteralOptimizations);
     BranchOptimizations = Platform::GetConfigBool(Platform::JIT_BranchOptimizations);
     FastMemory = Platform::GetConfigBool(Platform::JIT_FastMemory);
+    BackgroundCompilation = Platform::GetConfigBool(Platform::JIT_BackgroundCompilation)
+        && JITCompiler->CanCompileInBackground();
 
     if (MaxBlockSize < 1)
         MaxBlockSize = 1;
     if (MaxBlockSize > 32)
         MaxBlockSize = 32;
 
+    StopCompileThread();
+
     JitEnableWrite();
     ResetBlockCache();
 
     ARMJIT_Memory::Reset();
+
+    if (BackgroundCompilation)
+        StartCompileThread();
 }
 
 void FloodFillSetFlags(FetchedInstr instrs[], int start, u8 flags)
@@ -368,6 +474,68 @@ void FloodFillSetFlags(FetchedInstr instrs[], int start, u8 flags)
     }
 }
 
+// how many instructions of the following blocks are looked at to find out which flags they need
+const int MaxFlagLookahead = 8;
+
+// returns the flags which the code at addr might read before setting them.
+// The instructions looked at are added to the address ranges of the block,
+// so that it's invalidated together with them.
+u8 FlagsReadAhead(ARM* cpu, bool thumb, u32 addr, int region,
+    u32* addressRanges, u32* addressMasks, u32& numAddressRanges, u32* instrValues, u32& numInstrs)
+{
+    u8 unknownFlags = 0xF;
+    u8 readFlags = 0;
+    u32 codeCycles = cpu->CodeCycles;
+    for (int i = 0; i < MaxFlagLookahead && unknownFlags; i++, addr += thumb ? 2 : 4)
+    {
+        // staying in the same region also means the code is read from the same place
+        // the block was (the ARM7 BIOS can only be read from inside of it)
+        u32 translatedAddr = LocaliseCodeAddress(cpu->Num, addr);
+        if ((translatedAddr >> 27) != region)
+            break;
+
+        u32 instr;
+        if (cpu->Num == 0)
+        {
+            // CodeRead32 can't be used here, CodeMem is set up for
+            // wherever the block jumped to last, not for addr
+            ARMv5* cpu9 = (ARMv5*)cpu;
+            u32 wordAddr = addr & ~0x3;
+            if (wordAddr < cpu9->ITCMSize)
+                instr = *(u32*)&cpu9->ITCM[wordAddr & (ITCMPhysicalSize - 1)];
+            else
+                instr = NDS::ConsoleType == 0 ? NDS::ARM9Read32(wordAddr) : DSi::ARM9Read32(wordAddr);
+            if (thumb)
+                instr = (instr >> ((addr & 0x2) * 8)) & 0xFFFF;
+        }
+        else
+        {
+            instr = thumb ? ((ARMv4*)cpu)->CodeRead16(addr) : ((ARMv4*)cpu)->CodeRead32(addr);
+        }
+
+        u32 translatedAddrRounded = translatedAddr & ~0x1FF;
+        u32 j = 0;
+        for (; j < numAddressRanges; j++)
+            if (addressRanges[j] == translatedAddrRounded)
+                break;
+        if (j == numAddressRanges)
+            addressRanges[numAddressRanges++] = translatedAddrRounded;
+        addressMasks[j] |= 1 << ((translatedAddr & 0x1FF) / 16);
+        instrValues[numInstrs++] = instr;
+
+        ARMInstrInfo::Info info = ARMInstrInfo::Decode(thumb, cpu->Num, instr);
+        // like within a block, interpreted instructions read all flags
+        if (info.EndBlock || !JITCompiler->CanCompile(thumb, info.Kind))
+            break;
+
+        readFlags |= info.ReadFlags & unknownFlags;
+        unknownFlags &= ~(info.ReadFlags | info.WriteFlags);
+    }
+    cpu->CodeCycles = codeCycles;
+
+    return readFlags | unknownFlags;
+}
+
 bool DecodeLiteral(bool thumb, const FetchedInstr& instr, u32& addr)
 {
     if (!thumb)
@@ -456,6 +624,104 @@ bool DecodeBranch(bool thumb, const FetchedInstr& instr, u32& cond, bool hasLink
     return false;
 }
 
+// the target the compiler passes to Comp_JumpTo for branches with an immediate
+// (including the thumb bit if the branch switches to/stays in thumb mode)
+bool DecodeJumpTarget(bool thumb, u32 num, const FetchedInstr& instr, u32& targetAddr)
+{
+    if (thumb)
+    {
+        u32 r15 = instr.Addr + 4;
+
+        if (instr.Info.Kind == ARMInstrInfo::tk_B)
+        {
+            s32 offset = (s32)((instr.Instr & 0x7FF) << 21) >> 20;
+            targetAddr = r15 + offset + 1;
+            return true;
+        }
+        else if (instr.Info.Kind == ARMInstrInfo::tk_BCOND)
+        {
+            s32 offset = (s32)(instr.Instr << 24) >> 23;
+            targetAddr = r15 + offset + 1;
+            return true;
+        }
+        else if (instr.Info.Kind == ARMInstrInfo::tk_BL_LONG)
+        {
+            targetAddr = r15 + ((s32)((instr.Instr & 0x7FF) << 21) >> 9);
+            targetAddr += ((instr.Instr >> 16) & 0x7FF) << 1;
+            if (num == 1 || instr.Instr & (1 << 28))
+                targetAddr |= 1;
+            return true;
+        }
+    }
+    else if (instr.Info.Kind == ARMInstrInfo::ak_B
+        || instr.Info.Kind == ARMInstrInfo::ak_BL
+        || instr.Info.Kind == ARMInstrInfo::ak_BLX_IMM)
+    {
+        s32 offset = (s32)(instr.Instr << 8) >> 6;
+        targetAddr = instr.Addr + 8 + offset;
+        if (instr.Cond() == 0xF)
+            targetAddr += (((instr.Instr >> 24) & 1) << 1) + 1;
+        return true;
+    }
+    return false;
+}
+
+// the timing CodeRead32 would have
+u32 CodeReadCycles9(ARMv5* cpu, u32 regionCodeCycles, u32 addr, bool branch)
+{
+    if (addr < cpu->ITCMSize)
+        return 1;
+    if (regionCodeCycles == 0xFF) // cached memory
+        return (branch || !(addr & 0x1F)) ? kCodeCacheTiming : 1;
+    return regionCodeCycles;
+}
+
+// the cycles it takes to refill the pipeline after jumping to addr
+void DecodeJumpTimings(ARM* cpu, FetchedInstr& instr, u32 addr)
+{
+    u32 cycles = 0;
+    if (cpu->Num == 0)
+    {
+        ARMv5* cpu9 = (ARMv5*)cpu;
+
+        u32 regionCodeCycles = cpu9->MemTimings[addr >> 12][0];
+        instr.JumpRegionCodeCycles = regionCodeCycles;
+
+        if (addr & 0x1)
+        {
+            addr &= ~0x1;
+
+            // two-opcodes-at-once fetch
+            if (addr & 0x2)
+            {
+                cycles += CodeReadCycles9(cpu9, regionCodeCycles, addr-2, true);
+                cycles += CodeReadCycles9(cpu9, regionCodeCycles, addr+2, false);
+            }
+            else
+            {
+                cycles += CodeReadCycles9(cpu9, regionCodeCycles, addr, true);
+            }
+        }
+        else
+        {
+            addr &= ~0x3;
+
+            cycles += CodeReadCycles9(cpu9, regionCodeCycles, addr, true);
+            cycles += CodeReadCycles9(cpu9, regionCodeCycles, addr+4, false);
+        }
+    }
+    else
+    {
+        u32 codeCycles = addr >> 15; // cheato
+
+        if (addr & 0x1)
+            cycles += NDS::ARM7MemTimings[codeCycles][0] + NDS::ARM7MemTimings[codeCycles][1];
+        else
+            cycles += NDS::ARM7MemTimings[codeCycles][2] + NDS::ARM7MemTimings[codeCycles][3];
+    }
+    instr.JumpCycles = cycles;
+}
+
 bool IsIdleLoop(bool thumb, FetchedInstr* instrs, int instrsCount)
 {
     // see https://github.com/dolphin-emu/dolphin/blob/master/Source/Core/Core/PowerPC/PPCAnalyst.cpp#L678
@@ -574,8 +840,76 @@ InterpreterFunc InterpretTHUMB[ARMInstrInfo::tk_Count] =
 };
 #undef F
 
+void UnlinkJitBlock(JitBlock* block)
+{
+    if (block->LinkedExits.Length == 0)
+        return;
+
+    JitEnableWrite();
+    for (int i = 0; i < block->LinkedExits.Length; i++)
+        JITCompiler->UnlinkExit(block->LinkedExits[i]);
+    JitEnableExecute();
+
+    block->LinkedExits.Clear();
+}
+
+void UnlinkAllBlocks()
+{
+    for (auto it : JitBlocks9)
+        UnlinkJitBlock(it.second);
+    for (auto it : JitBlocks7)
+        UnlinkJitBlock(it.second);
+}
+
+bool MayLinkTo(JitBlock* block)
+{
+    // only memory which always stays at the same place can be linked to,
+    // otherwise the address might lead somewhere else after a remap
+    // (the mapping of ITCM and DSi main RAM changes are handled by UnlinkAllBlocks)
+    switch (block->StartAddrLocal >> 27)
+    {
+    case ARMJIT_Memory::memregion_ITCM:
+    case ARMJIT_Memory::memregion_BIOS9:
+    case ARMJIT_Memory::memregion_MainRAM:
+    case ARMJIT_Memory::memregion_BIOS7:
+        return true;
+    case ARMJIT_Memory::memregion_WRAM7:
+        // below it's mirrored where shared WRAM isn't mapped
+        return block->StartAddr >= 0x03800000;
+    default:
+        return false;
+    }
+}
+
+void LinkPendingExit(u32 num, u32 addr, JitBlockEntry entry)
+{
+    u32 exit = PendingExits[num].Exit;
+    PendingExits[num].Target = UINT32_MAX;
+
+    auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+    auto it = map.find(addr);
+    if (it == map.end())
+        return;
+
+    JitBlock* block = it->second;
+    if (block->EntryPoint != entry || !MayLinkTo(block) || block->LinkedExits.Length == UINT16_MAX)
+        return;
+
+    JitEnableWrite();
+    JITCompiler->LinkExit(exit, entry);
+    JitEnableExecute();
+
+    block->LinkedExits.Add(exit);
+}
+
 void RetireJitBlock(JitBlock* block)
 {
+    // it's still being compiled, it's deleted once that's done
+    if (!block->EntryPoint)
+        return;
+
+    UnlinkJitBlock(block);
+
     auto it = RestoreCandidates.find(block->InstrHash);
     if (it != RestoreCandidates.end())
     {
@@ -588,8 +922,313 @@ void RetireJitBlock(JitBlock* block)
     }
 }
 
+void RemoveFromCodeIndex(JitBlock* block)
+{
+    for (int j = 0; j < block->NumAddresses; j++)
+    {
+        u32 addr = block->AddressRanges()[j];
+        AddressRange* region = CodeMemRegions[addr >> 27];
+        AddressRange* range = &region[(addr & 0x7FFFFFF) / 512];
+
+        bool removed = range->Blocks.RemoveByValue(block);
+        assert(removed);
+
+        range->Code = 0;
+        for (int k = 0; k < range->Blocks.Length; k++)
+        {
+            JitBlock* other = range->Blocks[k];
+            for (int l = 0; l < other->NumAddresses; l++)
+            {
+                if (other->AddressRanges()[l] == addr)
+                {
+                    range->Code |= other->AddressMasks()[l];
+                    break;
+                }
+            }
+        }
+
+        if (range->Blocks.Length == 0
+            && !PageContainsCode(&region[(addr & 0x7FFF000) / 512]))
+        {
+            ARMJIT_Memory::SetCodeProtection(addr >> 27, addr & 0x7FFFFFF, false);
+        }
+    }
+}
+
+bool IsInCodeSegment(u32 offset, int segment)
+{
+    return JITCompiler->GetCodeSegment(offset) == segment;
+}
+
+void EvictCodeSegment()
+{
+    Platform::Mutex_Lock(CompilerLock);
+
+    // it might have been made space already
+    if (!JITCompiler->IsFull())
+    {
+        Platform::Mutex_Unlock(CompilerLock);
+        return;
+    }
+
+    int segment = -1;
+    for (int i = 0; i < Compiler::NumCodeSegments; i++)
+    {
+        if (i != JITCompiler->GetCurCodeSegment()
+            && (segment == -1 || CodeSegmentLastUse[i] < CodeSegmentLastUse[segment]))
+            segment = i;
+    }
+
+    if (segment == -1)
+    {
+        Platform::Mutex_Unlock(CompilerLock);
+        Log(LogLevel::Debug, "JIT code memory full\n");
+        ResetBlockCache();
+        return;
+    }
+
+    Log(LogLevel::Debug, "JIT code memory full, evicting segment %d\n", segment);
+
+    // blocks which are compiled but not yet made available are always
+    // in the current segment, the compilation thread only fills that one
+    for (int num = 0; num < 2; num++)
+    {
+        auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+        for (auto it = map.begin(); it != map.end();)
+        {
+            JitBlock* block = it->second;
+            if (!block->EntryPoint || !IsInCodeSegment(JITCompiler->SubEntryOffset(block->EntryPoint), segment))
+            {
+                it++;
+                continue;
+            }
+
+            RemoveFromCodeIndex(block);
+            FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2] = (u64)UINT32_MAX << 32;
+            UnlinkJitBlock(block);
+            delete block;
+            it = map.erase(it);
+
+            CurrentStats.EvictedBlocks++;
+        }
+    }
+    for (auto it = RestoreCandidates.begin(); it != RestoreCandidates.end();)
+    {
+        if (IsInCodeSegment(JITCompiler->SubEntryOffset(it->second->EntryPoint), segment))
+        {
+            delete it->second;
+            it = RestoreCandidates.erase(it);
+
+            CurrentStats.EvictedBlocks++;
+        }
+        else
+            it++;
+    }
+
+    // the remaining blocks might still be linked to from the evicted code
+    for (int num = 0; num < 2; num++)
+    {
+        auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+        for (auto it : map)
+        {
+            TinyVector<u32>& exits = it.second->LinkedExits;
+            for (int i = 0; i < exits.Length;)
+            {
+                if (IsInCodeSegment(exits[i], segment))
+                    exits.Remove(i);
+                else
+                    i++;
+            }
+        }
+
+        if (PendingExits[num].Target != UINT32_MAX && IsInCodeSegment(PendingExits[num].Exit, segment))
+            PendingExits[num].Target = UINT32_MAX;
+        for (int i = 0; i < ReturnStackSize; i++)
+        {
+            if (ReturnStacks[num].Keys[i] && IsInCodeSegment(ReturnStacks[num].Exits[i], segment))
+                ReturnStacks[num].Keys[i] = 0;
+        }
+    }
+
+    JitEnableWrite();
+    JITCompiler->ClearCodeSegment(segment);
+    JITCompiler->SetCodeSegment(segment);
+    JitEnableExecute();
+    CodeSegmentLastUse[segment] = ++CodeSegmentUses;
+
+    CurrentStats.Evictions++;
+
+    Platform::Mutex_Unlock(CompilerLock);
+}
+
+bool IsBlockInUse(JitBlock* block)
+{
+    auto& map = block->Num == 0 ? JitBlocks9 : JitBlocks7;
+    auto it = map.find(block->StartAddr);
+    return it != map.end() && it->second == block;
+}
+
+u64 GetHostTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CompileThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_CompileStart);
+        if (!CompileThreadRunning) break;
+
+        Platform::Mutex_Lock(CompilerLock);
+
+        Platform::Mutex_Lock(CompileQueueLock);
+        if (CompileQueueLength == 0)
+        {
+            // the queue was cleared in the meantime
+            Platform::Mutex_Unlock(CompileQueueLock);
+            Platform::Mutex_Unlock(CompilerLock);
+            continue;
+        }
+        // it stays in the queue until it's done, so its slot isn't reused
+        CompileJob& job = CompileQueue[CompileQueueStart];
+        Platform::Mutex_Unlock(CompileQueueLock);
+
+        JitBlockEntry entry = NULL;
+        u64 startTime = GetHostTime();
+        u32 startSize = JITCompiler->UsedCodeMemory();
+        if (!JITCompiler->IsFull())
+        {
+            ARM* cpu = job.Num == 0 ? (ARM*)NDS::ARM9 : (ARM*)NDS::ARM7;
+
+            JitEnableWrite();
+            entry = JITCompiler->CompileBlock(cpu, job.Thumb, job.Instrs, job.NumInstrs, job.HasMemoryInstr);
+            JitEnableExecute();
+        }
+
+        Platform::Mutex_Lock(CompileQueueLock);
+        CompiledBlocks[NumCompiledBlocks] = {job.Block, entry,
+            GetHostTime() - startTime, JITCompiler->UsedCodeMemory() - startSize};
+        NumCompiledBlocks++;
+        CompileQueueStart = (CompileQueueStart + 1) % CompileQueueSize;
+        CompileQueueLength--;
+        Platform::Mutex_Unlock(CompileQueueLock);
+
+        Platform::Mutex_Unlock(CompilerLock);
+    }
+}
+
+bool QueueBlock(JitBlock* block, bool thumb, FetchedInstr instrs[], int numInstrs, bool hasMemoryInstr)
+{
+    Platform::Mutex_Lock(CompileQueueLock);
+    if (CompileQueueLength + NumCompiledBlocks >= CompileQueueSize)
+    {
+        Platform::Mutex_Unlock(CompileQueueLock);
+        return false;
+    }
+
+    CompileJob& job = CompileQueue[(CompileQueueStart + CompileQueueLength) % CompileQueueSize];
+    job.Block = block;
+    job.Num = block->Num;
+    job.Thumb = thumb;
+    job.HasMemoryInstr = hasMemoryInstr;
+    job.NumInstrs = numInstrs;
+    memcpy(job.Instrs, instrs, numInstrs * sizeof(FetchedInstr));
+    CompileQueueLength++;
+    Platform::Mutex_Unlock(CompileQueueLock);
+
+    block->EntryPoint = NULL;
+    Platform::Semaphore_Post(Sema_CompileStart);
+    return true;
+}
+
+void CountCompiledBlock(CompiledBlock& compiled)
+{
+    if (compiled.Entry)
+        CurrentStats.BlocksCompiled[compiled.Block->Num]++;
+    CurrentStats.CompileTime += compiled.CompileTime;
+    CurrentStats.CodeSize += compiled.CodeSize;
+}
+
+void FinishCompiledBlocks()
+{
+    if (NumCompiledBlocks == 0)
+        return;
+
+    bool full = false;
+
+    Platform::Mutex_Lock(CompileQueueLock);
+    for (int i = 0; i < NumCompiledBlocks; i++)
+    {
+        JitBlock* block = CompiledBlocks[i].Block;
+
+        CountCompiledBlock(CompiledBlocks[i]);
+
+        if (!IsBlockInUse(block))
+        {
+            // it was invalidated while it was compiled
+            delete block;
+        }
+        else if (!CompiledBlocks[i].Entry)
+        {
+            // it's thrown away, to be compiled again once there's space
+            RemoveFromCodeIndex(block);
+            auto& map = block->Num == 0 ? JitBlocks9 : JitBlocks7;
+            map.erase(block->StartAddr);
+            delete block;
+
+            full = true;
+        }
+        else
+        {
+            block->EntryPoint = CompiledBlocks[i].Entry;
+
+            u64* entry = &FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2];
+            *entry = ((u64)block->StartAddr | block->Num) << 32;
+            *entry |= JITCompiler->SubEntryOffset(block->EntryPoint);
+
+            if (PendingExits[block->Num].Target == block->StartAddr)
+                LinkPendingExit(block->Num, block->StartAddr, block->EntryPoint);
+        }
+    }
+    NumCompiledBlocks = 0;
+    Platform::Mutex_Unlock(CompileQueueLock);
+
+    if (full)
+        EvictCodeSegment();
+}
+
+void DiscardCompileJobs()
+{
+    // blocks which are still in use are deleted with all the others
+    Platform::Mutex_Lock(CompileQueueLock);
+    for (int i = 0; i < CompileQueueLength; i++)
+    {
+        JitBlock* block = CompileQueue[(CompileQueueStart + i) % CompileQueueSize].Block;
+        if (!IsBlockInUse(block))
+            delete block;
+    }
+    for (int i = 0; i < NumCompiledBlocks; i++)
+    {
+        CountCompiledBlock(CompiledBlocks[i]);
+
+        if (!IsBlockInUse(CompiledBlocks[i].Block))
+            delete CompiledBlocks[i].Block;
+    }
+    CompileQueueStart = 0;
+    CompileQueueLength = 0;
+    NumCompiledBlocks = 0;
+    Platform::Mutex_Unlock(CompileQueueLock);
+}
+
 void CompileBlock(ARM* cpu)
 {
+    PROFILE_SCOPE(Profiler::Counter_JITCompile);
+
+    if (BackgroundCompilation)
+        FinishCompiledBlocks();
+
     bool thumb = cpu->CPSR & 0x20;
 
     u32 blockAddr = cpu->R[15] - (thumb ? 2 : 4);
@@ -600,9 +1239,16 @@ void CompileBlock(ARM* cpu)
         Log(LogLevel::Warn, "trying to compile non executable code? %x\n", blockAddr);
     }
 
+    // the block is only run, it's still being compiled
+    bool interpretOnly = false;
+
     auto& map = cpu->Num == 0 ? JitBlocks9 : JitBlocks7;
     auto existingBlockIt = map.find(blockAddr);
-    if (existingBlockIt != map.end())
+    if (existingBlockIt != map.end() && !existingBlockIt->second->EntryPoint)
+    {
+        interpretOnly = true;
+    }
+    else if (existingBlockIt != map.end())
     {
         // there's already a block, though it's not inside the fast map
         // could be that there are two blocks at the same physical addr
@@ -616,6 +1262,9 @@ void CompileBlock(ARM* cpu)
             u64* entry = &FastBlockLookupRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 2];
             *entry = ((u64)blockAddr | cpu->Num) << 32;
             *entry |= JITCompiler->SubEntryOffset(existingBlockIt->second->EntryPoint);
+
+            if (PendingExits[cpu->Num].Target == blockAddr)
+                LinkPendingExit(cpu->Num, blockAddr, existingBlockIt->second->EntryPoint);
             return;
         }
 
@@ -628,16 +1277,16 @@ void CompileBlock(ARM* cpu)
     int i = 0;
     u32 r15 = cpu->R[15];
 
-    u32 addressRanges[MaxBlockSize];
-    u32 addressMasks[MaxBlockSize];
-    memset(addressMasks, 0, MaxBlockSize * sizeof(u32));
+    u32 addressRanges[MaxBlockSize + 2 * MaxFlagLookahead];
+    u32 addressMasks[MaxBlockSize + 2 * MaxFlagLookahead];
+    memset(addressMasks, 0, (MaxBlockSize + 2 * MaxFlagLookahead) * sizeof(u32));
     u32 numAddressRanges = 0;
 
     u32 numLiterals = 0;
     u32 literalLoadAddrs[MaxBlockSize];
     // they are going to be hashed
     u32 literalValues[MaxBlockSize];
-    u32 instrValues[MaxBlockSize];
+    u32 instrValues[MaxBlockSize + 2 * MaxFlagLookahead];
     // due to instruction merging i might not reflect the amount of actual instructions
     u32 numInstrs = 0;
 
@@ -662,6 +1311,7 @@ void CompileBlock(ARM* cpu)
 
         instrs[i].BranchFlags = 0;
         instrs[i].SetFlags = 0;
+        instrs[i].HasLiteral = false;
         instrs[i].Instr = nextInstr[0];
         nextInstr[0] = nextInstr[1];
 
@@ -715,6 +1365,8 @@ void CompileBlock(ARM* cpu)
             else
                 nextInstr[1] = cpuv4->CodeRead32(r15);
             instrs[i].CodeCycles = cpu->CodeCycles;
+            instrs[i].CodeCyclesN = NDS::ARM7MemTimings[cpu->CodeCycles][thumb ? 0 : 2];
+            instrs[i].CodeCyclesS = NDS::ARM7MemTimings[cpu->CodeCycles][thumb ? 1 : 3];
         }
         instrs[i].Info = ARMInstrInfo::Decode(thumb, cpu->Num, instrs[i].Instr);
 
@@ -758,6 +1410,9 @@ void CompileBlock(ARM* cpu)
 
         instrs[i].DataCycles = cpu->DataCycles;
         instrs[i].DataRegion = cpu->DataRegion;
+        instrs[i].DataMemRegion = cpu->Num == 0
+            ? ARMJIT_Memory::ClassifyAddress9(cpu->DataRegion)
+            : ARMJIT_Memory::ClassifyAddress7(cpu->DataRegion);
 
         u32 literalAddr;
         if (LiteralOptimizations
@@ -783,6 +1438,10 @@ void CompileBlock(ARM* cpu)
                 JIT_DEBUGPRINT("literal loading %08x %08x %08x %08x\n", literalAddr, translatedAddr, addressMasks[j], addressRanges[j]);
                 cpu->DataRead32(literalAddr, &literalValues[numLiterals]);
                 literalLoadAddrs[numLiterals++] = translatedAddr;
+
+                instrs[i].HasLiteral = true;
+                instrs[i].LiteralAddr = literalAddr;
+                instrs[i].Literal = literalValues[numLiterals - 1];
             }
         }
         else if (instrs[i].Info.SpecialKind == ARMInstrInfo::special_WriteMem)
@@ -799,6 +1458,10 @@ void CompileBlock(ARM* cpu)
             JIT_DEBUGPRINT("merged BL\n");
         }
 
+        u32 jumpTarget;
+        if (DecodeJumpTarget(thumb, cpu->Num, instrs[i], jumpTarget))
+            DecodeJumpTimings(cpu, instrs[i], jumpTarget);
+
         if (instrs[i].Info.Branches() && BranchOptimizations
             && instrs[i].Info.Kind != (thumb ? ARMInstrInfo::tk_SVC : ARMInstrInfo::ak_SVC))
         {
@@ -880,6 +1543,43 @@ void CompileBlock(ARM* cpu)
             FloodFillSetFlags(instrs, i - 2, !secondaryFlagReadCond ? instrs[i - 1].Info.ReadFlags : 0xF);
     } while(!instrs[i - 1].Info.EndBlock && i < MaxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80)));
 
+    if (interpretOnly)
+        return;
+
+    // flags which aren't needed by the blocks following this one don't have to be set
+    u8 exitFlags = 0xF;
+    if (BranchOptimizations && !cpu->Halted)
+    {
+        const FetchedInstr& lastInstr = instrs[i - 1];
+        u32 exitAddrs[2];
+        int numExits = 0;
+        if (!lastInstr.Info.Branches())
+        {
+            if (!lastInstr.Info.EndBlock)
+                exitAddrs[numExits++] = lastInstr.Addr + (thumb ? 2 : 4);
+        }
+        else if (thumb
+            ? (lastInstr.Info.Kind == ARMInstrInfo::tk_B || lastInstr.Info.Kind == ARMInstrInfo::tk_BCOND)
+            : (lastInstr.Info.Kind == ARMInstrInfo::ak_B || lastInstr.Info.Kind == ARMInstrInfo::ak_BL))
+        {
+            bool link;
+            u32 cond, target, linkAddr;
+            DecodeBranch(thumb, lastInstr, cond, false, 0, link, linkAddr, target);
+            exitAddrs[numExits++] = target;
+            if (cond < 0xE)
+                exitAddrs[numExits++] = lastInstr.Addr + (thumb ? 2 : 4);
+        }
+
+        if (numExits > 0)
+        {
+            int region = LocaliseCodeAddress(cpu->Num, lastInstr.Addr) >> 27;
+            exitFlags = 0;
+            for (int j = 0; j < numExits; j++)
+                exitFlags |= FlagsReadAhead(cpu, thumb, exitAddrs[j], region,
+                    addressRanges, addressMasks, numAddressRanges, instrValues, numInstrs);
+        }
+    }
+
     if (numLiterals)
     {
         for (u32 j = 0; j < numWriteAddrs; j++)
@@ -911,7 +1611,7 @@ void CompileBlock(ARM* cpu)
         prevBlock = prevBlockIt->second;
         RestoreCandidates.erase(prevBlockIt);
 
-        mayRestore = prevBlock->StartAddr == blockAddr && prevBlock->LiteralHash == literalHash;
+        mayRestore = prevBlock->StartAddr == blockAddr && prevBlock->LiteralHash == literalHash && prevBlock->Num == cpu->Num;
 
         if (mayRestore && prevBlock->NumAddresses == numAddressRanges)
         {
@@ -952,11 +1652,42 @@ void CompileBlock(ARM* cpu)
         block->StartAddr = blockAddr;
         block->StartAddrLocal = localAddr;
 
-        FloodFillSetFlags(instrs, i - 1, 0xF);
+        FloodFillSetFlags(instrs, i - 1, exitFlags);
+
+        // the block might have written to its own literals
+        if (numLiterals)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                if (instrs[j].HasLiteral
+                    && InvalidLiterals.Find(LocaliseCodeAddress(cpu->Num, instrs[j].LiteralAddr)) != -1)
+                    instrs[j].HasLiteral = false;
+            }
+        }
+
+        // if the queue is full it's compiled right away
+        if (!BackgroundCompilation || !QueueBlock(block, thumb, instrs, i, hasMemoryInstr))
+        {
+            Platform::Mutex_Lock(CompilerLock);
+            while (JITCompiler->IsFull())
+            {
+                Platform::Mutex_Unlock(CompilerLock);
+                EvictCodeSegment();
+                Platform::Mutex_Lock(CompilerLock);
+            }
+
+            u64 startTime = GetHostTime();
+            u32 startSize = JITCompiler->UsedCodeMemory();
+
+            JitEnableWrite();
+            block->EntryPoint = JITCompiler->CompileBlock(cpu, thumb, instrs, i, hasMemoryInstr);
+            JitEnableExecute();
 
-        JitEnableWrite();
-        block->EntryPoint = JITCompiler->CompileBlock(cpu, thumb, instrs, i, hasMemoryInstr);
-        JitEnableExecute();
+            CurrentStats.BlocksCompiled[cpu->Num]++;
+            CurrentStats.CompileTime += GetHostTime() - startTime;
+            CurrentStats.CodeSize += JITCompiler->UsedCodeMemory() - startSize;
+            Platform::Mutex_Unlock(CompilerLock);
+        }
 
         JIT_DEBUGPRINT("block start %p\n", block->EntryPoint);
     }
@@ -964,8 +1695,12 @@ void CompileBlock(ARM* cpu)
     {
         JIT_DEBUGPRINT("restored! %p\n", prevBlock);
         block = prevBlock;
+        CurrentStats.BlocksRestored[cpu->Num]++;
     }
 
+    // restored blocks count as new too, the memory might have changed since the checkpoint
+    block->Checkpoint = CurrentCheckpoint;
+
     assert((localAddr & 1) == 0);
     for (u32 j = 0; j < numAddressRanges; j++)
     {
@@ -988,9 +1723,16 @@ void CompileBlock(ARM* cpu)
     else
         JitBlocks7[blockAddr] = block;
 
+    // it's made available once it's compiled
+    if (!block->EntryPoint)
+        return;
+
     u64* entry = &FastBlockLookupRegions[(localAddr >> 27)][(localAddr & 0x7FFFFFF) / 2];
     *entry = ((u64)blockAddr | cpu->Num) << 32;
     *entry |= JITCompiler->SubEntryOffset(block->EntryPoint);
+
+    if (PendingExits[cpu->Num].Target == blockAddr)
+        LinkPendingExit(cpu->Num, blockAddr, block->EntryPoint);
 }
 
 void InvalidateByAddr(u32 localAddr)
@@ -1026,6 +1768,7 @@ void InvalidateByAddr(u32 localAddr)
             continue;
         }
         range->Blocks.Remove(i);
+        CurrentStats.Invalidations[localAddr >> 27]++;
 
         if (range->Blocks.Length == 0
             && !PageContainsCode(&region[(localAddr & 0x7FFF000) / 512]))
@@ -1045,6 +1788,7 @@ void InvalidateByAddr(u32 localAddr)
                     JIT_DEBUGPRINT("found invalid literal %d\n", InvalidLiterals.Length);
                 }
                 literalInvalidation = true;
+                CurrentStats.LiteralInvalidations++;
                 break;
             }
         }
@@ -1080,8 +1824,9 @@ void InvalidateByAddr(u32 localAddr)
         {
             RetireJitBlock(block);
         }
-        else
+        else if (block->EntryPoint)
         {
+            UnlinkJitBlock(block);
             delete block;
         }
     }
@@ -1129,11 +1874,28 @@ void CheckAndInvalidate(u32 addr)
         InvalidateByAddr(localAddr);
 }
 
+void GetStats(Stats* stats)
+{
+    *stats = CurrentStats;
+}
+
+void ResetStats()
+{
+    memset(&CurrentStats, 0, sizeof(CurrentStats));
+}
+
 JitBlockEntry LookUpBlock(u32 num, u64* entries, u32 offset, u32 addr)
 {
     u64* entry = &entries[offset / 2];
     if (*entry >> 32 == (addr | num))
-        return JITCompiler->AddEntryOffset((u32)*entry);
+    {
+        JitBlockEntry block = JITCompiler->AddEntryOffset((u32)*entry);
+        CodeSegmentLastUse[JITCompiler->GetCodeSegment((u32)*entry)] = ++CodeSegmentUses;
+        CurrentStats.Lookups[num]++;
+        if (PendingExits[num].Target == addr)
+            LinkPendingExit(num, addr, block);
+        return block;
+    }
     return NULL;
 }
 
@@ -1180,11 +1942,20 @@ void ResetBlockCache()
 {
     Log(LogLevel::Debug, "Resetting JIT block cache...\n");
 
+    // nothing can be compiled while everything is thrown away
+    Platform::Mutex_Lock(CompilerLock);
+    DiscardCompileJobs();
+
+    CurrentStats.CacheResets++;
+
     // could be replace through a function which only resets
     // the permissions but we're too lazy
     ARMJIT_Memory::Reset();
 
     InvalidLiterals.Clear();
+    PendingExits[0].Target = UINT32_MAX;
+    PendingExits[1].Target = UINT32_MAX;
+    memset(ReturnStacks, 0, sizeof(ReturnStacks));
     for (int i = 0; i < ARMJIT_Memory::memregions_Count; i++)
     {
         if (FastBlockLookupRegions[i])
@@ -1221,6 +1992,221 @@ void ResetBlockCache()
     JitBlocks7.clear();
 
     JITCompiler->Reset();
+    memset(CodeSegmentLastUse, 0, sizeof(CodeSegmentLastUse));
+
+    Platform::Mutex_Unlock(CompilerLock);
+}
+
+const u32 CodeCacheMagic = 0x54494A4D; // MJIT
+const u32 CodeCacheVersion = 2;
+
+void WriteCodeCacheHeader(FILE* file)
+{
+    u32 header[] =
+    {
+        CodeCacheMagic, CodeCacheVersion,
+        (u32)NDS::ConsoleType, (u32)MaxBlockSize,
+        LiteralOptimizations, BranchOptimizations, FastMemory
+    };
+    fwrite(header, sizeof(header), 1, file);
+}
+
+bool CheckCodeCacheHeader(FILE* file)
+{
+    u32 expected[7], header[7];
+    expected[0] = CodeCacheMagic; expected[1] = CodeCacheVersion;
+    expected[2] = NDS::ConsoleType; expected[3] = MaxBlockSize;
+    expected[4] = LiteralOptimizations; expected[5] = BranchOptimizations; expected[6] = FastMemory;
+
+    return fread(header, sizeof(header), 1, file) == 1 && memcmp(header, expected, sizeof(header)) == 0;
+}
+
+void WriteCodeCacheBlock(FILE* file, JitBlock* block)
+{
+    u32 entry = JITCompiler->SubEntryOffset(block->EntryPoint);
+    fwrite(&block->Num, sizeof(block->Num), 1, file);
+    fwrite(&block->NumAddresses, sizeof(block->NumAddresses), 1, file);
+    fwrite(&block->NumLiterals, sizeof(block->NumLiterals), 1, file);
+    fwrite(&block->StartAddr, sizeof(block->StartAddr), 1, file);
+    fwrite(&block->StartAddrLocal, sizeof(block->StartAddrLocal), 1, file);
+    fwrite(&block->InstrHash, sizeof(block->InstrHash), 1, file);
+    fwrite(&block->LiteralHash, sizeof(block->LiteralHash), 1, file);
+    fwrite(&entry, sizeof(entry), 1, file);
+    fwrite(block->AddressRanges(), sizeof(u32), block->NumAddresses * 2 + block->NumLiterals, file);
+}
+
+// whether a local address from the code cache lies within a region
+// which has a code index, lookup is optional (see FastBlockLookupRegions)
+bool IsValidCodeCacheAddr(u32 localAddr, bool lookup)
+{
+    u32 region = localAddr >> 27;
+    return region < ARMJIT_Memory::memregions_Count
+        && (lookup ? FastBlockLookupRegions[region] != NULL : CodeMemRegions[region] != NULL)
+        && (localAddr & 0x7FFFFFF) < CodeRegionSizes[region];
+}
+
+JitBlock* ReadCodeCacheBlock(FILE* file)
+{
+    u8 num;
+    u16 numAddresses, numLiterals;
+    if (fread(&num, sizeof(num), 1, file) != 1
+        || fread(&numAddresses, sizeof(numAddresses), 1, file) != 1
+        || fread(&numLiterals, sizeof(numLiterals), 1, file) != 1
+        || num > 1 || numAddresses == 0 || numAddresses > MaxBlockSize + 2 * MaxFlagLookahead || numLiterals > MaxBlockSize)
+        return NULL;
+
+    JitBlock* block = new JitBlock(num, 0, numAddresses, numLiterals);
+    u32 entry;
+    if (fread(&block->StartAddr, sizeof(block->StartAddr), 1, file) != 1
+        || fread(&block->StartAddrLocal, sizeof(block->StartAddrLocal), 1, file) != 1
+        || fread(&block->InstrHash, sizeof(block->InstrHash), 1, file) != 1
+        || fread(&block->LiteralHash, sizeof(block->LiteralHash), 1, file) != 1
+        || fread(&entry, sizeof(entry), 1, file) != 1
+        || fread(block->AddressRanges(), sizeof(u32), numAddresses * 2 + numLiterals, file) != numAddresses * 2 + numLiterals
+        || !JITCompiler->IsLoadedEntryOffset(entry)
+        || !IsValidCodeCacheAddr(block->StartAddrLocal, true))
+    {
+        delete block;
+        return NULL;
+    }
+    for (u32 i = 0; i < numAddresses; i++)
+    {
+        if (!IsValidCodeCacheAddr(block->AddressRanges()[i], false))
+        {
+            delete block;
+            return NULL;
+        }
+    }
+    block->EntryPoint = JITCompiler->AddEntryOffset(entry);
+    block->Checkpoint = 0;
+    return block;
+}
+
+bool SaveCodeCache(const std::string& path)
+{
+    if (!JITCompiler->CanSaveCode())
+        return false;
+
+    FILE* file = Platform::OpenFile(path, "wb");
+    if (!file)
+        return false;
+
+    // links are made again when the code is run
+    UnlinkAllBlocks();
+
+    Platform::Mutex_Lock(CompilerLock);
+
+    WriteCodeCacheHeader(file);
+    JITCompiler->SaveCode(file);
+
+    // blocks which are still being compiled are left out
+    u32 numBlocks = RestoreCandidates.size();
+    for (auto it : JitBlocks9)
+        numBlocks += it.second->EntryPoint != NULL;
+    for (auto it : JitBlocks7)
+        numBlocks += it.second->EntryPoint != NULL;
+
+    fwrite(&numBlocks, sizeof(numBlocks), 1, file);
+    for (auto it : JitBlocks9)
+    {
+        if (it.second->EntryPoint)
+            WriteCodeCacheBlock(file, it.second);
+    }
+    for (auto it : JitBlocks7)
+    {
+        if (it.second->EntryPoint)
+            WriteCodeCacheBlock(file, it.second);
+    }
+    for (auto it : RestoreCandidates)
+        WriteCodeCacheBlock(file, it.second);
+
+    Platform::Mutex_Unlock(CompilerLock);
+
+    fclose(file);
+    Log(LogLevel::Info, "JIT: saved %d blocks to the code cache\n", numBlocks);
+    return true;
+}
+
+bool LoadCodeCache(const std::string& path)
+{
+    if (!JITCompiler->CanSaveCode())
+        return false;
+
+    FILE* file = Platform::OpenFile(path, "rb", true);
+    if (!file)
+        return false;
+
+    if (!CheckCodeCacheHeader(file))
+    {
+        fclose(file);
+        return false;
+    }
+
+    JitEnableWrite();
+    ResetBlockCache();
+
+    bool success = JITCompiler->LoadCode(file);
+    u32 numBlocks = 0;
+    if (success && fread(&numBlocks, sizeof(numBlocks), 1, file) != 1)
+        success = false;
+    for (u32 i = 0; success && i < numBlocks; i++)
+    {
+        // they're checked against the memory contents like any other
+        // block whose code was invalidated before they're used
+        JitBlock* block = ReadCodeCacheBlock(file);
+        if (block)
+            RetireJitBlock(block);
+        else
+            success = false;
+    }
+
+    if (!success)
+    {
+        Log(LogLevel::Warn, "JIT: code cache %s is broken\n", path.c_str());
+        ResetBlockCache();
+    }
+    else
+    {
+        Log(LogLevel::Info, "JIT: loaded %d blocks from the code cache\n", numBlocks);
+    }
+
+    JitEnableExecute();
+    fclose(file);
+    return success;
+}
+
+u32 CreateCheckpoint()
+{
+    return ++CurrentCheckpoint;
+}
+
+void RestoreCheckpoint(u32 checkpoint)
+{
+    // the memory mappings might be different in the loaded state
+    // unmapping everything first also means no code protection has to be updated
+    ARMJIT_Memory::Reset();
+
+    for (int num = 0; num < 2; num++)
+    {
+        auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+        for (auto it = map.begin(); it != map.end();)
+        {
+            JitBlock* block = it->second;
+            if (block->Checkpoint < checkpoint)
+            {
+                it++;
+                continue;
+            }
+
+            RemoveFromCodeIndex(block);
+
+            FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2] = (u64)UINT32_MAX << 32;
+
+            // if the code is still the same after loading, it can be restored without recompiling
+            RetireJitBlock(block);
+            it = map.erase(it);
+        }
+    }
 }
 
 void JitEnableWrite()
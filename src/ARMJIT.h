@@ -19,10 +19,13 @@
 #ifndef ARMJIT_H
 #define ARMJIT_H
 
+#include <string>
+
 #include "types.h"
 
 #include "ARM.h"
 #include "ARM_InstrInfo.h"
+#include "ARMJIT_Memory.h"
 
 #if defined(__APPLE__) && defined(__aarch64__)
     #include <pthread.h>
@@ -37,6 +40,7 @@ extern int MaxBlockSize;
 extern bool LiteralOptimizations;
 extern bool BranchOptimizations;
 extern bool FastMemory;
+extern bool BackgroundCompilation;
 
 void Init();
 void DeInit();
@@ -55,6 +59,50 @@ void CompileBlock(ARM* cpu);
 
 void ResetBlockCache();
 
+// blocks are linked directly to the ones they statically branch to,
+// this has to be undone when the memory at an address might be a different one now
+void UnlinkAllBlocks();
+
+// the compiled code can be saved to a file and loaded in a later session
+// (with the same binary and JIT settings), where it's used instead of compiling
+// a block again as long as the code in memory is still the same
+bool SaveCodeCache(const std::string& path);
+bool LoadCodeCache(const std::string& path);
+
+// blocks compiled before a checkpoint still match the memory contents from back then,
+// otherwise they would have been invalidated. so loading an in-memory savestate taken
+// at a checkpoint only needs to retire the blocks compiled since.
+// with checkpoint 0 all blocks are retired, they're still reused if the loaded
+// code is the same as the one they were compiled from.
+u32 CreateCheckpoint();
+void RestoreCheckpoint(u32 checkpoint);
+
+// counters since the last ResetStats(), to see how often code is thrown away
+struct Stats
+{
+    u64 BlocksCompiled[2];
+    u64 BlocksRestored[2];  // previously invalidated blocks which were reused
+    u64 CompileTime;        // host nanoseconds, including the compilation thread
+    u64 CodeSize;           // bytes of code generated
+
+    // blocks invalidated by writes to their code, by memory region
+    u64 Invalidations[ARMJIT_Memory::memregions_Count];
+    // of those, the ones thrown away for good as one of their literals was written to
+    u64 LiteralInvalidations;
+    u64 CacheResets;
+    // code segments emptied as the code memory was full, and the blocks thrown away with them
+    u64 Evictions;
+    u64 EvictedBlocks;
+
+    // blocks entered from the dispatcher and directly through a linked exit
+    // (the latter is only counted in builds with PROFILING_ENABLED)
+    u64 Lookups[2];
+    u64 LinkedTransitions[2];
+};
+
+void GetStats(Stats* stats);
+void ResetStats();
+
 JitBlockEntry LookUpBlock(u32 num, u64* entries, u32 offset, u32 addr);
 bool SetupExecutableRegion(u32 num, u32 blockAddr, u64*& entry, u32& start, u32& size);
 
@@ -20,9 +20,6 @@
 
 using namespace Arm64Gen;
 
-// hack
-const int kCodeCacheTiming = 3;
-
 namespace ARMJIT
 {
 
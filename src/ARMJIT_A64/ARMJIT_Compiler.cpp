@@ -699,19 +699,19 @@ void Compiler::Comp_BranchSpecialBehaviour(bool taken)
     }
 }
 
-JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr)
+bool Compiler::IsFull()
 {
-    if (JitMemMainSize - GetCodeOffset() < 1024 * 16)
-    {
-        Log(LogLevel::Debug, "JIT near memory full, resetting...\n");
-        ResetBlockCache();
-    }
-    if ((JitMemMainSize +  JitMemSecondarySize) - OtherCodeRegion < 1024 * 8)
-    {
-        Log(LogLevel::Debug, "JIT far memory full, resetting...\n");
-        ResetBlockCache();
-    }
+    return JitMemMainSize - GetCodeOffset() < 1024 * 16
+        || (JitMemMainSize +  JitMemSecondarySize) - OtherCodeRegion < 1024 * 8;
+}
 
+u32 Compiler::UsedCodeMemory()
+{
+    return GetCodeOffset() + (OtherCodeRegion - JitMemMainSize);
+}
+
+JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr)
+{
     JitBlockEntry res = (JitBlockEntry)GetRXPtr();
 
     Thumb = thumb;
@@ -851,6 +851,11 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     FlushIcache();
 
+#ifdef JIT_PERF_ENABLED
+    ARMJIT_Perf::AddCode((void*)res, (u8*)GetRXPtr() - (u8*)res,
+        "JIT_ARM%d_%s_%08X", Num ? 7 : 9, Thumb ? "THUMB" : "ARM", instrs[0].Addr);
+#endif
+
     return res;
 }
 
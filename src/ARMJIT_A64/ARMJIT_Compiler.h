@@ -26,6 +26,9 @@
 
 #include "../ARMJIT_Internal.h"
 #include "../ARMJIT_RegisterCache.h"
+#ifdef JIT_PERF_ENABLED
+#include "../ARMJIT_Perf.h"
+#endif
 
 #include <unordered_map>
 
@@ -110,6 +113,18 @@ public:
     }
 
     JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr);
+    // static branches still use the CPU to determine their timing
+    bool CanCompileInBackground() { return false; }
+    // the block cache has to be reset before compiling more
+    bool IsFull();
+    u32 UsedCodeMemory();
+
+    // the code memory isn't split into segments which could be evicted
+    static const int NumCodeSegments = 1;
+    int GetCodeSegment(u32 offset) { return 0; }
+    int GetCurCodeSegment() { return 0; }
+    void ClearCodeSegment(int segment) {}
+    void SetCodeSegment(int segment) {}
 
     bool CanCompile(bool thumb, u16 kind);
 
@@ -233,6 +248,16 @@ public:
         return (u8*)entry - GetRXBase();
     }
 
+    // this backend doesn't emit linkable exits (yet), so there's never anything to patch
+    void LinkExit(u32 exit, JitBlockEntry entry) {}
+    void UnlinkExit(u32 exit) {}
+
+    // the code isn't relocatable
+    bool CanSaveCode() { return false; }
+    void SaveCode(FILE* file) {}
+    bool LoadCode(FILE* file) { return false; }
+    bool IsLoadedEntryOffset(u32 offset) { return false; }
+
     bool IsJITFault(u8* pc);
     u8* RewriteMemAccess(u8* pc);
 
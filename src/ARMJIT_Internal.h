@@ -26,6 +26,7 @@
 
 #include "ARMJIT.h"
 #include "ARMJIT_Memory.h"
+#include "Platform.h"
 
 // here lands everything which doesn't fit into ARMJIT.h
 // where it would be included by pretty much everything
@@ -66,6 +67,21 @@ struct FetchedInstr
     u16 CodeCycles;
     u32 DataRegion;
 
+    // the memory state the code generation depends on, taken on the
+    // emu thread when the block is made. The compiler might run on
+    // another thread where it mustn't look at the CPU or memory.
+    u8 DataMemRegion; // DataRegion classified with ClassifyAddress9/7
+    // ARM7 only, the timings of the region at CodeCycles
+    u8 CodeCyclesN, CodeCyclesS;
+    // for branches with an immediate target
+    u8 JumpRegionCodeCycles;
+    u8 JumpCycles;
+
+    // for literal loads, the value at the address when the block was made
+    bool HasLiteral;
+    u32 LiteralAddr;
+    u32 Literal;
+
     ARMInstrInfo::Info Info;
 };
 
@@ -185,12 +201,17 @@ public:
     u32 StartAddr;
     u32 StartAddrLocal;
     u32 InstrHash, LiteralHash;
+    u32 Checkpoint;
     u8 Num;
     u16 NumAddresses;
     u16 NumLiterals;
 
     JitBlockEntry EntryPoint;
 
+    // code offsets of the exits of other blocks which jump directly
+    // into this one, they're unlinked again when it's thrown away
+    TinyVector<u32> LinkedExits;
+
     u32* AddressRanges()
     { return &Data[0]; }
     u32* AddressMasks()
@@ -216,6 +237,11 @@ extern InterpreterFunc InterpretTHUMB[];
 
 extern TinyVector<u32> InvalidLiterals;
 
+// held while the compiler is used, it might be on the compilation thread
+extern Platform::Mutex* CompilerLock;
+
+extern Stats CurrentStats;
+
 extern AddressRange* const CodeMemRegions[ARMJIT_Memory::memregions_Count];
 
 inline bool PageContainsCode(AddressRange* range)
@@ -230,8 +256,28 @@ inline bool PageContainsCode(AddressRange* range)
 
 u32 LocaliseCodeAddress(u32 num, u32 addr);
 
-template <u32 Num>
-void LinkBlock(ARM* cpu, u32 codeOffset);
+// exits to a statically known address first return to the dispatcher,
+// leaving themselves here. the block they lead to is then linked to them
+// so the next time they jump into it directly
+struct PendingExit
+{
+    u32 Target; // address of the block, UINT32_MAX if there is none
+    u32 Exit;   // code offset of the exit
+};
+extern PendingExit PendingExits[2];
+
+// calls push where they return to, so the return can
+// go there directly if it really ends up at that address
+const u32 ReturnStackSize = 32;
+struct ReturnStack
+{
+    u32 Top;
+    u32 Keys[ReturnStackSize];  // R15 after returning, bit 0 set for THUMB. 0 if unused
+    u32 Exits[ReturnStackSize]; // code offset of a linkable exit to the block there
+};
+extern ReturnStack ReturnStacks[2];
+
+void LinkPendingExit(u32 num, u32 addr, JitBlockEntry entry);
 
 template <typename T, int ConsoleType> T SlowRead9(u32 addr, ARMv5* cpu);
 template <typename T, int ConsoleType> void SlowWrite9(u32 addr, ARMv5* cpu, u32 val);
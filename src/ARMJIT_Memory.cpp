@@ -262,7 +262,14 @@ const u32 MemBlockDTCMOffset = MemBlockARM7WRAMOffset + RoundUp(NDS::ARM7WRAMSiz
 const u32 MemBlockNWRAM_AOffset = MemBlockDTCMOffset + RoundUp(DTCMPhysicalSize);
 const u32 MemBlockNWRAM_BOffset = MemBlockNWRAM_AOffset + RoundUp(DSi::NWRAMSize);
 const u32 MemBlockNWRAM_COffset = MemBlockNWRAM_BOffset + RoundUp(DSi::NWRAMSize);
-const u32 MemoryTotalSize = MemBlockNWRAM_COffset + RoundUp(DSi::NWRAMSize);
+const u32 MemBlockVRAMOffset = MemBlockNWRAM_COffset + RoundUp(DSi::NWRAMSize);
+const u32 MemoryTotalSize = MemBlockVRAMOffset + RoundUp(656*1024);
+
+// all VRAM banks one after another, in the order of GPU::VRAM
+const u32 VRAMBankOffsets[9] =
+{
+    0x00000, 0x20000, 0x40000, 0x60000, 0x80000, 0x90000, 0x94000, 0x98000, 0xA0000
+};
 
 const u32 OffsetsPerRegion[memregions_Count] =
 {
@@ -273,12 +280,12 @@ const u32 OffsetsPerRegion[memregions_Count] =
     MemBlockMainRAMOffset,
     MemBlockSWRAMOffset,
     UINT32_MAX,
-    UINT32_MAX,
+    MemBlockVRAMOffset,
     UINT32_MAX,
     MemBlockARM7WRAMOffset,
     UINT32_MAX,
     UINT32_MAX,
-    UINT32_MAX,
+    MemBlockVRAMOffset,
     UINT32_MAX,
     UINT32_MAX,
     MemBlockNWRAM_AOffset,
@@ -291,7 +298,11 @@ enum
     memstate_Unmapped,
     memstate_MappedRW,
     // on Switch this is unmapped as well
+    // VRAM pages are always in this state, see GetVRAMMirrorLocation
     memstate_MappedProtected,
+    // read only until the first write, see SetWriteTracking
+    // never used on Switch
+    memstate_MappedTracked,
 };
 
 u8 MappingStatus9[1 << (32-12)];
@@ -441,8 +452,43 @@ struct Mapping
 };
 ARMJIT::TinyVector<Mapping> Mappings[memregions_Count];
 
+bool WriteTracking = false;
+
+u8* GetDirtyPageFlag(int region, u32 offset)
+{
+    switch (region)
+    {
+    case memregion_MainRAM:
+        return &NDS::DirtyPages[NDS::DirtyPages_MainRAM + (offset >> 12)];
+    case memregion_SharedWRAM:
+        return &NDS::DirtyPages[NDS::DirtyPages_SharedWRAM + (offset >> 12)];
+    case memregion_WRAM7:
+        return &NDS::DirtyPages[NDS::DirtyPages_ARM7WRAM + (offset >> 12)];
+    default:
+        return nullptr;
+    }
+}
+
+bool IsPageTracked(int region, u32 offset)
+{
+#ifdef __SWITCH__
+    return false;
+#else
+    if (!WriteTracking)
+        return false;
+
+    u8* dirty = GetDirtyPageFlag(region, offset);
+    return dirty && !*dirty;
+#endif
+}
+
 void SetCodeProtection(int region, u32 offset, bool protect)
 {
+    // VRAM is never mapped writeable anyway and offset isn't
+    // relative to the same thing as the mappings there
+    if (region == memregion_VRAM || region == memregion_VWRAM)
+        return;
+
     offset &= ~0xFFF;
     //printf("set code protection %d %x %d\n", region, offset, protect);
 
@@ -462,8 +508,13 @@ void SetCodeProtection(int region, u32 offset, bool protect)
         u8* states = (u8*)(mapping.Num == 0 ? MappingStatus9 : MappingStatus7);
 
         //printf("%x %d %x %x %x %d\n", effectiveAddr, mapping.Num, mapping.Addr, mapping.LocalOffset, mapping.Size, states[effectiveAddr >> 12]);
-        assert(states[effectiveAddr >> 12] == (protect ? memstate_MappedRW : memstate_MappedProtected));
-        states[effectiveAddr >> 12] = protect ? memstate_MappedProtected : memstate_MappedRW;
+        u8 oldState = states[effectiveAddr >> 12];
+        assert(protect
+            ? (oldState == memstate_MappedRW || oldState == memstate_MappedTracked)
+            : oldState == memstate_MappedProtected);
+        u8 newState = protect ? memstate_MappedProtected
+            : (IsPageTracked(region, offset) ? memstate_MappedTracked : memstate_MappedRW);
+        states[effectiveAddr >> 12] = newState;
 
 #if defined(__SWITCH__)
         bool success;
@@ -473,7 +524,9 @@ void SetCodeProtection(int region, u32 offset, bool protect)
             success = MapIntoRange(effectiveAddr, mapping.Num, OffsetsPerRegion[region] + offset, 0x1000);
         assert(success);
 #else
-        SetCodeProtectionRange(effectiveAddr, 0x1000, mapping.Num, protect ? 1 : 2);
+        // tracked pages are read only already
+        if (oldState != memstate_MappedTracked && newState != memstate_MappedTracked)
+            SetCodeProtectionRange(effectiveAddr, 0x1000, mapping.Num, protect ? 1 : 2);
 #endif
     }
 }
@@ -570,6 +623,101 @@ void RemapSWRAM()
     Mappings[memregion_SharedWRAM].Clear();
 }
 
+void RemapVRAM()
+{
+    for (int region : {memregion_VRAM, memregion_VWRAM})
+    {
+        for (int i = 0; i < Mappings[region].Length; i++)
+        {
+            Mappings[region][i].Unmap(region);
+        }
+        Mappings[region].Clear();
+    }
+}
+
+/*
+    Only pieces of VRAM where exactly one bank is mapped are put into fastmem,
+    otherwise reads would need to OR multiple banks together. They're always
+    mapped read only, so writes fault and end up in the slow path which takes
+    care of GPU::VRAMDirty, the ignored 8-bit writes from the ARM9 and invalidating
+    code. memoryOffset is relative to the start of the VRAM memory block.
+*/
+bool GetVRAMMirrorLocation(u32 num, u32 addr, u32& memoryOffset, u32& mirrorStart, u32& mirrorSize)
+{
+    u8* ptr = nullptr;
+    if (num == 0)
+    {
+        mirrorStart = addr & ~0x3FFF;
+        mirrorSize = 0x4000;
+
+        switch (addr & 0x00E00000)
+        {
+        case 0x00000000: ptr = GPU::VRAMPtr_ABG[(addr >> 14) & 0x1F]; break;
+        case 0x00200000: ptr = GPU::VRAMPtr_BBG[(addr >> 14) & 0x7]; break;
+        case 0x00400000: ptr = GPU::VRAMPtr_AOBJ[(addr >> 14) & 0xF]; break;
+        case 0x00600000: ptr = GPU::VRAMPtr_BOBJ[(addr >> 14) & 0x7]; break;
+        default:
+            {
+                // LCDC, banks A-D are 128KB, E is 64KB, F, G and I 16KB and H 32KB
+                u32 chunk = (addr >> 14) & 0x3F;
+                int bank;
+                u32 offset = 0;
+                if (chunk < 32)
+                {
+                    bank = chunk >> 3;
+                    offset = (chunk & 0x7) << 14;
+                }
+                else if (chunk < 36)
+                {
+                    bank = 4;
+                    offset = (chunk & 0x3) << 14;
+                }
+                else if (chunk < 41)
+                {
+                    const int banks[] = {5, 6, 7, 7, 8};
+                    bank = banks[chunk - 36];
+                    if (chunk == 39)
+                        offset = 0x4000;
+                }
+                else
+                    return false;
+
+                if (GPU::VRAMMap_LCDC & (1 << bank))
+                    ptr = &GPU::VRAM[bank][offset];
+            }
+            break;
+        }
+    }
+    else
+    {
+        mirrorStart = addr & ~0x1FFFF;
+        mirrorSize = 0x20000;
+
+        u32 mask = GPU::VRAMMap_ARM7[(addr >> 17) & 1];
+        if (mask == (1 << 2))
+            ptr = GPU::VRAM_C;
+        else if (mask == (1 << 3))
+            ptr = GPU::VRAM_D;
+    }
+
+    if (!ptr)
+        return false;
+
+    memoryOffset = ptr - GPU::VRAM_A;
+    return true;
+}
+
+u8 GetInitialPageState(int region, bool isExecutable, ARMJIT::AddressRange* range, u32 memoryOffset, u32 offset)
+{
+    if (region == memregion_VRAM || region == memregion_VWRAM)
+        return memstate_MappedProtected;
+    if (isExecutable && ARMJIT::PageContainsCode(&range[offset / 512]))
+        return memstate_MappedProtected;
+    if (IsPageTracked(region, memoryOffset + offset))
+        return memstate_MappedTracked;
+    return memstate_MappedRW;
+}
+
 bool MapAtAddress(u32 addr)
 {
     u32 num = NDS::CurCPU;
@@ -578,11 +726,13 @@ bool MapAtAddress(u32 addr)
         ? ClassifyAddress9(addr)
         : ClassifyAddress7(addr);
 
-    if (!IsFastmemCompatible(region))
+    if (!IsFastmemCompatible(region, false))
         return false;
 
     u32 mirrorStart, mirrorSize, memoryOffset;
-    bool isMapped = GetMirrorLocation(region, num, addr, memoryOffset, mirrorStart, mirrorSize);
+    bool isMapped = region == memregion_VRAM || region == memregion_VWRAM
+        ? GetVRAMMirrorLocation(num, addr, memoryOffset, mirrorStart, mirrorSize)
+        : GetMirrorLocation(region, num, addr, memoryOffset, mirrorStart, mirrorSize);
     if (!isMapped)
         return false;
 
@@ -638,27 +788,27 @@ bool MapAtAddress(u32 addr)
         else
         {
             u32 sectionOffset = offset;
-            bool hasCode = isExecutable && ARMJIT::PageContainsCode(&range[offset / 512]);
+            u8 status = GetInitialPageState(region, isExecutable, range, memoryOffset, offset);
             while (offset < mirrorSize
-                && (!isExecutable || ARMJIT::PageContainsCode(&range[offset / 512]) == hasCode)
+                && GetInitialPageState(region, isExecutable, range, memoryOffset, offset) == status
                 && (!skipDTCM || mirrorStart + offset != NDS::ARM9->DTCMBase))
             {
                 assert(states[(mirrorStart + offset) >> 12] == memstate_Unmapped);
-                states[(mirrorStart + offset) >> 12] = hasCode ? memstate_MappedProtected : memstate_MappedRW;
+                states[(mirrorStart + offset) >> 12] = status;
                 offset += 0x1000;
             }
 
             u32 sectionSize = offset - sectionOffset;
 
 #if defined(__SWITCH__)
-            if (!hasCode)
+            if (status == memstate_MappedRW)
             {
                 //printf("trying to map %x (size: %x) from %x\n", mirrorStart + sectionOffset, sectionSize, sectionOffset + memoryOffset + OffsetsPerRegion[region]);
                 bool succeded = MapIntoRange(mirrorStart + sectionOffset, num, sectionOffset + memoryOffset + OffsetsPerRegion[region], sectionSize);
                 assert(succeded);
             }
 #else
-            if (hasCode)
+            if (status != memstate_MappedRW)
             {
                 SetCodeProtectionRange(mirrorStart + sectionOffset, sectionSize, num, 1);
             }
@@ -675,6 +825,120 @@ bool MapAtAddress(u32 addr)
     return true;
 }
 
+// calls func(mapping, addr) for every mapped 4KB page of a region, except where DTCM is on top of it
+template <typename F>
+void ForEachMappedPage(int region, F func)
+{
+    for (int i = 0; i < Mappings[region].Length; i++)
+    {
+        Mapping& mapping = Mappings[region][i];
+        for (u32 offset = 0; offset < mapping.Size; offset += 0x1000)
+        {
+            u32 addr = mapping.Addr + offset;
+            if (mapping.Num == 0
+                && region != memregion_DTCM
+                && (addr & NDS::ARM9->DTCMMask) == NDS::ARM9->DTCMBase)
+                continue;
+
+            func(mapping, addr);
+        }
+    }
+}
+
+const int TrackedRegions[] = {memregion_MainRAM, memregion_SharedWRAM, memregion_WRAM7};
+
+void SetWriteTracking(bool enable)
+{
+    if (WriteTracking == enable)
+        return;
+
+    WriteTracking = enable;
+
+    if (enable)
+    {
+        RestartWriteTracking();
+        return;
+    }
+
+#ifndef __SWITCH__
+    for (int region : TrackedRegions)
+    {
+        ForEachMappedPage(region, [](Mapping& mapping, u32 addr)
+        {
+            u8* states = mapping.Num == 0 ? MappingStatus9 : MappingStatus7;
+            if (states[addr >> 12] == memstate_MappedTracked)
+            {
+                states[addr >> 12] = memstate_MappedRW;
+                SetCodeProtectionRange(addr, 0x1000, mapping.Num, 2);
+            }
+        });
+    }
+#endif
+}
+
+void RestartWriteTracking()
+{
+    if (!WriteTracking)
+        return;
+
+    for (int region : TrackedRegions)
+    {
+        ForEachMappedPage(region, [region](Mapping& mapping, u32 addr)
+        {
+            u8* states = mapping.Num == 0 ? MappingStatus9 : MappingStatus7;
+            if (states[addr >> 12] != memstate_MappedRW)
+                return;
+
+#ifdef __SWITCH__
+            // no way to catch writes, assume the worst
+            *GetDirtyPageFlag(region, mapping.LocalOffset + (addr - mapping.Addr)) = 1;
+#else
+            states[addr >> 12] = memstate_MappedTracked;
+            SetCodeProtectionRange(addr, 0x1000, mapping.Num, 1);
+#endif
+        });
+    }
+}
+
+// first write to a tracked page, mark it as dirty and make it writable in all mirrors
+bool UntrackPage(u32 addr)
+{
+    u32 num = NDS::CurCPU;
+    int region = num == 0
+        ? ClassifyAddress9(addr)
+        : ClassifyAddress7(addr);
+
+    u8* dirty = GetDirtyPageFlag(region, LocaliseAddress(region, num, addr) & 0x7FFFFFF);
+    if (!dirty)
+        return false;
+    *dirty = 1;
+
+    u32 offset = LocaliseAddress(region, num, addr) & 0x7FFF000;
+    for (int i = 0; i < Mappings[region].Length; i++)
+    {
+        Mapping& mapping = Mappings[region][i];
+        if (offset < mapping.LocalOffset || offset >= mapping.LocalOffset + mapping.Size)
+            continue;
+
+        u32 effectiveAddr = mapping.Addr + (offset - mapping.LocalOffset);
+        if (mapping.Num == 0
+            && region != memregion_DTCM
+            && (effectiveAddr & NDS::ARM9->DTCMMask) == NDS::ARM9->DTCMBase)
+            continue;
+
+        u8* states = mapping.Num == 0 ? MappingStatus9 : MappingStatus7;
+        if (states[effectiveAddr >> 12] == memstate_MappedTracked)
+        {
+            states[effectiveAddr >> 12] = memstate_MappedRW;
+#ifndef __SWITCH__
+            SetCodeProtectionRange(effectiveAddr, 0x1000, mapping.Num, 2);
+#endif
+        }
+    }
+
+    return true;
+}
+
 bool FaultHandler(FaultDescription& faultDesc)
 {
     if (ARMJIT::JITCompiler->IsJITFault(faultDesc.FaultPC))
@@ -683,11 +947,18 @@ bool FaultHandler(FaultDescription& faultDesc)
 
         u8* memStatus = NDS::CurCPU == 0 ? MappingStatus9 : MappingStatus7;
 
-        if (memStatus[faultDesc.EmulatedFaultAddr >> 12] == memstate_Unmapped)
+        u8 status = memStatus[faultDesc.EmulatedFaultAddr >> 12];
+        if (status == memstate_Unmapped)
             rewriteToSlowPath = !MapAtAddress(faultDesc.EmulatedFaultAddr);
+        else if (status == memstate_MappedTracked)
+            rewriteToSlowPath = !UntrackPage(faultDesc.EmulatedFaultAddr);
 
         if (rewriteToSlowPath)
+        {
+            Platform::Mutex_Lock(ARMJIT::CompilerLock);
             faultDesc.FaultPC = ARMJIT::JITCompiler->RewriteMemAccess(faultDesc.FaultPC);
+            Platform::Mutex_Unlock(ARMJIT::CompilerLock);
+        }
 
         return true;
     }
@@ -805,6 +1076,17 @@ void Init()
     DSi::NWRAM_A = basePtr + MemBlockNWRAM_AOffset;
     DSi::NWRAM_B = basePtr + MemBlockNWRAM_BOffset;
     DSi::NWRAM_C = basePtr + MemBlockNWRAM_COffset;
+
+    u8* vram = basePtr + MemBlockVRAMOffset;
+    GPU::VRAM_A = vram + VRAMBankOffsets[0];
+    GPU::VRAM_B = vram + VRAMBankOffsets[1];
+    GPU::VRAM_C = vram + VRAMBankOffsets[2];
+    GPU::VRAM_D = vram + VRAMBankOffsets[3];
+    GPU::VRAM_E = vram + VRAMBankOffsets[4];
+    GPU::VRAM_F = vram + VRAMBankOffsets[5];
+    GPU::VRAM_G = vram + VRAMBankOffsets[6];
+    GPU::VRAM_H = vram + VRAMBankOffsets[7];
+    GPU::VRAM_I = vram + VRAMBankOffsets[8];
 }
 
 void DeInit()
@@ -851,7 +1133,7 @@ void Reset()
     Log(LogLevel::Debug, "done resetting jit mem\n");
 }
 
-bool IsFastmemCompatible(int region)
+bool IsFastmemCompatible(int region, bool store)
 {
 #ifdef _WIN32
     /*
@@ -864,6 +1146,14 @@ bool IsFastmemCompatible(int region)
         || region == memregion_NewSharedWRAM_C)
         return false;
 #endif
+#if defined(_WIN32) || defined(__SWITCH__)
+    // VRAM is mapped in 16KB pieces and read only
+    if (region == memregion_VRAM || region == memregion_VWRAM)
+        return false;
+#endif
+    // stores to VRAM would always fault, the handlers from GetFuncForAddr are faster
+    if (store && (region == memregion_VRAM || region == memregion_VWRAM))
+        return false;
     return OffsetsPerRegion[region] != UINT32_MAX;
 }
 
@@ -1206,15 +1496,15 @@ T VRAMRead(u32 addr)
     }
 }
 
-void* GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size)
+void* GetFuncForAddr(u32 num, u32 addr, bool store, int size)
 {
-    if (cpu->Num == 0)
+    if (num == 0)
     {
         switch (addr & 0xFF000000)
         {
         case 0x04000000:
-            if (!store && size == 32 && addr == 0x04100010 && NDS::ExMemCnt[0] & (1<<11))
-                return (void*)NDSCart::ReadROMData;
+            if (!store && size == 32 && addr == 0x04100010)
+                return (void*)NDS::ARM9ROMDataRead;
 
             /*
                 unfortunately we can't map GPU2D this way
@@ -1222,6 +1512,19 @@ void* GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size)
 
                 though GPU3D registers are accessed much more intensive
             */
+            if (store && size == 32)
+            {
+                // skip the IO write switch for the registers which are hammered the most
+                if (addr >= 0x04000400 && addr < 0x04000440)
+                    return (void*)GPU3D::WriteGXFIFO32;
+                if (addr >= 0x04000440 && addr < 0x040005CC)
+                    return (void*)GPU3D::WriteCmdPort32;
+                if (addr == 0x04000188)
+                    return (void*)NDS::ARM9IPCFIFOWrite;
+                if (addr >= 0x040000E0 && addr < 0x040000F0)
+                    return (void*)NDS::DMA9FillWrite;
+            }
+
             if (addr >= 0x04000320 && addr < 0x040006A4)
             {
                 switch (size | store)
@@ -1278,6 +1581,9 @@ void* GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size)
         switch (addr & 0xFF800000)
         {
         case 0x04000000:
+            if (store && size == 32 && addr == 0x04000188)
+                return (void*)NDS::ARM7IPCFIFOWrite;
+
             if (addr >= 0x04000400 && addr < 0x04000520)
             {
                 switch (size | store)
@@ -66,15 +66,25 @@ int ClassifyAddress7(u32 addr);
 bool GetMirrorLocation(int region, u32 num, u32 addr, u32& memoryOffset, u32& mirrorStart, u32& mirrorSize);
 u32 LocaliseAddress(int region, u32 num, u32 addr);
 
-bool IsFastmemCompatible(int region);
+bool IsFastmemCompatible(int region, bool store);
 
 void RemapDTCM(u32 newBase, u32 newSize);
 void RemapSWRAM();
 void RemapNWRAM(int num);
+// needs to be called whenever the VRAM bank mapping changes
+void RemapVRAM();
 
 void SetCodeProtection(int region, u32 offset, bool protect);
 
-void* GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size);
+// fastmem writes don't go through the memory handlers, so for incremental savestates
+// pages of main RAM and WRAM which aren't dirty yet (NDS::DirtyPages) are write protected
+// and marked dirty on the first write. not supported on Switch, every page mapped
+// there is considered dirty
+void SetWriteTracking(bool enable);
+// protects the pages again, after NDS::DirtyPages was cleared
+void RestartWriteTracking();
+
+void* GetFuncForAddr(u32 num, u32 addr, bool store, int size);
 
 }
 
@@ -0,0 +1,194 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "ARMJIT_Perf.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "Platform.h"
+
+using Platform::Log;
+using Platform::LogLevel;
+
+namespace ARMJIT_Perf
+{
+
+// see tools/perf/Documentation/jitdump-specification.txt in the Linux sources
+const u32 DumpMagic = 0x4A695444; // JiTD
+const u32 DumpVersion = 1;
+
+enum
+{
+    record_CodeLoad = 0,
+    record_CodeClose = 3,
+};
+
+struct DumpHeader
+{
+    u32 Magic;
+    u32 Version;
+    u32 TotalSize;
+    u32 ElfMach;
+    u32 Pad1;
+    u32 Pid;
+    u64 Timestamp;
+    u64 Flags;
+};
+
+struct DumpRecordHeader
+{
+    u32 ID;
+    u32 TotalSize;
+    u64 Timestamp;
+};
+
+struct DumpCodeLoad
+{
+    DumpRecordHeader Header;
+    u32 Pid;
+    u32 Tid;
+    u64 VMA;
+    u64 CodeAddr;
+    u64 CodeSize;
+    u64 CodeIndex;
+    // followed by the name and the code
+};
+
+FILE* MapFile;
+FILE* DumpFile;
+void* DumpMarker;
+long DumpMarkerSize;
+u64 CodeIndex;
+
+u64 GetTimestamp()
+{
+    // the clock perf record -k 1 uses
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void Init()
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+    MapFile = fopen(path, "w");
+    if (!MapFile)
+        Log(LogLevel::Warn, "JIT: couldn't open %s\n", path);
+
+    snprintf(path, sizeof(path), "/tmp/jit-%d.dump", getpid());
+    DumpFile = fopen(path, "w+");
+    DumpMarker = MAP_FAILED;
+    if (DumpFile)
+    {
+        DumpHeader header = {};
+        header.Magic = DumpMagic;
+        header.Version = DumpVersion;
+        header.TotalSize = sizeof(header);
+#if defined(__x86_64__)
+        header.ElfMach = 62; // EM_X86_64
+#elif defined(__aarch64__)
+        header.ElfMach = 183; // EM_AARCH64
+#endif
+        header.Pid = getpid();
+        header.Timestamp = GetTimestamp();
+        fwrite(&header, sizeof(header), 1, DumpFile);
+        fflush(DumpFile);
+
+        // perf record only learns about the file through it being mapped
+        DumpMarkerSize = sysconf(_SC_PAGESIZE);
+        DumpMarker = mmap(NULL, DumpMarkerSize, PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(DumpFile), 0);
+        if (DumpMarker == MAP_FAILED)
+            Log(LogLevel::Warn, "JIT: couldn't map %s\n", path);
+    }
+    else
+    {
+        Log(LogLevel::Warn, "JIT: couldn't open %s\n", path);
+    }
+
+    CodeIndex = 0;
+}
+
+void DeInit()
+{
+    if (MapFile)
+    {
+        fclose(MapFile);
+        MapFile = nullptr;
+    }
+
+    if (DumpFile)
+    {
+        DumpRecordHeader close = {record_CodeClose, sizeof(close), GetTimestamp()};
+        fwrite(&close, sizeof(close), 1, DumpFile);
+
+        if (DumpMarker != MAP_FAILED)
+            munmap(DumpMarker, DumpMarkerSize);
+        fclose(DumpFile);
+        DumpFile = nullptr;
+    }
+}
+
+void AddCode(const void* code, u32 size, const char* namefmt, ...)
+{
+    if (size == 0)
+        return;
+
+    char name[64];
+    va_list args;
+    va_start(args, namefmt);
+    int nameLen = vsnprintf(name, sizeof(name), namefmt, args);
+    va_end(args);
+    if (nameLen < 0)
+        return;
+    if (nameLen >= (int)sizeof(name))
+        nameLen = sizeof(name) - 1;
+
+    if (MapFile)
+    {
+        fprintf(MapFile, "%llx %x %s\n", (unsigned long long)code, size, name);
+        fflush(MapFile);
+    }
+
+    if (DumpFile)
+    {
+        DumpCodeLoad record;
+        record.Header.ID = record_CodeLoad;
+        record.Header.TotalSize = sizeof(record) + nameLen + 1 + size;
+        record.Header.Timestamp = GetTimestamp();
+        record.Pid = getpid();
+        record.Tid = syscall(SYS_gettid);
+        record.VMA = (u64)code;
+        record.CodeAddr = (u64)code;
+        record.CodeSize = size;
+        record.CodeIndex = CodeIndex++;
+
+        fwrite(&record, sizeof(record), 1, DumpFile);
+        fwrite(name, nameLen + 1, 1, DumpFile);
+        fwrite(code, size, 1, DumpFile);
+        fflush(DumpFile);
+    }
+}
+
+}
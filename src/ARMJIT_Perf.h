@@ -0,0 +1,45 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ARMJIT_PERF_H
+#define ARMJIT_PERF_H
+
+#include "types.h"
+
+// makes the generated code visible to Linux perf, so the time spent in it
+// is attributed to the guest code it was compiled from.
+//
+// only compiled in when JIT_PERF_ENABLED is defined (ENABLE_JIT_PERF in CMake).
+//
+// every piece of code is written to /tmp/perf-<pid>.map, which perf report picks up
+// by itself. It can't tell apart different code at the same place though, which
+// happens once the code memory is reused. For that the code is also written to
+// /tmp/jit-<pid>.dump in the jitdump format. Record with "perf record -k 1"
+// and run "perf inject --jit" on the result to use it.
+
+namespace ARMJIT_Perf
+{
+
+void Init();
+void DeInit();
+
+void AddCode(const void* code, u32 size, const char* namefmt, ...);
+
+}
+
+#endif
@@ -37,7 +37,6 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
     IrregularCycles = true;
 
     u32 newPC;
-    u32 cycles = 0;
 
     if (addr & 0x1 && !Thumb)
     {
@@ -50,98 +49,42 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
         AND(32, R(RCPSR), Imm32(~0x20));
     }
 
+    // the timings were taken when the block was made, the compiler
+    // might run on another thread
+    u32 cycles = CurInstr.JumpCycles;
     if (Num == 0)
     {
-        ARMv5* cpu9 = (ARMv5*)CurCPU;
-
-        u32 regionCodeCycles = cpu9->MemTimings[addr >> 12][0];
-        u32 compileTimeCodeCycles = cpu9->RegionCodeCycles;
-        cpu9->RegionCodeCycles = regionCodeCycles;
-
         if (Exit)
-            MOV(32, MDisp(RCPU, offsetof(ARMv5, RegionCodeCycles)), Imm32(regionCodeCycles));
-
-        if (addr & 0x1)
-        {
-            addr &= ~0x1;
-            newPC = addr+2;
-
-            // two-opcodes-at-once fetch
-            // doesn't matter if we put garbage in the MSbs there
-            if (addr & 0x2)
-            {
-                cpu9->CodeRead32(addr-2, true);
-                cycles += cpu9->CodeCycles;
-                cpu9->CodeRead32(addr+2, false);
-                cycles += CurCPU->CodeCycles;
-            }
-            else
-            {
-                cpu9->CodeRead32(addr, true);
-                cycles += cpu9->CodeCycles;
-            }
-        }
-        else
-        {
-            addr &= ~0x3;
-            newPC = addr+4;
-
-            cpu9->CodeRead32(addr, true);
-            cycles += cpu9->CodeCycles;
-            cpu9->CodeRead32(addr+4, false);
-            cycles += cpu9->CodeCycles;
-        }
-
-        cpu9->RegionCodeCycles = compileTimeCodeCycles;
+            MOV(32, MDisp(RCPU, offsetof(ARMv5, RegionCodeCycles)), Imm32(CurInstr.JumpRegionCodeCycles));
     }
     else
     {
-        ARMv4* cpu7 = (ARMv4*)CurCPU;
-
         u32 codeRegion = addr >> 24;
         u32 codeCycles = addr >> 15; // cheato
 
-        cpu7->CodeRegion = codeRegion;
-        cpu7->CodeCycles = codeCycles;
-
         if (Exit)
         {
             MOV(32, MDisp(RCPU, offsetof(ARM, CodeRegion)), Imm32(codeRegion));
             MOV(32, MDisp(RCPU, offsetof(ARM, CodeCycles)), Imm32(codeCycles));
         }
+    }
 
-        if (addr & 0x1)
-        {
-            addr &= ~0x1;
-            newPC = addr+2;
-
-            // this is necessary because ARM7 bios protection
-            u32 compileTimePC = CurCPU->R[15];
-            CurCPU->R[15] = newPC;
-
-            cycles += NDS::ARM7MemTimings[codeCycles][0] + NDS::ARM7MemTimings[codeCycles][1];
-
-            CurCPU->R[15] = compileTimePC;
-        }
-        else
-        {
-            addr &= ~0x3;
-            newPC = addr+4;
-
-            u32 compileTimePC = CurCPU->R[15];
-            CurCPU->R[15] = newPC;
-
-            cycles += NDS::ARM7MemTimings[codeCycles][2] + NDS::ARM7MemTimings[codeCycles][3];
-
-            CurCPU->R[15] = compileTimePC;
-        }
-
-        cpu7->CodeRegion = R15 >> 24;
-        cpu7->CodeCycles = addr >> 15;
+    if (addr & 0x1)
+    {
+        addr &= ~0x1;
+        newPC = addr+2;
+    }
+    else
+    {
+        addr &= ~0x3;
+        newPC = addr+4;
     }
 
     if (Exit)
+    {
         MOV(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(newPC));
+        ExitTarget = addr;
+    }
     if ((Thumb || CurInstr.Cond() >= 0xE) && !forceNonConstantCycles)
         ConstantCycles += cycles;
     else
@@ -200,16 +143,23 @@ void Compiler::A_Comp_BranchImm()
     }
 
     if (link)
+    {
+        Comp_PushReturnAddress(R15 - 4);
         MOV(32, MapReg(14), Imm32(R15 - 4));
+    }
 
     Comp_JumpTo(target);
 }
 
 void Compiler::A_Comp_BranchXchangeReg()
 {
+    bool link = (CurInstr.Instr & 0xF0) == 0x30; // BLX_reg
+    if (link)
+        Comp_PushReturnAddress(R15 - 4);
+
     OpArg rn = MapReg(CurInstr.A_Reg(0));
     MOV(32, R(RSCRATCH), rn);
-    if ((CurInstr.Instr & 0xF0) == 0x30) // BLX_reg
+    if (link)
         MOV(32, MapReg(14), Imm32(R15 - 4));
     Comp_JumpTo(RSCRATCH);
 }
@@ -224,7 +174,7 @@ void Compiler::T_Comp_BCOND()
 
     Comp_SpecialBranchBehaviour(true);
 
-    FixupBranch skipFailed = J();
+    FixupBranch skipFailed = J(true);
     SetJumpTarget(skipExecute);
 
     Comp_SpecialBranchBehaviour(false);
@@ -250,6 +200,7 @@ void Compiler::T_Comp_BranchXchangeReg()
             Log(LogLevel::Warn, "BLX unsupported on ARM7!!!\n");
             return;
         }
+        Comp_PushReturnAddress((R15 - 2) | 1);
         MOV(32, R(RSCRATCH), MapReg(CurInstr.A_Reg(3)));
         MOV(32, MapReg(14), Imm32(R15 - 1));
         Comp_JumpTo(RSCRATCH);
@@ -270,6 +221,8 @@ void Compiler::T_Comp_BL_LONG_1()
 
 void Compiler::T_Comp_BL_LONG_2()
 {
+    Comp_PushReturnAddress((R15 - 2) | 1);
+
     OpArg lr = MapReg(14);
     s32 offset = (CurInstr.Instr & 0x7FF) << 1;
     LEA(32, RSCRATCH, MDisp(lr.GetSimpleReg(), offset));
@@ -292,6 +245,7 @@ void Compiler::T_Comp_BL_Merged()
     if (Num == 1 || upperPart & (1 << 12))
         target |= 1;
 
+    Comp_PushReturnAddress((R15 - 2) | 1);
     MOV(32, MapReg(14), Imm32((R15 - 2) | 1));
 
     Comp_JumpTo(target);
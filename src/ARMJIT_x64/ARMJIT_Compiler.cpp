@@ -22,9 +22,13 @@
 
 #include <assert.h>
 #include <stdarg.h>
+#include <algorithm>
 
 #include "../dolphin/CommonFuncs.h"
 
+#define XXH_STATIC_LINKING_ONLY
+#include "../xxhash/xxhash.h"
+
 #ifdef _WIN32
 #include <windows.h>
 #else
@@ -256,6 +260,7 @@ Compiler::Compiler()
         mprotect(pageAligned, alignedSize, PROT_EXEC | PROT_READ | PROT_WRITE);
     #endif
 
+        CodeStart = pageAligned;
         ResetStart = pageAligned;
         CodeMemSize = alignedSize;
     }
@@ -461,15 +466,22 @@ Compiler::Compiler()
         }
     }
 
+#ifdef JIT_PERF_ENABLED
+    ARMJIT_Perf::AddCode(CodeStart, GetWritableCodePtr() - CodeStart, "JIT_Helpers");
+#endif
+
     // move the region forward to prevent overwriting the generated functions
     CodeMemSize -= GetWritableCodePtr() - ResetStart;
     ResetStart = GetWritableCodePtr();
 
     NearStart = ResetStart;
-    FarStart = ResetStart + 1024*1024*24;
+    FarStart = ResetStart + (NumCodeSegments << NearSegmentShift);
 
     NearSize = FarStart - ResetStart;
     FarSize = (ResetStart + CodeMemSize) - FarStart;
+    FarSegmentSize = FarSize / NumCodeSegments;
+
+    ResetCodeSegments();
 }
 
 void Compiler::LoadCPSR()
@@ -508,6 +520,8 @@ Gen::FixupBranch Compiler::CheckCondition(u32 cond)
     // hack, ldm/stm can get really big TODO: make this better
     bool ldmStm = !Thumb &&
         (CurInstr.Info.Kind == ARMInstrInfo::ak_LDM || CurInstr.Info.Kind == ARMInstrInfo::ak_STM);
+    // so can a followed branch, it contains a whole block exit
+    bool farJump = ldmStm || (CurInstr.BranchFlags & (branch_FollowCondTaken | branch_FollowCondNotTaken));
     if (cond >= 0x8)
     {
         static_assert(RSCRATCH3 == ECX, "RSCRATCH has to be equal to ECX!");
@@ -517,14 +531,14 @@ Gen::FixupBranch Compiler::CheckCondition(u32 cond)
         SHL(32, R(RSCRATCH), R(RSCRATCH3));
         TEST(32, R(RSCRATCH), Imm32(ARM::ConditionTable[cond]));
 
-        return J_CC(CC_Z, ldmStm);
+        return J_CC(CC_Z, farJump);
     }
     else
     {
         // could have used a LUT, but then where would be the fun?
         TEST(32, R(RCPSR), Imm32(1 << (28 + ((~(cond >> 1) & 1) << 1 | (cond >> 2 & 1) ^ (cond >> 1 & 1)))));
 
-        return J_CC(cond & 1 ? CC_NZ : CC_Z, ldmStm);
+        return J_CC(cond & 1 ? CC_NZ : CC_Z, farJump);
     }
 }
 
@@ -661,7 +675,248 @@ void Compiler::Reset()
     NearCode = NearStart;
     FarCode = FarStart;
 
+    ResetCodeSegments();
+
     LoadStorePatches.clear();
+    Relocations.clear();
+}
+
+void Compiler::ResetCodeSegments()
+{
+    for (int i = 0; i < NumCodeSegments; i++)
+    {
+        SegmentNearCode[i] = NearStart + (i << NearSegmentShift);
+        SegmentFarCode[i] = FarStart + i * FarSegmentSize;
+    }
+    CurCodeSegment = 0;
+}
+
+void Compiler::ClearCodeSegment(int segment)
+{
+    u8* nearStart = NearStart + (segment << NearSegmentShift);
+    u8* farStart = FarStart + segment * FarSegmentSize;
+    u32 nearSize = 1 << NearSegmentShift;
+
+    memset(nearStart, 0xcc, nearSize);
+    memset(farStart, 0xcc, FarSegmentSize);
+    SegmentNearCode[segment] = nearStart;
+    SegmentFarCode[segment] = farStart;
+
+    auto inSegment = [&](u8* addr)
+    {
+        return (addr >= nearStart && addr < nearStart + nearSize)
+            || (addr >= farStart && addr < farStart + FarSegmentSize);
+    };
+    for (auto it = LoadStorePatches.begin(); it != LoadStorePatches.end();)
+    {
+        if (inSegment(it->first))
+            it = LoadStorePatches.erase(it);
+        else
+            it++;
+    }
+    Relocations.erase(std::remove_if(Relocations.begin(), Relocations.end(),
+        [&](const Relocation& reloc) { return inSegment(ResetStart + reloc.Offset); }),
+        Relocations.end());
+}
+
+void Compiler::StoreCodeSegment()
+{
+    SegmentNearCode[CurCodeSegment] = GetWritableCodePtr();
+    SegmentFarCode[CurCodeSegment] = FarCode;
+}
+
+void Compiler::SetCodeSegment(int segment)
+{
+    StoreCodeSegment();
+
+    CurCodeSegment = segment;
+    SetCodePtr(SegmentNearCode[segment]);
+    NearCode = SegmentNearCode[segment];
+    FarCode = SegmentFarCode[segment];
+}
+
+void Compiler::MOVPtr(X64Reg reg, const void* ptr, u32 kind)
+{
+    // always the long form, it might not fit into 32 bit after relocation
+    Write8(0x48 | (reg >> 3));
+    Write8(0xB8 + (reg & 7));
+    Write64((u64)ptr);
+
+    Relocations.push_back({(u32)(GetWritableCodePtr() - 8 - ResetStart), kind});
+}
+
+bool Compiler::CanSaveCode()
+{
+    // otherwise the code would have far calls into the binary
+    return CodeStart >= CodeMemory && CodeStart < CodeMemory + sizeof(CodeMemory);
+}
+
+u64 RelocationBase(u32 kind)
+{
+    switch (kind)
+    {
+    case Compiler::reloc_FastMem9: return (u64)ARMJIT_Memory::FastMem9Start;
+    case Compiler::reloc_FastMem7: return (u64)ARMJIT_Memory::FastMem7Start;
+    default: return (u64)CodeMemory;
+    }
+}
+
+void Compiler::SaveCode(FILE* file)
+{
+    // the code generated on startup has to be the same as well,
+    // everything else calls into it or the binary relative to it
+    u64 helperHash = XXH3_64bits(CodeStart, ResetStart - CodeStart);
+    u64 helperOffset = CodeStart - CodeMemory;
+    fwrite(&helperHash, sizeof(helperHash), 1, file);
+    fwrite(&helperOffset, sizeof(helperOffset), 1, file);
+
+    std::vector<u8> code(ResetStart, ResetStart + CodeMemSize);
+    for (const Relocation& reloc : Relocations)
+        *(u64*)&code[reloc.Offset] -= RelocationBase(reloc.Kind);
+
+    StoreCodeSegment();
+    fwrite(&CurCodeSegment, sizeof(CurCodeSegment), 1, file);
+    for (int i = 0; i < NumCodeSegments; i++)
+    {
+        u32 nearOffset = i << NearSegmentShift;
+        u32 farOffset = NearSize + i * FarSegmentSize;
+        u32 nearSize = SegmentNearCode[i] - (ResetStart + nearOffset);
+        u32 farSize = SegmentFarCode[i] - (ResetStart + farOffset);
+
+        fwrite(&nearSize, sizeof(nearSize), 1, file);
+        fwrite(&farSize, sizeof(farSize), 1, file);
+        fwrite(&code[nearOffset], nearSize, 1, file);
+        fwrite(&code[farOffset], farSize, 1, file);
+    }
+
+    u32 numRelocations = Relocations.size();
+    fwrite(&numRelocations, sizeof(numRelocations), 1, file);
+    fwrite(Relocations.data(), sizeof(Relocation), numRelocations, file);
+
+    u32 numPatches = LoadStorePatches.size();
+    fwrite(&numPatches, sizeof(numPatches), 1, file);
+    for (auto& it : LoadStorePatches)
+    {
+        s64 offset = it.first - ResetStart;
+        s64 funcOffset = (u8*)it.second.PatchFunc - ResetStart;
+        fwrite(&offset, sizeof(offset), 1, file);
+        fwrite(&funcOffset, sizeof(funcOffset), 1, file);
+        fwrite(&it.second.Offset, sizeof(it.second.Offset), 1, file);
+        fwrite(&it.second.Size, sizeof(it.second.Size), 1, file);
+    }
+}
+
+bool Compiler::LoadCode(FILE* file)
+{
+    u64 helperHash, helperOffset;
+    if (fread(&helperHash, sizeof(helperHash), 1, file) != 1
+        || fread(&helperOffset, sizeof(helperOffset), 1, file) != 1
+        || helperHash != XXH3_64bits(CodeStart, ResetStart - CodeStart)
+        || helperOffset != (u64)(CodeStart - CodeMemory))
+        return false;
+
+    int curSegment;
+    if (fread(&curSegment, sizeof(curSegment), 1, file) != 1
+        || curSegment < 0 || curSegment >= NumCodeSegments)
+        return false;
+    for (int i = 0; i < NumCodeSegments; i++)
+    {
+        u8* nearStart = NearStart + (i << NearSegmentShift);
+        u8* farStart = FarStart + i * FarSegmentSize;
+        u32 nearSize, farSize;
+        if (fread(&nearSize, sizeof(nearSize), 1, file) != 1
+            || fread(&farSize, sizeof(farSize), 1, file) != 1
+            || nearSize > (1 << NearSegmentShift) || farSize > FarSegmentSize
+            || fread(nearStart, 1, nearSize, file) != nearSize
+            || fread(farStart, 1, farSize, file) != farSize)
+            return false;
+
+        SegmentNearCode[i] = nearStart + nearSize;
+        SegmentFarCode[i] = farStart + farSize;
+    }
+
+    u32 numRelocations;
+    if (fread(&numRelocations, sizeof(numRelocations), 1, file) != 1)
+        return false;
+    Relocations.resize(numRelocations);
+    if (fread(Relocations.data(), sizeof(Relocation), numRelocations, file) != numRelocations)
+        return false;
+    for (const Relocation& reloc : Relocations)
+    {
+        if (reloc.Offset + 8 > CodeMemSize)
+            return false;
+        *(u64*)(ResetStart + reloc.Offset) += RelocationBase(reloc.Kind);
+    }
+
+    u32 numPatches;
+    if (fread(&numPatches, sizeof(numPatches), 1, file) != 1)
+        return false;
+    for (u32 i = 0; i < numPatches; i++)
+    {
+        s64 offset, funcOffset;
+        LoadStorePatch patch;
+        if (fread(&offset, sizeof(offset), 1, file) != 1
+            || fread(&funcOffset, sizeof(funcOffset), 1, file) != 1
+            || fread(&patch.Offset, sizeof(patch.Offset), 1, file) != 1
+            || fread(&patch.Size, sizeof(patch.Size), 1, file) != 1)
+            return false;
+
+        // RewriteMemAccess() overwrites these bytes with a call to PatchFunc,
+        // which is either one of the helpers generated on startup or in the far code
+        if (patch.Size < 5 || !IsLoadedCode(offset + patch.Offset, patch.Size)
+            || (!(funcOffset >= CodeStart - ResetStart && funcOffset < 0) && !IsLoadedCode(funcOffset, 1)))
+            return false;
+
+        patch.PatchFunc = ResetStart + funcOffset;
+        LoadStorePatches[ResetStart + offset] = patch;
+    }
+
+    CurCodeSegment = curSegment;
+    SetCodePtr(SegmentNearCode[curSegment]);
+    NearCode = SegmentNearCode[curSegment];
+    FarCode = SegmentFarCode[curSegment];
+    return true;
+}
+
+bool Compiler::IsLoadedCode(s64 offset, u32 size)
+{
+    for (int i = 0; i < NumCodeSegments; i++)
+    {
+        s64 nearStart = (s64)i << NearSegmentShift;
+        s64 farStart = NearSize + (s64)i * FarSegmentSize;
+        if ((offset >= nearStart && offset + size <= SegmentNearCode[i] - ResetStart)
+            || (offset >= farStart && offset + size <= SegmentFarCode[i] - ResetStart))
+            return true;
+    }
+    return false;
+}
+
+bool Compiler::IsLoadedEntryOffset(u32 offset)
+{
+    // blocks always start in the near code
+    u32 segment = offset >> NearSegmentShift;
+    return segment < NumCodeSegments && ResetStart + offset < SegmentNearCode[segment];
+}
+
+bool Compiler::IsFull()
+{
+    u8* nearEnd = NearStart + ((CurCodeSegment + 1) << NearSegmentShift);
+    u8* farEnd = FarStart + (CurCodeSegment + 1) * FarSegmentSize;
+    return nearEnd - GetCodePtr() < 1024 * 32 // guess...
+        || farEnd - FarCode < 1024 * 32;
+}
+
+u32 Compiler::UsedCodeMemory()
+{
+    StoreCodeSegment();
+
+    u32 size = 0;
+    for (int i = 0; i < NumCodeSegments; i++)
+    {
+        size += SegmentNearCode[i] - (NearStart + (i << NearSegmentShift));
+        size += SegmentFarCode[i] - (FarStart + i * FarSegmentSize);
+    }
+    return size;
 }
 
 bool Compiler::IsJITFault(u8* addr)
@@ -681,10 +936,104 @@ void Compiler::Comp_SpecialBranchBehaviour(bool taken)
 
         if (ConstantCycles)
             ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
-        JMP((u8*)&ARM_Ret, true);
+
+        if (!taken)
+            Comp_LinkableExit(CurInstr.Addr + (Thumb ? 2 : 4));
+        else if (ExitTarget != UINT32_MAX)
+            Comp_LinkableExit(ExitTarget);
+        else
+            Comp_PredictedReturn();
     }
 }
 
+void Compiler::Comp_LinkableExit(u32 target)
+{
+    // the same checks the dispatcher would do before running the next block
+    CMP(32, MDisp(RCPU, offsetof(ARM, StopExecution)), Imm8(0));
+    J_CC(CC_NZ, (u8*)&ARM_Ret);
+
+    MOVSX(64, 32, RSCRATCH, MDisp(RCPU, offsetof(ARM, Cycles)));
+    MOV(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(0));
+    MOVPtr(RSCRATCH2, Num == 0 ? &NDS::ARM9Timestamp : &NDS::ARM7Timestamp);
+    ADD(64, R(RSCRATCH), MatR(RSCRATCH2));
+    MOV(64, MatR(RSCRATCH2), R(RSCRATCH));
+    MOVPtr(RSCRATCH2, Num == 0 ? &NDS::ARM9Target : &NDS::ARM7Target);
+    CMP(64, R(RSCRATCH), MatR(RSCRATCH2));
+    J_CC(CC_AE, (u8*)&ARM_Ret);
+
+#ifdef PROFILING_ENABLED
+    MOVPtr(RSCRATCH2, &CurrentStats.LinkedTransitions[Num]);
+    ADD(64, MatR(RSCRATCH2), Imm8(1));
+#endif
+
+    // while it's not linked this jumps right behind itself
+    u8* exit = GetWritableCodePtr();
+    JMP(exit + 5, true);
+
+#ifdef PROFILING_ENABLED
+    SUB(64, MatR(RSCRATCH2), Imm8(1));
+#endif
+
+    MOVPtr(RSCRATCH, &PendingExits[Num]);
+    MOV(32, MDisp(RSCRATCH, offsetof(PendingExit, Target)), Imm32(target));
+    MOV(32, MDisp(RSCRATCH, offsetof(PendingExit, Exit)), Imm32(exit - ResetStart));
+    JMP((u8*)&ARM_Ret, true);
+}
+
+void Compiler::Comp_PushReturnAddress(u32 lr)
+{
+    // the exit to where the call returns to is put into the far code
+    u32 returnAddr = lr & ~1;
+    SwitchToFarCode();
+    u8* exit = GetWritableCodePtr();
+    Comp_LinkableExit(returnAddr);
+    SwitchToNearCode();
+
+    u32 key = lr & 1 ? (returnAddr + 2) | 1 : returnAddr + 4;
+
+    MOVPtr(RSCRATCH2, &ReturnStacks[Num]);
+    MOV(32, R(RSCRATCH), MDisp(RSCRATCH2, offsetof(ReturnStack, Top)));
+    ADD(32, R(RSCRATCH), Imm8(1));
+    AND(32, R(RSCRATCH), Imm8(ReturnStackSize - 1));
+    MOV(32, MDisp(RSCRATCH2, offsetof(ReturnStack, Top)), R(RSCRATCH));
+    MOV(32, MComplex(RSCRATCH2, RSCRATCH, SCALE_4, offsetof(ReturnStack, Keys)), Imm32(key));
+    MOV(32, MComplex(RSCRATCH2, RSCRATCH, SCALE_4, offsetof(ReturnStack, Exits)), Imm32(exit - ResetStart));
+}
+
+void Compiler::Comp_PredictedReturn()
+{
+    // R15 and the CPSR are already where the branch went
+    MOVPtr(RSCRATCH2, &ReturnStacks[Num]);
+    MOV(32, R(RSCRATCH3), MDisp(RSCRATCH2, offsetof(ReturnStack, Top)));
+    MOV(32, R(RSCRATCH), R(RCPSR));
+    SHR(32, R(RSCRATCH), Imm8(5));
+    AND(32, R(RSCRATCH), Imm8(1));
+    OR(32, R(RSCRATCH), MDisp(RCPU, offsetof(ARM, R[15])));
+    CMP(32, R(RSCRATCH), MComplex(RSCRATCH2, RSCRATCH3, SCALE_4, offsetof(ReturnStack, Keys)));
+    J_CC(CC_NE, (u8*)&ARM_Ret);
+
+    MOV(32, MComplex(RSCRATCH2, RSCRATCH3, SCALE_4, offsetof(ReturnStack, Keys)), Imm32(0));
+    MOV(32, R(RSCRATCH), MComplex(RSCRATCH2, RSCRATCH3, SCALE_4, offsetof(ReturnStack, Exits)));
+    SUB(32, R(RSCRATCH3), Imm8(1));
+    AND(32, R(RSCRATCH3), Imm8(ReturnStackSize - 1));
+    MOV(32, MDisp(RSCRATCH2, offsetof(ReturnStack, Top)), R(RSCRATCH3));
+
+    MOVPtr(RSCRATCH2, ResetStart);
+    ADD(64, R(RSCRATCH), R(RSCRATCH2));
+    JMPptr(R(RSCRATCH));
+}
+
+void Compiler::LinkExit(u32 exit, JitBlockEntry entry)
+{
+    u8* jump = ResetStart + exit;
+    *(s32*)(jump + 1) = (u8*)entry - (jump + 5);
+}
+
+void Compiler::UnlinkExit(u32 exit)
+{
+    *(s32*)(ResetStart + exit + 1) = 0;
+}
+
 #ifdef JIT_PROFILING_ENABLED
 void Compiler::CreateMethod(const char* namefmt, void* start, ...)
 {
@@ -709,26 +1058,17 @@ void Compiler::CreateMethod(const char* namefmt, void* start, ...)
 
 JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr)
 {
-    if (NearSize - (GetCodePtr() - NearStart) < 1024 * 32) // guess...
-    {
-        Log(LogLevel::Debug, "near reset\n");
-        ResetBlockCache();
-    }
-    if (FarSize - (FarCode - FarStart) < 1024 * 32) // guess...
-    {
-        Log(LogLevel::Debug, "far reset\n");
-        ResetBlockCache();
-    }
-
     ConstantCycles = 0;
     Thumb = thumb;
     Num = cpu->Num;
     CodeRegion = instrs[0].Addr >> 24;
-    CurCPU = cpu;
     // CPSR might have been modified in a previous block
     CPSRDirty = false;
 
     JitBlockEntry res = (JitBlockEntry)GetWritableCodePtr();
+#ifdef JIT_PERF_ENABLED
+    u8* farStart = FarCode;
+#endif
 
     RegCache = RegisterCache<Compiler, X64Reg>(this, instrs, instrsCount);
 
@@ -739,6 +1079,7 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
         CodeRegion = R15 >> 24;
 
         Exit = i == instrsCount - 1 || (CurInstr.BranchFlags & branch_FollowCondNotTaken);
+        ExitTarget = UINT32_MAX;
 
         CompileFunc comp = Thumb
             ? T_Comp[CurInstr.Info.Kind]
@@ -817,7 +1158,7 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
                 {
                     if (IrregularCycles || (CurInstr.BranchFlags & branch_FollowCondTaken))
                     {
-                        FixupBranch skipFailed = J();
+                        FixupBranch skipFailed = J(true);
                         SetJumpTarget(skipExecute);
 
                         Comp_AddCycles_C(true);
@@ -843,11 +1184,45 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     if (ConstantCycles)
         ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
-    JMP((u8*)ARM_Ret, true);
+
+    // if where the block continues is known it can be linked to the next one
+    bool isConditional = Thumb ? CurInstr.Info.Kind == ARMInstrInfo::tk_BCOND : CurInstr.Cond() < 0xE;
+    bool wasCompiled = (Thumb ? T_Comp[CurInstr.Info.Kind] : A_Comp[CurInstr.Info.Kind]) != NULL;
+    if (wasCompiled && !CurInstr.Info.Branches())
+    {
+        Comp_LinkableExit(CurInstr.Addr + (Thumb ? 2 : 4));
+    }
+    else if (ExitTarget != UINT32_MAX && !isConditional)
+    {
+        Comp_LinkableExit(ExitTarget);
+    }
+    else if (ExitTarget != UINT32_MAX)
+    {
+        u32 target = ExitTarget;
+        CMP(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(R15));
+        FixupBranch taken = J_CC(CC_NE, true);
+        Comp_LinkableExit(CurInstr.Addr + (Thumb ? 2 : 4));
+        SetJumpTarget(taken);
+        Comp_LinkableExit(target);
+    }
+    else if (CurInstr.Info.Branches())
+    {
+        Comp_PredictedReturn();
+    }
+    else
+    {
+        JMP((u8*)ARM_Ret, true);
+    }
 
 #ifdef JIT_PROFILING_ENABLED
     CreateMethod("JIT_Block_%d_%d_%08X", (void*)res, Num, Thumb, instrs[0].Addr);
 #endif
+#ifdef JIT_PERF_ENABLED
+    ARMJIT_Perf::AddCode((void*)res, GetWritableCodePtr() - (u8*)res,
+        "JIT_ARM%d_%s_%08X", Num ? 7 : 9, Thumb ? "THUMB" : "ARM", instrs[0].Addr);
+    ARMJIT_Perf::AddCode(farStart, FarCode - farStart,
+        "JIT_ARM%d_%s_%08X_far", Num ? 7 : 9, Thumb ? "THUMB" : "ARM", instrs[0].Addr);
+#endif
 
     /*FILE* codeout = fopen("codeout", "a");
     fprintf(codeout, "beginning block argargarg__ %x!!!", instrs[0].Addr);
@@ -861,7 +1236,7 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 void Compiler::Comp_AddCycles_C(bool forceNonConstant)
 {
     s32 cycles = Num ?
-        NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 1 : 3]
+        CurInstr.CodeCyclesS
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles);
 
     if ((!Thumb && CurInstr.Cond() < 0xE) || forceNonConstant)
@@ -873,7 +1248,7 @@ void Compiler::Comp_AddCycles_C(bool forceNonConstant)
 void Compiler::Comp_AddCycles_CI(u32 i)
 {
     s32 cycles = (Num ?
-        NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2]
+        CurInstr.CodeCyclesN
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles)) + i;
 
     if (!Thumb && CurInstr.Cond() < 0xE)
@@ -885,7 +1260,7 @@ void Compiler::Comp_AddCycles_CI(u32 i)
 void Compiler::Comp_AddCycles_CI(Gen::X64Reg i, int add)
 {
     s32 cycles = Num ?
-        NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2]
+        CurInstr.CodeCyclesN
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles);
 
     if (!Thumb && CurInstr.Cond() < 0xE)
@@ -910,7 +1285,7 @@ void Compiler::Comp_AddCycles_CDI()
 
         s32 cycles;
 
-        s32 numC = NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2];
+        s32 numC = CurInstr.CodeCyclesN;
         s32 numD = CurInstr.DataCycles;
 
         if ((CurInstr.DataRegion >> 24) == 0x02) // mainRAM
@@ -955,7 +1330,7 @@ void Compiler::Comp_AddCycles_CD()
     }
     else
     {
-        s32 numC = NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2];
+        s32 numC = CurInstr.CodeCyclesN;
         s32 numD = CurInstr.DataCycles;
 
         if ((CurInstr.DataRegion >> 4) == 0x02)
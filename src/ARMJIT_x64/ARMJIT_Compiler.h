@@ -28,8 +28,13 @@
 #ifdef JIT_PROFILING_ENABLED
 #include <jitprofiling.h>
 #endif
+#ifdef JIT_PERF_ENABLED
+#include "../ARMJIT_Perf.h"
+#endif
 
 #include <unordered_map>
+#include <vector>
+#include <stdio.h>
 
 namespace ARMJIT
 {
@@ -83,7 +88,28 @@ public:
 
     void Reset();
 
+    // doesn't modify the CPU, so it can run on the background compilation thread
     JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr);
+    bool CanCompileInBackground() { return true; }
+    // the current code segment is full
+    bool IsFull();
+    u32 UsedCodeMemory();
+
+    // the code memory is split into segments which are filled one after another.
+    // once all of them are full the least recently used one is emptied and
+    // filled again, instead of throwing away everything (see ARMJIT::EvictCodeSegment)
+    static const int NumCodeSegments = 12;
+    static const int NearSegmentShift = 21;
+
+    int GetCodeSegment(u32 offset)
+    {
+        return offset < NearSize
+            ? offset >> NearSegmentShift
+            : (offset - NearSize) / FarSegmentSize;
+    }
+    int GetCurCodeSegment() { return CurCodeSegment; }
+    void ClearCodeSegment(int segment);
+    void SetCodeSegment(int segment);
 
     void LoadReg(int reg, Gen::X64Reg nativeReg);
     void SaveReg(int reg, Gen::X64Reg nativeReg);
@@ -181,6 +207,9 @@ public:
     void Comp_RetriveFlags(bool sign, bool retriveCV, bool carryUsed);
 
     void Comp_SpecialBranchBehaviour(bool taken);
+    void Comp_LinkableExit(u32 target);
+    void Comp_PushReturnAddress(u32 lr);
+    void Comp_PredictedReturn();
 
 
     Gen::OpArg Comp_RegShiftImm(int op, int amount, Gen::OpArg rm, bool S, bool& carryUsed);
@@ -230,6 +259,33 @@ public:
         SetCodePtr(FarCode);
     }
 
+    void LinkExit(u32 exit, JitBlockEntry entry);
+    void UnlinkExit(u32 exit);
+
+    // the generated code is only position dependent through the pointers
+    // loaded with MOVPtr, so it can be saved and loaded in another session
+    // as long as it's the same binary (see ARMJIT::SaveCodeCache)
+    enum
+    {
+        reloc_Binary, // pointer into the emulator's binary
+        reloc_FastMem9,
+        reloc_FastMem7,
+    };
+    struct Relocation
+    {
+        u32 Offset;
+        u32 Kind;
+    };
+
+    void MOVPtr(Gen::X64Reg reg, const void* ptr, u32 kind = reloc_Binary);
+
+    bool CanSaveCode();
+    void SaveCode(FILE* file);
+    bool LoadCode(FILE* file);
+    bool IsLoadedEntryOffset(u32 offset);
+    // whether the range is within the code loaded into a segment
+    bool IsLoadedCode(s64 offset, u32 size);
+
     bool IsJITFault(u8* addr);
 
     u8* RewriteMemAccess(u8* pc);
@@ -246,16 +302,30 @@ public:
     u8* NearStart;
     u8* FarStart;
 
+    void ResetCodeSegments();
+    // stores how far the current segment is filled
+    void StoreCodeSegment();
+
+    // how far each segment is filled
+    u8* SegmentNearCode[NumCodeSegments];
+    u8* SegmentFarCode[NumCodeSegments];
+    u32 FarSegmentSize;
+    int CurCodeSegment;
+
     void* PatchedStoreFuncs[2][2][3][16];
     void* PatchedLoadFuncs[2][2][3][2][16];
 
     std::unordered_map<u8*, LoadStorePatch> LoadStorePatches;
+    std::vector<Relocation> Relocations;
 
+    u8* CodeStart;
     u8* ResetStart;
     u32 CodeMemSize;
 
     bool Exit;
     bool IrregularCycles;
+    // where a static branch exiting the block goes, UINT32_MAX otherwise
+    u32 ExitTarget;
 
     void* ReadBanked;
     void* WriteBanked;
@@ -272,8 +342,6 @@ public:
     u32 CodeRegion;
 
     u32 ConstantCycles;
-
-    ARM* CurCPU;
 };
 
 }
@@ -18,6 +18,8 @@
 
 #include "ARMJIT_Compiler.h"
 
+#include <algorithm>
+
 using namespace Gen;
 
 namespace ARMJIT
@@ -48,6 +50,12 @@ u8* Compiler::RewriteMemAccess(u8* pc)
         if (remainingSize > 0)
             emitter.NOP(remainingSize);
 
+        // the fastmem base pointer which was loaded here is gone
+        u32 start = pc + (ptrdiff_t)patch.Offset - ResetStart;
+        Relocations.erase(std::remove_if(Relocations.begin(), Relocations.end(),
+            [=](const Relocation& reloc) { return reloc.Offset >= start && reloc.Offset < start + patch.Size; }),
+            Relocations.end());
+
         return pc + (ptrdiff_t)patch.Offset;
     }
 
@@ -67,38 +75,30 @@ u8* Compiler::RewriteMemAccess(u8* pc)
 
 bool Compiler::Comp_MemLoadLiteral(int size, bool signExtend, int rd, u32 addr)
 {
-    u32 localAddr = LocaliseCodeAddress(Num, addr);
-
-    int invalidLiteralIdx = InvalidLiterals.Find(localAddr);
-    if (invalidLiteralIdx != -1)
-    {
+    // the value was read when the block was made, it isn't
+    // read again here as the compiler might run on another thread
+    if (!CurInstr.HasLiteral || CurInstr.LiteralAddr != addr)
         return false;
-    }
 
     Comp_AddCycles_CDI();
 
-    u32 val;
-    // make sure arm7 bios is accessible
-    u32 tmpR15 = CurCPU->R[15];
-    CurCPU->R[15] = R15;
+    u32 val = CurInstr.Literal;
     if (size == 32)
     {
-        CurCPU->DataRead32(addr & ~0x3, &val);
         val = ::ROR(val, (addr & 0x3) << 3);
     }
     else if (size == 16)
     {
-        CurCPU->DataRead16(addr & ~0x1, &val);
+        val = (val >> ((addr & 0x2) << 3)) & 0xFFFF;
         if (signExtend)
             val = ((s32)val << 16) >> 16;
     }
     else
     {
-        CurCPU->DataRead8(addr, &val);
+        val = (val >> ((addr & 0x3) << 3)) & 0xFF;
         if (signExtend)
             val = ((s32)val << 24) >> 24;
     }
-    CurCPU->R[15] = tmpR15;
 
     MOV(32, MapReg(rd), Imm32(val));
 
@@ -194,11 +194,9 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
     if ((flags & memop_Writeback) && !(flags & memop_Post))
         MOV(32, rnMapped, R(finalAddr));
 
-    u32 expectedTarget = Num == 0
-        ? ARMJIT_Memory::ClassifyAddress9(CurInstr.DataRegion)
-        : ARMJIT_Memory::ClassifyAddress7(CurInstr.DataRegion);
+    u32 expectedTarget = CurInstr.DataMemRegion;
 
-    if (ARMJIT::FastMemory && ((!Thumb && CurInstr.Cond() != 0xE) || ARMJIT_Memory::IsFastmemCompatible(expectedTarget)))
+    if (ARMJIT::FastMemory && ((!Thumb && CurInstr.Cond() != 0xE) || ARMJIT_Memory::IsFastmemCompatible(expectedTarget, flags & memop_Store)))
     {
         if (rdMapped.IsImm())
         {
@@ -216,7 +214,10 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
 
         assert(patch.PatchFunc != NULL);
 
-        MOV(64, R(RSCRATCH), ImmPtr(Num == 0 ? ARMJIT_Memory::FastMem9Start : ARMJIT_Memory::FastMem7Start));
+        if (Num == 0)
+            MOVPtr(RSCRATCH, ARMJIT_Memory::FastMem9Start, reloc_FastMem9);
+        else
+            MOVPtr(RSCRATCH, ARMJIT_Memory::FastMem7Start, reloc_FastMem7);
 
         X64Reg maskedAddr = RSCRATCH3;
         if (size > 8)
@@ -267,7 +268,7 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
 
         void* func = NULL;
         if (addrIsStatic)
-            func = ARMJIT_Memory::GetFuncForAddr(CurCPU, staticAddress, flags & memop_Store, size);
+            func = ARMJIT_Memory::GetFuncForAddr(Num, staticAddress, flags & memop_Store, size);
 
         if (func)
         {
@@ -420,9 +421,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
 
     s32 offset = (regsCount * 4) * (decrement ? -1 : 1);
 
-    int expectedTarget = Num == 0
-        ? ARMJIT_Memory::ClassifyAddress9(CurInstr.DataRegion)
-        : ARMJIT_Memory::ClassifyAddress7(CurInstr.DataRegion);
+    int expectedTarget = CurInstr.DataMemRegion;
 
     if (!store)
         Comp_AddCycles_CDI();
@@ -430,7 +429,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
         Comp_AddCycles_CD();
 
     bool compileFastPath = FastMemory
-        && !usermode && (CurInstr.Cond() < 0xE || ARMJIT_Memory::IsFastmemCompatible(expectedTarget));
+        && !usermode && (CurInstr.Cond() < 0xE || ARMJIT_Memory::IsFastmemCompatible(expectedTarget, store));
 
     // we need to make sure that the stack stays aligned to 16 bytes
 #ifdef _WIN32
@@ -453,7 +452,10 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
         u8* fastPathStart = GetWritableCodePtr();
         u8* loadStoreAddr[16];
 
-        MOV(64, R(RSCRATCH2), ImmPtr(Num == 0 ? ARMJIT_Memory::FastMem9Start : ARMJIT_Memory::FastMem7Start));
+        if (Num == 0)
+            MOVPtr(RSCRATCH2, ARMJIT_Memory::FastMem9Start, reloc_FastMem9);
+        else
+            MOVPtr(RSCRATCH2, ARMJIT_Memory::FastMem7Start, reloc_FastMem7);
         ADD(64, R(RSCRATCH2), R(RSCRATCH4));
 
         u32 offset = 0;
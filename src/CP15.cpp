@@ -18,9 +18,11 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include "NDS.h"
 #include "DSi.h"
 #include "ARM.h"
+#include "ARMDecodeCache.h"
 #include "Platform.h"
 
 #ifdef JIT_ENABLED
@@ -36,8 +38,8 @@ using Platform::LogLevel;
 // this was measured to be close to hardware average
 // a value of 1 would represent a perfect cache, but that causes
 // games to run too fast, causing a number of issues
+// (kCodeCacheTiming lives in ARM.h)
 const int kDataCacheTiming = 3;//2;
-const int kCodeCacheTiming = 3;//5;
 
 
 void ARMv5::CP15Reset()
@@ -77,6 +79,11 @@ void ARMv5::CP15DoSavestate(Savestate* file)
 {
     file->Section("CP15");
 
+    // the PU maps only need to be rebuilt if the settings they're derived from changed
+    // (loading back a state that was just saved happens every frame with run-ahead)
+    u32 oldsettings[6+8] = {CP15Control, PU_CodeCacheable, PU_DataCacheable, PU_DataCacheWrite, PU_CodeRW, PU_DataRW};
+    memcpy(&oldsettings[6], PU_Region, 8*sizeof(u32));
+
     file->Var32(&CP15Control);
 
     file->Var32(&DTCMSetting);
@@ -85,6 +92,12 @@ void ARMv5::CP15DoSavestate(Savestate* file)
     file->VarArray(ITCM, ITCMPhysicalSize);
     file->VarArray(DTCM, DTCMPhysicalSize);
 
+    if (!file->Saving)
+    {
+        for (u32 i = 0; i < ITCMPhysicalSize; i += 0x1000)
+            NDS::InvalidateITCMCode(i);
+    }
+
     file->Var32(&PU_CodeCacheable);
     file->Var32(&PU_DataCacheable);
     file->Var32(&PU_DataCacheWrite);
@@ -98,7 +111,11 @@ void ARMv5::CP15DoSavestate(Savestate* file)
     {
         UpdateDTCMSetting();
         UpdateITCMSetting();
-        UpdatePURegions(true);
+
+        u32 newsettings[6+8] = {CP15Control, PU_CodeCacheable, PU_DataCacheable, PU_DataCacheWrite, PU_CodeRW, PU_DataRW};
+        memcpy(&newsettings[6], PU_Region, 8*sizeof(u32));
+        if (memcmp(oldsettings, newsettings, sizeof(newsettings)))
+            UpdatePURegions(true);
     }
 }
 
@@ -146,158 +163,210 @@ void ARMv5::UpdateITCMSetting()
     {
         ITCMSize = 0;
     }
+
+    // decoded code might not be in ITCM anymore, or be hidden by it
+    ARMDecodeCache::Generation++;
+#ifdef JIT_ENABLED
+    ARMJIT::UnlinkAllBlocks();
+#endif
 }
 
 
-// covers updates to a specific PU region's cache/etc settings
-// (not to the region range/enabled status)
-void ARMv5::UpdatePURegion(u32 n)
+// pages covered by a PU region, end is exclusive
+void GetPURegionPages(u32 rgn, u32* start, u32* end)
 {
-    if (!(CP15Control & (1<<0)))
-        return;
-
-    u32 coderw = (PU_CodeRW >> (4*n)) & 0xF;
-    u32 datarw = (PU_DataRW >> (4*n)) & 0xF;
+    u32 sz = 2 << ((rgn >> 1) & 0x1F);
+    *start = rgn >> 12;
+    *end = std::min(*start + (sz >> 12), (u32)0x100000);
+    // TODO: check alignment of start
+}
 
-    u32 codecache, datacache, datawrite;
+// works out the permissions and cache settings of a PU region, or of
+// the pages outside of any region (n=PU_NoRegion)
+// returns whether the cache settings changed, which affect timings
+bool ARMv5::UpdatePURegionMasks(u32 n)
+{
+    u8 usermask = 0;
+    u8 privmask = 0;
 
-    // datacache/datawrite
-    // 0/0: goes to memory
-    // 0/1: goes to memory
-    // 1/0: goes to memory and cache
-    // 1/1: goes to cache
+    if (!(CP15Control & (1<<0)))
+    {
+        // PU disabled
 
-    if (CP15Control & (1<<12))
-        codecache = (PU_CodeCacheable >> n) & 0x1;
-    else
-        codecache = 0;
+        privmask = 0x07;
+        if (CP15Control & (1<<2))  privmask |= 0x30;
+        if (CP15Control & (1<<12)) privmask |= 0x40;
 
-    if (CP15Control & (1<<2))
-    {
-        datacache = (PU_DataCacheable >> n) & 0x1;
-        datawrite = (PU_DataCacheWrite >> n) & 0x1;
+        usermask = privmask;
     }
-    else
+    else if (n != PU_NoRegion)
     {
-        datacache = 0;
-        datawrite = 0;
-    }
+        u32 coderw = (PU_CodeRW >> (4*n)) & 0xF;
+        u32 datarw = (PU_DataRW >> (4*n)) & 0xF;
 
-    u32 rgn = PU_Region[n];
-    if (!(rgn & (1<<0)))
-    {
-        return;
-    }
+        u32 codecache, datacache, datawrite;
 
-    u32 start = rgn >> 12;
-    u32 sz = 2 << ((rgn >> 1) & 0x1F);
-    u32 end = start + (sz >> 12);
-    // TODO: check alignment of start
+        // datacache/datawrite
+        // 0/0: goes to memory
+        // 0/1: goes to memory
+        // 1/0: goes to memory and cache
+        // 1/1: goes to cache
 
-    u8 usermask = 0;
-    u8 privmask = 0;
+        if (CP15Control & (1<<12))
+            codecache = (PU_CodeCacheable >> n) & 0x1;
+        else
+            codecache = 0;
 
-    switch (datarw)
-    {
-    case 0: break;
-    case 1: privmask |= 0x03; break;
-    case 2: privmask |= 0x03; usermask |= 0x01; break;
-    case 3: privmask |= 0x03; usermask |= 0x03; break;
-    case 5: privmask |= 0x01; break;
-    case 6: privmask |= 0x01; usermask |= 0x01; break;
-    default: Log(LogLevel::Warn, "!! BAD DATARW VALUE %d\n", datarw&0xF);
-    }
+        if (CP15Control & (1<<2))
+        {
+            datacache = (PU_DataCacheable >> n) & 0x1;
+            datawrite = (PU_DataCacheWrite >> n) & 0x1;
+        }
+        else
+        {
+            datacache = 0;
+            datawrite = 0;
+        }
 
-    switch (coderw)
-    {
-    case 0: break;
-    case 1: privmask |= 0x04; break;
-    case 2: privmask |= 0x04; usermask |= 0x04; break;
-    case 3: privmask |= 0x04; usermask |= 0x04; break;
-    case 5: privmask |= 0x04; break;
-    case 6: privmask |= 0x04; usermask |= 0x04; break;
-    default: Log(LogLevel::Warn, "!! BAD CODERW VALUE %d\n", datarw&0xF);
-    }
+        switch (datarw)
+        {
+        case 0: break;
+        case 1: privmask |= 0x03; break;
+        case 2: privmask |= 0x03; usermask |= 0x01; break;
+        case 3: privmask |= 0x03; usermask |= 0x03; break;
+        case 5: privmask |= 0x01; break;
+        case 6: privmask |= 0x01; usermask |= 0x01; break;
+        default: Log(LogLevel::Warn, "!! BAD DATARW VALUE %d\n", datarw&0xF);
+        }
 
-    if (datacache & 0x1)
-    {
-        privmask |= 0x10;
-        usermask |= 0x10;
+        switch (coderw)
+        {
+        case 0: break;
+        case 1: privmask |= 0x04; break;
+        case 2: privmask |= 0x04; usermask |= 0x04; break;
+        case 3: privmask |= 0x04; usermask |= 0x04; break;
+        case 5: privmask |= 0x04; break;
+        case 6: privmask |= 0x04; usermask |= 0x04; break;
+        default: Log(LogLevel::Warn, "!! BAD CODERW VALUE %d\n", datarw&0xF);
+        }
 
-        if (datawrite & 0x1)
+        if (datacache & 0x1)
         {
-            privmask |= 0x20;
-            usermask |= 0x20;
+            privmask |= 0x10;
+            usermask |= 0x10;
+
+            if (datawrite & 0x1)
+            {
+                privmask |= 0x20;
+                usermask |= 0x20;
+            }
         }
-    }
 
-    if (codecache & 0x1)
-    {
-        privmask |= 0x40;
-        usermask |= 0x40;
+        if (codecache & 0x1)
+        {
+            privmask |= 0x40;
+            usermask |= 0x40;
+        }
+
+        Log(
+            LogLevel::Debug,
+            "PU region %d: %08X, user=%02X priv=%02X, %08X/%08X\n",
+            n,
+            PU_Region[n],
+            usermask,
+            privmask,
+            PU_DataRW,
+            PU_CodeRW
+        );
     }
 
-    Log(
-        LogLevel::Debug,
-        "PU region %d: %08X-%08X, user=%02X priv=%02X, %08X/%08X\n",
-        n,
-        start << 12,
-        end << 12,
-        usermask,
-        privmask,
-        PU_DataRW,
-        PU_CodeRW
-    );
-
-    for (u32 i = start; i < end; i++)
+    bool cachechanged = (PU_PrivMap[n] ^ privmask) & 0x50;
+
+    PU_UserMap[n] = usermask;
+    PU_PrivMap[n] = privmask;
+
+    return cachechanged;
+}
+
+// finds which region each page in the given range belongs to
+// the region with the highest number wins where they overlap
+void ARMv5::UpdatePUPages(u32 start, u32 end)
+{
+    memset(&PU_PageRegion[start], PU_NoRegion, end - start);
+
+    for (u32 n = 0; n < 8; n++)
     {
-        PU_UserMap[i] = usermask;
-        PU_PrivMap[i] = privmask;
+        u32 rgn = PU_Region[n];
+        if (!(rgn & (1<<0)))
+            continue;
+
+        u32 rgnstart, rgnend;
+        GetPURegionPages(rgn, &rgnstart, &rgnend);
+
+        rgnstart = std::max(rgnstart, start);
+        rgnend = std::min(rgnend, end);
+        if (rgnstart < rgnend)
+            memset(&PU_PageRegion[rgnstart], n, rgnend - rgnstart);
     }
 
     UpdateRegionTimings(start, end);
 }
 
-void ARMv5::UpdatePURegions(bool update_all)
+// covers updates to a specific PU region's cache/etc settings
+// (not to the region range/enabled status)
+void ARMv5::UpdatePURegion(u32 n)
 {
     if (!(CP15Control & (1<<0)))
-    {
-        // PU disabled
-
-        u8 mask = 0x07;
-        if (CP15Control & (1<<2))  mask |= 0x30;
-        if (CP15Control & (1<<12)) mask |= 0x40;
+        return;
 
-        memset(PU_UserMap, mask, 0x100000);
-        memset(PU_PrivMap, mask, 0x100000);
+    if (UpdatePURegionMasks(n) && (PU_Region[n] & (1<<0)))
+    {
+        u32 start, end;
+        GetPURegionPages(PU_Region[n], &start, &end);
+        UpdateRegionTimings(start, end);
+    }
+}
 
-        UpdateRegionTimings(0x00000, 0x100000);
+// covers updates to a PU region's range/enabled status, only the
+// pages it covered before or covers now have to be looked at again
+void ARMv5::UpdatePURegionRange(u32 n, u32 oldrgn)
+{
+    u32 rgn = PU_Region[n];
+    if (rgn == oldrgn)
         return;
-    }
 
-    if (update_all)
+    if (oldrgn & (1<<0))
     {
-        memset(PU_UserMap, 0, 0x100000);
-        memset(PU_PrivMap, 0, 0x100000);
+        u32 start, end;
+        GetPURegionPages(oldrgn, &start, &end);
+        UpdatePUPages(start, end);
     }
-
-    for (int n = 0; n < 8; n++)
+    if (rgn & (1<<0))
     {
-        UpdatePURegion(n);
+        u32 start, end;
+        GetPURegionPages(rgn, &start, &end);
+        UpdatePUPages(start, end);
     }
 
-    // TODO: this is way unoptimized
-    // should be okay unless the game keeps changing shit, tho
-    if (update_all) UpdateRegionTimings(0x00000, 0x100000);
-
     // TODO: throw exception if the region we're running in has become non-executable, I guess
 }
 
+void ARMv5::UpdatePURegions(bool update_all)
+{
+    for (u32 n = 0; n < 9; n++)
+        UpdatePURegionMasks(n);
+
+    if (update_all)
+        UpdatePUPages(0x00000, 0x100000);
+    else
+        UpdateRegionTimings(0x00000, 0x100000);
+}
+
 void ARMv5::UpdateRegionTimings(u32 addrstart, u32 addrend)
 {
     for (u32 i = addrstart; i < addrend; i++)
     {
-        u8 pu = PU_Map[i];
+        u8 pu = PU_PrivMap[PU_PageRegion[i]];
         u8* bustimings = NDS::ARM9MemTimings[i >> 2];
 
         if (pu & 0x40)
@@ -454,7 +523,7 @@ void ARMv5::CP15Write(u32 id, u32 val)
             UpdateITCMSetting();
             if ((old & 0x1005) != (val & 0x1005))
             {
-                UpdatePURegions((old & 0x1) != (val & 0x1));
+                UpdatePURegions(false);
             }
             if (val & (1<<7)) Log(LogLevel::Warn, "!!!! ARM9 BIG ENDIAN MODE. VERY BAD. SHIT GONNA ASPLODE NOW\n");
             if (val & (1<<13)) ExceptionBase = 0xFFFF0000;
@@ -577,23 +646,26 @@ void ARMv5::CP15Write(u32 id, u32 val)
     case 0x661:
     case 0x670:
     case 0x671:
-        char log_output[1024];
-        PU_Region[(id >> 4) & 0xF] = val;
-
-        std::snprintf(log_output,
-                 sizeof(log_output),
-                 "PU: region %d = %08X : %s, %08X-%08X\n",
-                 (id >> 4) & 0xF,
-                 val,
-                 val & 1 ? "enabled" : "disabled",
-                 val & 0xFFFFF000,
-                 (val & 0xFFFFF000) + (2 << ((val & 0x3E) >> 1))
-        );
-        Log(LogLevel::Debug, "%s", log_output);
-        // Some implementations of Log imply a newline, so we build up the line before printing it
-
-        // TODO: smarter region update for this?
-        UpdatePURegions(true);
+        {
+            char log_output[1024];
+            u32 n = (id >> 4) & 0xF;
+            u32 old = PU_Region[n];
+            PU_Region[n] = val;
+
+            std::snprintf(log_output,
+                     sizeof(log_output),
+                     "PU: region %d = %08X : %s, %08X-%08X\n",
+                     n,
+                     val,
+                     val & 1 ? "enabled" : "disabled",
+                     val & 0xFFFFF000,
+                     (val & 0xFFFFF000) + (2 << ((val & 0x3E) >> 1))
+            );
+            Log(LogLevel::Debug, "%s", log_output);
+            // Some implementations of Log imply a newline, so we build up the line before printing it
+
+            UpdatePURegionRange(n, old);
+        }
         return;
 
 
@@ -776,7 +848,7 @@ u32 ARMv5::CodeRead32(u32 addr, bool branch)
 {
     /*if (branch || (!(addr & 0xFFF)))
     {
-        if (!(PU_Map[addr>>12] & 0x04))
+        if (!(PU_Map[PU_PageRegion[addr>>12]] & 0x04))
         {
             PrefetchAbort();
             return 0;
@@ -808,7 +880,7 @@ u32 ARMv5::CodeRead32(u32 addr, bool branch)
 
 void ARMv5::DataRead8(u32 addr, u32* val)
 {
-    if (!(PU_Map[addr>>12] & 0x01))
+    if (!(PU_Map[PU_PageRegion[addr>>12]] & 0x01))
     {
         DataAbort();
         return;
@@ -829,13 +901,16 @@ void ARMv5::DataRead8(u32 addr, u32* val)
         return;
     }
 
-    *val = BusRead8(addr);
+    if (u8* mem = NDS::LookUpTLB(NDS::ARM9ReadTLB, addr))
+        *val = *(u8*)mem;
+    else
+        *val = BusRead8(addr);
     DataCycles = MemTimings[addr >> 12][1];
 }
 
 void ARMv5::DataRead16(u32 addr, u32* val)
 {
-    if (!(PU_Map[addr>>12] & 0x01))
+    if (!(PU_Map[PU_PageRegion[addr>>12]] & 0x01))
     {
         DataAbort();
         return;
@@ -858,13 +933,16 @@ void ARMv5::DataRead16(u32 addr, u32* val)
         return;
     }
 
-    *val = BusRead16(addr);
+    if (u8* mem = NDS::LookUpTLB(NDS::ARM9ReadTLB, addr))
+        *val = *(u16*)mem;
+    else
+        *val = BusRead16(addr);
     DataCycles = MemTimings[addr >> 12][1];
 }
 
 void ARMv5::DataRead32(u32 addr, u32* val)
 {
-    if (!(PU_Map[addr>>12] & 0x01))
+    if (!(PU_Map[PU_PageRegion[addr>>12]] & 0x01))
     {
         DataAbort();
         return;
@@ -887,7 +965,10 @@ void ARMv5::DataRead32(u32 addr, u32* val)
         return;
     }
 
-    *val = BusRead32(addr);
+    if (u8* mem = NDS::LookUpTLB(NDS::ARM9ReadTLB, addr))
+        *val = *(u32*)mem;
+    else
+        *val = BusRead32(addr);
     DataCycles = MemTimings[addr >> 12][2];
 }
 
@@ -908,13 +989,16 @@ void ARMv5::DataRead32S(u32 addr, u32* val)
         return;
     }
 
-    *val = BusRead32(addr);
+    if (u8* mem = NDS::LookUpTLB(NDS::ARM9ReadTLB, addr))
+        *val = *(u32*)mem;
+    else
+        *val = BusRead32(addr);
     DataCycles += MemTimings[addr >> 12][3];
 }
 
 void ARMv5::DataWrite8(u32 addr, u8 val)
 {
-    if (!(PU_Map[addr>>12] & 0x02))
+    if (!(PU_Map[PU_PageRegion[addr>>12]] & 0x02))
     {
         DataAbort();
         return;
@@ -926,6 +1010,7 @@ void ARMv5::DataWrite8(u32 addr, u8 val)
     {
         DataCycles = 1;
         *(u8*)&ITCM[addr & (ITCMPhysicalSize - 1)] = val;
+        NDS::InvalidateITCMCode(addr);
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_ITCM>(addr);
 #endif
@@ -938,13 +1023,19 @@ void ARMv5::DataWrite8(u32 addr, u8 val)
         return;
     }
 
-    BusWrite8(addr, val);
+    if (u8* mem = NDS::LookUpTLB(NDS::ARM9WriteTLB, addr))
+    {
+        *(u8*)mem = val;
+        NDS::MarkPageDirty(NDS::ARM9WriteTLBPage[addr >> 12]);
+    }
+    else
+        BusWrite8(addr, val);
     DataCycles = MemTimings[addr >> 12][1];
 }
 
 void ARMv5::DataWrite16(u32 addr, u16 val)
 {
-    if (!(PU_Map[addr>>12] & 0x02))
+    if (!(PU_Map[PU_PageRegion[addr>>12]] & 0x02))
     {
         DataAbort();
         return;
@@ -958,6 +1049,7 @@ void ARMv5::DataWrite16(u32 addr, u16 val)
     {
         DataCycles = 1;
         *(u16*)&ITCM[addr & (ITCMPhysicalSize - 1)] = val;
+        NDS::InvalidateITCMCode(addr);
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_ITCM>(addr);
 #endif
@@ -970,13 +1062,19 @@ void ARMv5::DataWrite16(u32 addr, u16 val)
         return;
     }
 
-    BusWrite16(addr, val);
+    if (u8* mem = NDS::LookUpTLB(NDS::ARM9WriteTLB, addr))
+    {
+        *(u16*)mem = val;
+        NDS::MarkPageDirty(NDS::ARM9WriteTLBPage[addr >> 12]);
+    }
+    else
+        BusWrite16(addr, val);
     DataCycles = MemTimings[addr >> 12][1];
 }
 
 void ARMv5::DataWrite32(u32 addr, u32 val)
 {
-    if (!(PU_Map[addr>>12] & 0x02))
+    if (!(PU_Map[PU_PageRegion[addr>>12]] & 0x02))
     {
         DataAbort();
         return;
@@ -990,6 +1088,7 @@ void ARMv5::DataWrite32(u32 addr, u32 val)
     {
         DataCycles = 1;
         *(u32*)&ITCM[addr & (ITCMPhysicalSize - 1)] = val;
+        NDS::InvalidateITCMCode(addr);
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_ITCM>(addr);
 #endif
@@ -1002,7 +1101,13 @@ void ARMv5::DataWrite32(u32 addr, u32 val)
         return;
     }
 
-    BusWrite32(addr, val);
+    if (u8* mem = NDS::LookUpTLB(NDS::ARM9WriteTLB, addr))
+    {
+        *(u32*)mem = val;
+        NDS::MarkPageDirty(NDS::ARM9WriteTLBPage[addr >> 12]);
+    }
+    else
+        BusWrite32(addr, val);
     DataCycles = MemTimings[addr >> 12][2];
 }
 
@@ -1014,6 +1119,7 @@ void ARMv5::DataWrite32S(u32 addr, u32 val)
     {
         DataCycles += 1;
         *(u32*)&ITCM[addr & (ITCMPhysicalSize - 1)] = val;
+        NDS::InvalidateITCMCode(addr);
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_ITCM>(addr);
 #endif
@@ -1026,7 +1132,13 @@ void ARMv5::DataWrite32S(u32 addr, u32 val)
         return;
     }
 
-    BusWrite32(addr, val);
+    if (u8* mem = NDS::LookUpTLB(NDS::ARM9WriteTLB, addr))
+    {
+        *(u32*)mem = val;
+        NDS::MarkPageDirty(NDS::ARM9WriteTLBPage[addr >> 12]);
+    }
+    else
+        BusWrite32(addr, val);
     DataCycles += MemTimings[addr >> 12][3];
 }
 
@@ -23,6 +23,7 @@
 #include "GPU.h"
 #include "DMA_Timings.h"
 #include "Platform.h"
+#include "Profiler.h"
 
 using Platform::Log;
 using Platform::LogLevel;
@@ -706,6 +707,9 @@ template <int ConsoleType>
 void DMA::Run()
 {
     if (!Running) return;
+
+    PROFILE_SCOPE(Profiler::Counter_DMA);
+
     if (CPU == 0) return Run9<ConsoleType>();
     else          return Run7<ConsoleType>();
 }
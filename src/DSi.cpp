@@ -22,6 +22,7 @@
 #include "NDS.h"
 #include "DSi.h"
 #include "ARM.h"
+#include "ARMDecodeCache.h"
 #include "GPU.h"
 #include "NDSCart.h"
 #include "SPI.h"
@@ -644,6 +645,7 @@ void SoftReset()
     ARMJIT_Memory::Reset();
     ARMJIT::CheckAndInvalidateITCM();
 #endif
+    ARMDecodeCache::Reset();
 
     NDS::ARM9->Reset();
     NDS::ARM7->Reset();
@@ -903,6 +905,8 @@ bool LoadNAND()
     memcpy(&NDS::ARM9->ITCM[0x4800], &ARM9iBIOS[0x9920], 0x80);
     memcpy(&NDS::ARM9->ITCM[0x4894], &ARM9iBIOS[0x99A0], 0x1048);
     memcpy(&NDS::ARM9->ITCM[0x58DC], &ARM9iBIOS[0xA9E8], 0x1048);
+    for (u32 i = 0x4000; i < 0x7000; i += 0x1000)
+        NDS::InvalidateITCMCode(i);
 
     u8 ARM7Init[0x3C00];
     memset(ARM7Init, 0, 0x3C00);
@@ -1230,6 +1234,12 @@ void ApplyNewRAMSize(u32 size)
         Log(LogLevel::Debug, "RAM: 16MB\n");
         break;
     }
+
+    NDS::UpdateTLB(0x02000000, 0x03000000);
+    ARMDecodeCache::Generation++;
+#ifdef JIT_ENABLED
+    ARMJIT::UnlinkAllBlocks();
+#endif
 }
 
 
@@ -1515,6 +1525,7 @@ void ARM9Write8(u32 addr, u8 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        NDS::MarkMainRAMDirty(addr);
         *(u8*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
         return;
     }
@@ -1607,6 +1618,7 @@ void ARM9Write16(u32 addr, u16 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        NDS::MarkMainRAMDirty(addr);
         *(u16*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
         return;
     }
@@ -1699,6 +1711,7 @@ void ARM9Write32(u32 addr, u32 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        NDS::MarkMainRAMDirty(addr);
         *(u32*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
         return;
     }
@@ -2007,6 +2020,7 @@ void ARM7Write8(u32 addr, u8 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        NDS::MarkMainRAMDirty(addr);
         *(u8*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
         return;
     }
@@ -2104,6 +2118,7 @@ void ARM7Write16(u32 addr, u16 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        NDS::MarkMainRAMDirty(addr);
         *(u16*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
         return;
     }
@@ -2201,6 +2216,7 @@ void ARM7Write32(u32 addr, u32 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        NDS::MarkMainRAMDirty(addr);
         *(u32*)&NDS::MainRAM[addr & NDS::MainRAMMask] = val;
         return;
     }
@@ -47,16 +47,16 @@ u16 DispStat[2], VMatch[2];
 u8 Palette[2*1024];
 u8 OAM[2*1024];
 
-u8 VRAM_A[128*1024];
-u8 VRAM_B[128*1024];
-u8 VRAM_C[128*1024];
-u8 VRAM_D[128*1024];
-u8 VRAM_E[ 64*1024];
-u8 VRAM_F[ 16*1024];
-u8 VRAM_G[ 16*1024];
-u8 VRAM_H[ 32*1024];
-u8 VRAM_I[ 16*1024];
-u8* const VRAM[9]     = {VRAM_A,  VRAM_B,  VRAM_C,  VRAM_D,  VRAM_E, VRAM_F, VRAM_G, VRAM_H, VRAM_I};
+u8* VRAM_A;
+u8* VRAM_B;
+u8* VRAM_C;
+u8* VRAM_D;
+u8* VRAM_E;
+u8* VRAM_F;
+u8* VRAM_G;
+u8* VRAM_H;
+u8* VRAM_I;
+u8* VRAM[9];
 u32 const VRAMMask[9] = {0x1FFFF, 0x1FFFF, 0x1FFFF, 0x1FFFF, 0xFFFF, 0x3FFF, 0x3FFF, 0x7FFF, 0x3FFF};
 
 u8 VRAMCNT[9];
@@ -88,6 +88,11 @@ int FrontBuffer;
 u32* Framebuffer[2][2];
 int Renderer = 0;
 
+u32 RenderSkip = 0;
+u32 RenderSkipCount;
+bool SkipFrame;
+bool SkipNextFrame;
+
 GPU2D::Unit GPU2D_A(0);
 GPU2D::Unit GPU2D_B(1);
 
@@ -151,6 +156,21 @@ std::unique_ptr<GLCompositor> CurGLCompositor = {};
 
 bool Init()
 {
+#ifndef JIT_ENABLED
+    VRAM_A = new u8[128*1024];
+    VRAM_B = new u8[128*1024];
+    VRAM_C = new u8[128*1024];
+    VRAM_D = new u8[128*1024];
+    VRAM_E = new u8[ 64*1024];
+    VRAM_F = new u8[ 16*1024];
+    VRAM_G = new u8[ 16*1024];
+    VRAM_H = new u8[ 32*1024];
+    VRAM_I = new u8[ 16*1024];
+#endif
+    VRAM[0] = VRAM_A; VRAM[1] = VRAM_B; VRAM[2] = VRAM_C;
+    VRAM[3] = VRAM_D; VRAM[4] = VRAM_E; VRAM[5] = VRAM_F;
+    VRAM[6] = VRAM_G; VRAM[7] = VRAM_H; VRAM[8] = VRAM_I;
+
     GPU2D_Renderer = std::make_unique<GPU2D::SoftRenderer>();
     if (!GPU3D::Init()) return false;
 
@@ -171,6 +191,18 @@ void DeInit()
     if (Framebuffer[0][1]) delete[] Framebuffer[0][1];
     if (Framebuffer[1][0]) delete[] Framebuffer[1][0];
     if (Framebuffer[1][1]) delete[] Framebuffer[1][1];
+
+#ifndef JIT_ENABLED
+    delete[] VRAM_A;
+    delete[] VRAM_B;
+    delete[] VRAM_C;
+    delete[] VRAM_D;
+    delete[] VRAM_E;
+    delete[] VRAM_F;
+    delete[] VRAM_G;
+    delete[] VRAM_H;
+    delete[] VRAM_I;
+#endif
 }
 
 void ResetVRAMCache()
@@ -205,6 +237,10 @@ void Reset()
 {
     VCount = 0;
     NextVCount = -1;
+
+    RenderSkipCount = 0;
+    SkipFrame = false;
+    SkipNextFrame = false;
     TotalScanlines = 0;
 
     DispStat[0] = 0;
@@ -304,8 +340,36 @@ void Stop()
 #endif
 }
 
+void DoSavestate_VRAMBank(Savestate* file, int bank, u32 size)
+{
+    if (file->Saving)
+    {
+        file->VarArray(VRAM[bank], size);
+        return;
+    }
+
+    // mark what's different in the loaded state dirty (run-ahead loads a state every frame,
+    // rebuilding all the flattened VRAM each time would be very slow)
+    static u8 loaded[128*1024];
+    file->VarArray(loaded, size);
+    if (file->Error)
+        return;
+
+    for (u32 i = 0; i < size; i += VRAMDirtyGranularity)
+    {
+        if (memcmp(&VRAM[bank][i], &loaded[i], VRAMDirtyGranularity))
+        {
+            memcpy(&VRAM[bank][i], &loaded[i], VRAMDirtyGranularity);
+            VRAMDirty[bank][i / VRAMDirtyGranularity] = true;
+        }
+    }
+}
+
 void DoSavestate(Savestate* file)
 {
+    if (!file->Saving)
+        GPU3D::CurrentRenderer->PreSavestateLoad();
+
     file->Section("GPUG");
 
     file->Var16(&VCount);
@@ -320,15 +384,15 @@ void DoSavestate(Savestate* file)
     file->VarArray(Palette, 2*1024);
     file->VarArray(OAM, 2*1024);
 
-    file->VarArray(VRAM_A, 128*1024);
-    file->VarArray(VRAM_B, 128*1024);
-    file->VarArray(VRAM_C, 128*1024);
-    file->VarArray(VRAM_D, 128*1024);
-    file->VarArray(VRAM_E,  64*1024);
-    file->VarArray(VRAM_F,  16*1024);
-    file->VarArray(VRAM_G,  16*1024);
-    file->VarArray(VRAM_H,  32*1024);
-    file->VarArray(VRAM_I,  16*1024);
+    DoSavestate_VRAMBank(file, 0, 128*1024);
+    DoSavestate_VRAMBank(file, 1, 128*1024);
+    DoSavestate_VRAMBank(file, 2, 128*1024);
+    DoSavestate_VRAMBank(file, 3, 128*1024);
+    DoSavestate_VRAMBank(file, 4,  64*1024);
+    DoSavestate_VRAMBank(file, 5,  16*1024);
+    DoSavestate_VRAMBank(file, 6,  16*1024);
+    DoSavestate_VRAMBank(file, 7,  32*1024);
+    DoSavestate_VRAMBank(file, 8,  16*1024);
 
     file->VarArray(VRAMCNT, 9);
     file->Var8(&VRAMSTAT);
@@ -367,7 +431,12 @@ void DoSavestate(Savestate* file)
     GPU2D_B.DoSavestate(file);
     GPU3D::DoSavestate(file);
 
-    ResetVRAMCache();
+    // the flattened VRAM doesn't have to be thrown away, the parts of VRAM
+    // which were changed by loading are marked dirty, and remapped parts
+    // are detected like after any other mapping change
+
+    if (!file->Saving)
+        GPU3D::CurrentRenderer->PostSavestateLoad();
 }
 
 void AssignFramebuffers()
@@ -591,6 +660,11 @@ void MapVRAM_AB(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateTLB(0x06000000, 0x07000000);
+#ifdef JIT_ENABLED
+    ARMJIT_Memory::RemapVRAM();
+#endif
 }
 
 void MapVRAM_CD(u32 bank, u8 cnt)
@@ -680,6 +754,11 @@ void MapVRAM_CD(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateTLB(0x06000000, 0x07000000);
+#ifdef JIT_ENABLED
+    ARMJIT_Memory::RemapVRAM();
+#endif
 }
 
 void MapVRAM_E(u32 bank, u8 cnt)
@@ -744,6 +823,11 @@ void MapVRAM_E(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateTLB(0x06000000, 0x07000000);
+#ifdef JIT_ENABLED
+    ARMJIT_Memory::RemapVRAM();
+#endif
 }
 
 void MapVRAM_FG(u32 bank, u8 cnt)
@@ -844,6 +928,11 @@ void MapVRAM_FG(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateTLB(0x06000000, 0x07000000);
+#ifdef JIT_ENABLED
+    ARMJIT_Memory::RemapVRAM();
+#endif
 }
 
 void MapVRAM_H(u32 bank, u8 cnt)
@@ -906,6 +995,11 @@ void MapVRAM_H(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateTLB(0x06000000, 0x07000000);
+#ifdef JIT_ENABLED
+    ARMJIT_Memory::RemapVRAM();
+#endif
 }
 
 void MapVRAM_I(u32 bank, u8 cnt)
@@ -976,6 +1070,11 @@ void MapVRAM_I(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateTLB(0x06000000, 0x07000000);
+#ifdef JIT_ENABLED
+    ARMJIT_Memory::RemapVRAM();
+#endif
 }
 
 
@@ -1029,6 +1128,24 @@ void StartFrame()
     // * if we have display FIFO DMA
     RunFIFO = GPU2D_A.UsesFIFO() || NDS::DMAsInMode(0, 0x04);
 
+    // the 3D frame shown during the next frame is rendered during this one,
+    // so decide a frame ahead whether it will be presented
+    // the OpenGL renderer composites on the GPU side and always draws everything
+    SkipFrame = SkipNextFrame;
+    if (RenderSkip > 0 && !GPU3D::CurrentRenderer->Accelerated)
+    {
+        RenderSkipCount++;
+        if (RenderSkipCount > RenderSkip)
+            RenderSkipCount = 0;
+
+        SkipNextFrame = RenderSkipCount != 0;
+    }
+    else
+    {
+        RenderSkipCount = 0;
+        SkipNextFrame = false;
+    }
+
     TotalScanlines = 0;
     StartScanline(0);
 }
@@ -1078,8 +1195,11 @@ void StartHBlank(u32 line)
 
 void FinishFrame(u32 lines)
 {
-    FrontBuffer = FrontBuffer ? 0 : 1;
-    AssignFramebuffers();
+    if (!SkipFrame)
+    {
+        FrontBuffer = FrontBuffer ? 0 : 1;
+        AssignFramebuffers();
+    }
 
     TotalScanlines = lines;
 
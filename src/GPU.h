@@ -42,17 +42,18 @@ extern u8 VRAMSTAT;
 extern u8 Palette[2*1024];
 extern u8 OAM[2*1024];
 
-extern u8 VRAM_A[128*1024];
-extern u8 VRAM_B[128*1024];
-extern u8 VRAM_C[128*1024];
-extern u8 VRAM_D[128*1024];
-extern u8 VRAM_E[ 64*1024];
-extern u8 VRAM_F[ 16*1024];
-extern u8 VRAM_G[ 16*1024];
-extern u8 VRAM_H[ 32*1024];
-extern u8 VRAM_I[ 16*1024];
-
-extern u8* const VRAM[9];
+// with the JIT these are part of the fastmem memory block, see ARMJIT_Memory::Init
+extern u8* VRAM_A; // 128KB
+extern u8* VRAM_B; // 128KB
+extern u8* VRAM_C; // 128KB
+extern u8* VRAM_D; // 128KB
+extern u8* VRAM_E; //  64KB
+extern u8* VRAM_F; //  16KB
+extern u8* VRAM_G; //  16KB
+extern u8* VRAM_H; //  32KB
+extern u8* VRAM_I; //  16KB
+
+extern u8* VRAM[9];
 
 extern u32 VRAMMap_LCDC;
 extern u32 VRAMMap_ABG[0x20];
@@ -75,6 +76,14 @@ extern u8* VRAMPtr_BOBJ[0x8];
 extern int FrontBuffer;
 extern u32* Framebuffer[2][2];
 
+// render skipping: RenderSkip frames are emulated without being drawn
+// between two presented frames. SkipFrame is set while the current frame
+// isn't drawn, FrontBuffer isn't flipped at the end of such frames.
+extern u32 RenderSkip;
+extern u32 RenderSkipCount;
+extern bool SkipFrame;
+extern bool SkipNextFrame;
+
 extern GPU2D::Unit GPU2D_A;
 extern GPU2D::Unit GPU2D_B;
 
@@ -18,6 +18,7 @@
 
 #include "GPU2D_Soft.h"
 #include "GPU.h"
+#include "Profiler.h"
 
 namespace GPU2D
 {
@@ -163,6 +164,8 @@ u32 SoftRenderer::ColorComposite(int i, u32 val1, u32 val2)
 
 void SoftRenderer::DrawScanline(u32 line, Unit* unit)
 {
+    PROFILE_SCOPE(Profiler::Counter_GPU2D);
+
     CurUnit = unit;
 
     int stride = GPU3D::CurrentRenderer->Accelerated ? (256*3 + 1) : 256;
@@ -203,6 +206,11 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
     if (line == 0 && CurUnit->CaptureCnt & (1 << 31) && !forceblank)
         CurUnit->CaptureLatch = true;
 
+    // frames that won't be presented only need to be drawn for display capture
+    bool capture = (CurUnit->Num == 0) && CurUnit->CaptureLatch;
+    if (GPU::SkipFrame && !capture)
+        return;
+
     if (CurUnit->Num == 0)
     {
         if (!GPU3D::CurrentRenderer->Accelerated)
@@ -294,7 +302,7 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
     }
 
     // capture
-    if ((CurUnit->Num == 0) && CurUnit->CaptureLatch)
+    if (capture)
     {
         u32 capwidth, capheight;
         switch ((CurUnit->CaptureCnt >> 20) & 0x3)
@@ -309,6 +317,9 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
             DoCapture(line, capwidth);
     }
 
+    if (GPU::SkipFrame)
+        return;
+
     u32 masterBrightness = CurUnit->MasterBrightness;
 
     if (GPU3D::CurrentRenderer->Accelerated)
@@ -1644,6 +1655,8 @@ void SoftRenderer::InterleaveSprites(u32 prio)
 
 void SoftRenderer::DrawSprites(u32 line, Unit* unit)
 {
+    PROFILE_SCOPE(Profiler::Counter_GPU2D);
+
     CurUnit = unit;
 
     if (line == 0)
@@ -1669,6 +1682,10 @@ void SoftRenderer::DrawSprites(u32 line, Unit* unit)
         GPU::MakeVRAMFlat_BOBJCoherent(objDirty);
     }
 
+    // sprites for line 0 are drawn before the capture latch is known, always render those
+    if (line > 0 && GPU::SkipFrame && !((CurUnit->Num == 0) && CurUnit->CaptureLatch))
+        return;
+
     NumSprites[CurUnit->Num] = 0;
     memset(OBJLine[CurUnit->Num], 0, 256*4);
     memset(OBJWindow[CurUnit->Num], 0, 256);
@@ -23,6 +23,7 @@
 #include "GPU.h"
 #include "FIFO.h"
 #include "Platform.h"
+#include "Profiler.h"
 
 using Platform::Log;
 using Platform::LogLevel;
@@ -388,6 +389,99 @@ void Reset()
     AbortFrame = false;
 }
 
+// packs (save=true) or unpacks a field of the vertex/polygon RAM savestate buffer
+template <bool save>
+void DoSavestate_Field(u8*& pos, void* var, u32 len)
+{
+    if (save) memcpy(pos, var, len);
+    else      memcpy(var, pos, len);
+    pos += len;
+}
+
+template <bool save>
+void DoSavestate_Bool32(u8*& pos, bool* var)
+{
+    // for compatibility, like Savestate::Bool32()
+    u32 val = *var;
+    DoSavestate_Field<save>(pos, &val, sizeof(u32));
+    if (!save) *var = val != 0;
+}
+
+const u32 SavestateVertexSize = sizeof(s32)*4 + sizeof(s32)*3 + sizeof(s16)*2 + 4 + sizeof(s32)*2 + sizeof(s32)*3;
+
+constexpr u32 SavestatePolygonSize(bool type)
+{
+    return 10*4 + 4 + sizeof(s32)*10*2 + 4 + 3*4 + 4*4 + (type ? 4 : 0) + 6*4 + 4;
+}
+
+u8 SavestateBuffer[6144*2 * SavestateVertexSize + 2048*2 * SavestatePolygonSize(true)];
+
+template <bool save>
+void DoSavestate_Vertex(u8*& pos, Vertex* vtx)
+{
+    DoSavestate_Field<save>(pos, vtx->Position, sizeof(s32)*4);
+    DoSavestate_Field<save>(pos, vtx->Color, sizeof(s32)*3);
+    DoSavestate_Field<save>(pos, vtx->TexCoords, sizeof(s16)*2);
+
+    DoSavestate_Bool32<save>(pos, &vtx->Clipped);
+
+    DoSavestate_Field<save>(pos, vtx->FinalPosition, sizeof(s32)*2);
+    DoSavestate_Field<save>(pos, vtx->FinalColor, sizeof(s32)*3);
+}
+
+template <bool save>
+void DoSavestate_Polygon(u8*& pos, Polygon* poly, bool type)
+{
+    // this is a bit ugly, but eh
+    // we can't save the pointers as-is, that's a bad idea
+    for (int j = 0; j < 10; j++)
+    {
+        u32 id;
+        if (save)
+        {
+            Vertex* ptr = poly->Vertices[j];
+            if (ptr) id = (u32)(ptr - &VertexRAM[0]);
+            else     id = -1;
+        }
+        DoSavestate_Field<save>(pos, &id, sizeof(u32));
+        if (!save)
+        {
+            if (id == 0xFFFFFFFF) poly->Vertices[j] = NULL;
+            else          poly->Vertices[j] = &VertexRAM[id];
+        }
+    }
+
+    DoSavestate_Field<save>(pos, &poly->NumVertices, sizeof(u32));
+
+    DoSavestate_Field<save>(pos, poly->FinalZ, sizeof(s32)*10);
+    DoSavestate_Field<save>(pos, poly->FinalW, sizeof(s32)*10);
+    DoSavestate_Bool32<save>(pos, &poly->WBuffer);
+
+    DoSavestate_Field<save>(pos, &poly->Attr, sizeof(u32));
+    DoSavestate_Field<save>(pos, &poly->TexParam, sizeof(u32));
+    DoSavestate_Field<save>(pos, &poly->TexPalette, sizeof(u32));
+
+    DoSavestate_Bool32<save>(pos, &poly->FacingView);
+    DoSavestate_Bool32<save>(pos, &poly->Translucent);
+
+    DoSavestate_Bool32<save>(pos, &poly->IsShadowMask);
+    DoSavestate_Bool32<save>(pos, &poly->IsShadow);
+
+    if (type)
+        DoSavestate_Field<save>(pos, &poly->Type, sizeof(u32));
+    else
+        poly->Type = 0;
+
+    DoSavestate_Field<save>(pos, &poly->VTop, sizeof(u32));
+    DoSavestate_Field<save>(pos, &poly->VBottom, sizeof(u32));
+    DoSavestate_Field<save>(pos, &poly->YTop, sizeof(s32));
+    DoSavestate_Field<save>(pos, &poly->YBottom, sizeof(s32));
+    DoSavestate_Field<save>(pos, &poly->XTop, sizeof(s32));
+    DoSavestate_Field<save>(pos, &poly->XBottom, sizeof(s32));
+
+    DoSavestate_Field<save>(pos, &poly->SortKey, sizeof(u32));
+}
+
 void DoSavestate(Savestate* file)
 {
     file->Section("GP3D");
@@ -484,7 +578,7 @@ void DoSavestate(Savestate* file)
     if (file->Saving)
     {
         u32 id;
-        if (LastStripPolygon) id = (u32)((LastStripPolygon - (&PolygonRAM[0])) / sizeof(Polygon));
+        if (LastStripPolygon) id = (u32)(LastStripPolygon - &PolygonRAM[0]);
         else                  id = -1;
         file->Var32(&id);
     }
@@ -504,93 +598,71 @@ void DoSavestate(Savestate* file)
     file->Var32(&FlushRequest);
     file->Var32(&FlushAttributes);
 
-    for (int i = 0; i < 6144*2; i++)
-    {
-        Vertex* vtx = &VertexRAM[i];
-
-        file->VarArray(vtx->Position, sizeof(s32)*4);
-        file->VarArray(vtx->Color, sizeof(s32)*3);
-        file->VarArray(vtx->TexCoords, sizeof(s16)*2);
+    // vertex and polygon RAM make up most of the state, going through
+    // the savestate for every field of them is slow (run-ahead does this every frame)
+    // so they're packed into a buffer with the same layout and transferred in one go
+    bool polyType = file->IsAtLeastVersion(4, 1);
+    u32 vtxRAMSize = 6144*2 * SavestateVertexSize;
+    u32 polyRAMSize = 2048*2 * SavestatePolygonSize(polyType);
 
-        file->Bool32(&vtx->Clipped);
+    if (file->Saving)
+    {
+        u8* pos = SavestateBuffer;
+        for (int i = 0; i < 6144*2; i++)
+            DoSavestate_Vertex<true>(pos, &VertexRAM[i]);
+        for (int i = 0; i < 2048*2; i++)
+            DoSavestate_Polygon<true>(pos, &PolygonRAM[i], polyType);
 
-        file->VarArray(vtx->FinalPosition, sizeof(s32)*2);
-        file->VarArray(vtx->FinalColor, sizeof(s32)*3);
+        file->VarArray(SavestateBuffer, vtxRAMSize + polyRAMSize);
     }
-
-    for(int i = 0; i < 2048*2; i++)
+    else
     {
-        Polygon* poly = &PolygonRAM[i];
+        file->VarArray(SavestateBuffer, vtxRAMSize + polyRAMSize);
 
-        // this is a bit ugly, but eh
-        // we can't save the pointers as-is, that's a bad idea
-        if (file->Saving)
-        {
-            for (int j = 0; j < 10; j++)
-            {
-                Vertex* ptr = poly->Vertices[j];
-                u32 id;
-                if (ptr) id = (u32)((ptr - (&VertexRAM[0])) / sizeof(Vertex));
-                else     id = -1;
-                file->Var32(&id);
-            }
-        }
-        else
+        if (!file->Error)
         {
-            for (int j = 0; j < 10; j++)
+            u8* pos = SavestateBuffer;
+            for (int i = 0; i < 6144*2; i++)
+                DoSavestate_Vertex<false>(pos, &VertexRAM[i]);
+            for (int i = 0; i < 2048*2; i++)
             {
-                u32 id = -1;
-                file->Var32(&id);
-                if (id == 0xFFFFFFFF) poly->Vertices[j] = NULL;
-                else          poly->Vertices[j] = &VertexRAM[id];
-            }
-        }
-
-        file->Var32(&poly->NumVertices);
-
-        file->VarArray(poly->FinalZ, sizeof(s32)*10);
-        file->VarArray(poly->FinalW, sizeof(s32)*10);
-        file->Bool32(&poly->WBuffer);
-
-        file->Var32(&poly->Attr);
-        file->Var32(&poly->TexParam);
-        file->Var32(&poly->TexPalette);
+                Polygon* poly = &PolygonRAM[i];
+                DoSavestate_Polygon<false>(pos, poly, polyType);
 
-        file->Bool32(&poly->FacingView);
-        file->Bool32(&poly->Translucent);
+                poly->Degenerate = false;
 
-        file->Bool32(&poly->IsShadowMask);
-        file->Bool32(&poly->IsShadow);
-
-        if (file->IsAtLeastVersion(4, 1))
-            file->Var32((u32*)&poly->Type);
-        else
-            poly->Type = 0;
-
-        file->Var32(&poly->VTop);
-        file->Var32(&poly->VBottom);
-        file->Var32((u32*)&poly->YTop);
-        file->Var32((u32*)&poly->YBottom);
-        file->Var32((u32*)&poly->XTop);
-        file->Var32((u32*)&poly->XBottom);
-
-        file->Var32(&poly->SortKey);
-
-        if (!file->Saving)
-        {
-            poly->Degenerate = false;
+                for (u32 j = 0; j < poly->NumVertices; j++)
+                {
+                    if (poly->Vertices[j]->Position[3] == 0)
+                        poly->Degenerate = true;
+                }
 
-            for (u32 j = 0; j < poly->NumVertices; j++)
-            {
-                if (poly->Vertices[j]->Position[3] == 0)
-                    poly->Degenerate = true;
+                if (poly->YBottom > 192) poly->Degenerate = true;
             }
+        }
+    }
 
-            if (poly->YBottom > 192) poly->Degenerate = true;
+    // the polygon list latched at VBlank, so the frame being displayed
+    // can be rendered again after loading the state
+    if (file->IsAtLeastVersion(10, 1))
+    {
+        file->Var32(&RenderNumPolygons);
+        if (RenderNumPolygons > 2048) RenderNumPolygons = 2048;
+        for (u32 i = 0; i < RenderNumPolygons; i++)
+        {
+            u32 id;
+            if (file->Saving) id = (u32)(RenderPolygonRAM[i] - &PolygonRAM[0]);
+            file->Var32(&id);
+            if (!file->Saving) RenderPolygonRAM[i] = &PolygonRAM[id & 0xFFF];
         }
     }
+    else
+    {
+        // better safe than sorry, I guess
+        // might cause a blank frame but atleast it won't shit itself
+        RenderNumPolygons = 0;
+    }
 
-    // probably not worth storing the vblank-latched Renderxxxxxx variables
     CmdStallQueue.DoSavestate(file);
 
     file->Var32((u32*)&VertexPipeline);
@@ -606,10 +678,6 @@ void DoSavestate(Savestate* file)
 
         CurVertexRAM = &VertexRAM[CurRAMBank ? 6144 : 0];
         CurPolygonRAM = &PolygonRAM[CurRAMBank ? 2048 : 0];
-
-        // better safe than sorry, I guess
-        // might cause a blank frame but atleast it won't shit itself
-        RenderNumPolygons = 0;
     }
 
     file->VarArray(CurVertex, sizeof(s16)*3);
@@ -2451,6 +2519,8 @@ void FinishWork(s32 cycles)
 
 void Run()
 {
+    PROFILE_SCOPE(Profiler::Counter_GPU3D);
+
     if (!GeometryEnabled || FlushRequest ||
         (CmdPIPE.IsEmpty() && !(GXStat & (1<<27))))
     {
@@ -2505,6 +2575,7 @@ void CheckFIFODMA()
 
 void VCount144()
 {
+    PROFILE_SCOPE(Profiler::Counter_GPU3D);
     CurrentRenderer->VCount144();
 }
 
@@ -2528,6 +2599,8 @@ bool YSort(Polygon* a, Polygon* b)
 
 void VBlank()
 {
+    PROFILE_SCOPE(Profiler::Counter_GPU3D);
+
     if (GeometryEnabled)
     {
         if (RenderingEnabled)
@@ -2605,6 +2678,7 @@ void VBlank()
 
 void VCount215()
 {
+    PROFILE_SCOPE(Profiler::Counter_GPU3D);
     CurrentRenderer->RenderFrame();
 }
 
@@ -3020,16 +3094,13 @@ void Write32(u32 addr, u32 val)
 
     if (addr >= 0x04000400 && addr < 0x04000440)
     {
-        WriteToGXFIFO(val);
+        WriteGXFIFO32(addr, val);
         return;
     }
 
     if (addr >= 0x04000440 && addr < 0x040005CC)
     {
-        CmdFIFOEntry entry;
-        entry.Command = (addr & 0x1FC) >> 2;
-        entry.Param = val;
-        CmdFIFOWrite(entry);
+        WriteCmdPort32(addr, val);
         return;
     }
 
@@ -3062,6 +3133,23 @@ void Write32(u32 addr, u32 val)
     Log(LogLevel::Warn, "unknown GPU3D write32 %08X %08X\n", addr, val);
 }
 
+void WriteGXFIFO32(u32 addr, u32 val)
+{
+    if (!GeometryEnabled) return;
+
+    WriteToGXFIFO(val);
+}
+
+void WriteCmdPort32(u32 addr, u32 val)
+{
+    if (!GeometryEnabled) return;
+
+    CmdFIFOEntry entry;
+    entry.Command = (addr & 0x1FC) >> 2;
+    entry.Param = val;
+    CmdFIFOWrite(entry);
+}
+
 Renderer3D::Renderer3D(bool Accelerated)
 : Accelerated(Accelerated)
 { }
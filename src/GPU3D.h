@@ -134,6 +134,11 @@ void Write8(u32 addr, u8 val);
 void Write16(u32 addr, u16 val);
 void Write32(u32 addr, u32 val);
 
+// 32-bit stores to the GX FIFO and the command ports, without going through Write32
+// the JIT calls these directly when the address is known at compile time
+void WriteGXFIFO32(u32 addr, u32 val);
+void WriteCmdPort32(u32 addr, u32 val);
+
 class Renderer3D
 {
 public:
@@ -159,6 +164,11 @@ public:
     virtual void RenderFrame() = 0;
     virtual void RestartFrame() {};
     virtual u32* GetLine(int line) = 0;
+
+    // called around savestate loading: the renderer has to stop using the
+    // current frame data, and redo its output from the loaded state
+    virtual void PreSavestateLoad() {};
+    virtual void PostSavestateLoad() {};
 };
 
 extern int Renderer;
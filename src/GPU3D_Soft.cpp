@@ -23,6 +23,7 @@
 #include <string.h>
 #include "NDS.h"
 #include "GPU.h"
+#include "Profiler.h"
 
 
 namespace GPU3D
@@ -62,7 +63,9 @@ void SoftRenderer::SetupRenderThread()
         Platform::Semaphore_Reset(Sema_RenderStart);
         Platform::Semaphore_Reset(Sema_ScanlineCount);
 
-        Platform::Semaphore_Post(Sema_RenderStart);
+        // skipped frames are only rendered once they're needed
+        if (!FrameSkipped)
+            Platform::Semaphore_Post(Sema_RenderStart);
     }
     else
     {
@@ -87,6 +90,8 @@ bool SoftRenderer::Init()
     RenderThreadRunning = false;
     RenderThreadRendering = false;
 
+    FrameSkipped = false;
+
     return true;
 }
 
@@ -107,6 +112,8 @@ void SoftRenderer::Reset()
 
     PrevIsShadowMask = false;
 
+    FrameSkipped = false;
+
     SetupRenderThread();
 }
 
@@ -1618,6 +1625,8 @@ void SoftRenderer::ClearBuffers()
 
 void SoftRenderer::RenderPolygons(bool threaded, Polygon** polygons, int npolys)
 {
+    PROFILE_SCOPE(Profiler::Counter_GPU3DRender);
+
     int j = 0;
     for (int i = 0; i < npolys; i++)
     {
@@ -1644,7 +1653,7 @@ void SoftRenderer::RenderPolygons(bool threaded, Polygon** polygons, int npolys)
 
 void SoftRenderer::VCount144()
 {
-    if (RenderThreadRunning.load(std::memory_order_relaxed) && !GPU3D::AbortFrame)
+    if (RenderThreadRunning.load(std::memory_order_relaxed) && !GPU3D::AbortFrame && !FrameSkipped)
         Platform::Semaphore_Wait(Sema_RenderDone);
 }
 
@@ -1656,8 +1665,20 @@ void SoftRenderer::RenderFrame()
     bool textureChanged = GPU::MakeVRAMFlat_TextureCoherent(textureDirty);
     bool texPalChanged = GPU::MakeVRAMFlat_TexPalCoherent(texPalDirty);
 
-    FrameIdentical = !(textureChanged || texPalChanged) && RenderFrameIdentical;
+    FrameIdentical = !(textureChanged || texPalChanged) && RenderFrameIdentical && !FrameSkipped;
+
+    // the next frame won't be presented, only render it if display capture needs it
+    // capture usually gets enabled during VBlank, so it should be known by now
+    // if it gets enabled later, GetLine() will render the frame on demand
+    FrameSkipped = GPU::SkipNextFrame && !(GPU::GPU2D_A.CaptureCnt & (1<<31));
+    if (FrameSkipped)
+        return;
+
+    StartRendering();
+}
 
+void SoftRenderer::StartRendering()
+{
     if (RenderThreadRunning.load(std::memory_order_relaxed))
     {
         Platform::Semaphore_Post(Sema_RenderStart);
@@ -1674,6 +1695,28 @@ void SoftRenderer::RestartFrame()
     SetupRenderThread();
 }
 
+void SoftRenderer::PreSavestateLoad()
+{
+    // the render thread might still be working on the current frame
+    StopRenderThread();
+}
+
+void SoftRenderer::PostSavestateLoad()
+{
+    auto textureDirty = GPU::VRAMDirty_Texture.DeriveState(GPU::VRAMMap_Texture);
+    auto texPalDirty = GPU::VRAMDirty_TexPal.DeriveState(GPU::VRAMMap_TexPal);
+
+    GPU::MakeVRAMFlat_TextureCoherent(textureDirty);
+    GPU::MakeVRAMFlat_TexPalCoherent(texPalDirty);
+
+    // the color buffer doesn't match the loaded state anymore,
+    // render the frame again once it's needed
+    FrameIdentical = false;
+    FrameSkipped = true;
+
+    SetupRenderThread();
+}
+
 void SoftRenderer::RenderThreadFunc()
 {
     for (;;)
@@ -1699,6 +1742,12 @@ void SoftRenderer::RenderThreadFunc()
 
 u32* SoftRenderer::GetLine(int line)
 {
+    if (FrameSkipped)
+    {
+        FrameSkipped = false;
+        StartRendering();
+    }
+
     if (RenderThreadRunning.load(std::memory_order_relaxed))
     {
         if (line < 192)
@@ -41,6 +41,9 @@ public:
     virtual void RestartFrame() override;
     virtual u32* GetLine(int line) override;
 
+    virtual void PreSavestateLoad() override;
+    virtual void PostSavestateLoad() override;
+
     void SetupRenderThread();
     void StopRenderThread();
 private:
@@ -469,6 +472,7 @@ private:
     void ScanlineFinalPass(s32 y);
     void ClearBuffers();
     void RenderPolygons(bool threaded, Polygon** polygons, int npolys);
+    void StartRendering();
 
     void RenderThreadFunc();
 
@@ -503,6 +507,10 @@ private:
 
     bool FrameIdentical;
 
+    // set when rendering was skipped because the frame won't be presented
+    // the color buffer is stale until the frame is rendered after all
+    bool FrameSkipped;
+
     // threading
 
     bool Threaded;
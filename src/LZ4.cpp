@@ -0,0 +1,219 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <vector>
+#include "LZ4.h"
+
+namespace LZ4
+{
+
+/*
+    block format
+
+    sequence of:
+    token - high nibble: amount of literals, low nibble: match length - 4
+            15 means more length bytes follow, added up until one isn't 255
+    literals
+    match offset - 16-bit, counted back from the current position
+
+    the last sequence only has literals. the last 5 bytes are always literals,
+    and the last match starts at least 12 bytes before the end
+*/
+
+const u32 MinMatch = 4;
+const u32 LastLiterals = 5;
+const u32 MatchFindLimit = 12;
+const u32 MaxOffset = 0xFFFF;
+
+const u32 HashBits = 16;
+
+inline u32 Read32(const u8* ptr)
+{
+    u32 ret;
+    memcpy(&ret, ptr, 4);
+    return ret;
+}
+
+inline u32 Hash(u32 seq)
+{
+    return (seq * 2654435761U) >> (32 - HashBits);
+}
+
+// returns the new output position, or 0 if the output is full
+u32 WriteLength(u8* dst, u32 pos, u32 dstlen, u32 len)
+{
+    while (len >= 255)
+    {
+        if (pos >= dstlen) return 0;
+        dst[pos++] = 255;
+        len -= 255;
+    }
+
+    if (pos >= dstlen) return 0;
+    dst[pos++] = len;
+    return pos;
+}
+
+// litlen literals, followed by a match unless matchlen is 0
+u32 WriteSequence(u8* dst, u32 pos, u32 dstlen, const u8* literals, u32 litlen, u32 offset, u32 matchlen)
+{
+    if (pos >= dstlen) return 0;
+
+    u32 tokenpos = pos++;
+    u8 token = (litlen >= 15 ? 15 : litlen) << 4;
+    if (litlen >= 15)
+    {
+        pos = WriteLength(dst, pos, dstlen, litlen - 15);
+        if (!pos) return 0;
+    }
+
+    if (pos + litlen > dstlen) return 0;
+    memcpy(&dst[pos], literals, litlen);
+    pos += litlen;
+
+    if (matchlen)
+    {
+        if (pos + 2 > dstlen) return 0;
+        dst[pos++] = offset & 0xFF;
+        dst[pos++] = offset >> 8;
+
+        matchlen -= MinMatch;
+        token |= (matchlen >= 15 ? 15 : matchlen);
+        if (matchlen >= 15)
+        {
+            pos = WriteLength(dst, pos, dstlen, matchlen - 15);
+            if (!pos) return 0;
+        }
+    }
+
+    dst[tokenpos] = token;
+    return pos;
+}
+
+u32 Compress(const u8* src, u32 len, u8* dst, u32 dstlen)
+{
+    u32 pos = 0;
+    u32 anchor = 0;
+
+    if (len >= MatchFindLimit + 1)
+    {
+        std::vector<u32> table(1 << HashBits, 0);
+
+        u32 matchlimit = len - LastLiterals;
+        u32 i = 0;
+        while (i + MatchFindLimit <= len)
+        {
+            u32 seq = Read32(&src[i]);
+            u32 h = Hash(seq);
+            u32 ref = table[h];
+            table[h] = i;
+
+            if (ref >= i || (i - ref) > MaxOffset || Read32(&src[ref]) != seq)
+            {
+                // skip faster through data that doesn't compress
+                i += 1 + ((i - anchor) >> 6);
+                continue;
+            }
+
+            while (i > anchor && ref > 0 && src[i-1] == src[ref-1])
+            {
+                i--;
+                ref--;
+            }
+
+            u32 matchlen = MinMatch;
+            while (i + matchlen < matchlimit && src[i + matchlen] == src[ref + matchlen])
+                matchlen++;
+
+            pos = WriteSequence(dst, pos, dstlen, &src[anchor], i - anchor, i - ref, matchlen);
+            if (!pos) return 0;
+
+            i += matchlen;
+            anchor = i;
+        }
+    }
+
+    return WriteSequence(dst, pos, dstlen, &src[anchor], len - anchor, 0, 0);
+}
+
+bool ReadLength(const u8* src, u32 len, u32& pos, u32& val)
+{
+    for (;;)
+    {
+        if (pos >= len) return false;
+        u8 b = src[pos++];
+        val += b;
+        if (b != 255) return true;
+    }
+}
+
+bool Decompress(const u8* src, u32 len, u8* dst, u32 dstlen)
+{
+    u32 in = 0;
+    u32 out = 0;
+
+    while (in < len)
+    {
+        u8 token = src[in++];
+
+        u32 litlen = token >> 4;
+        if (litlen == 15 && !ReadLength(src, len, in, litlen))
+            return false;
+
+        if (litlen > len - in || litlen > dstlen - out)
+            return false;
+        memcpy(&dst[out], &src[in], litlen);
+        in += litlen;
+        out += litlen;
+
+        if (in == len)
+            break;
+
+        if (len - in < 2)
+            return false;
+        u32 offset = src[in] | (src[in+1] << 8);
+        in += 2;
+        if (offset == 0 || offset > out)
+            return false;
+
+        u32 matchlen = token & 0xF;
+        if (matchlen == 15 && !ReadLength(src, len, in, matchlen))
+            return false;
+        matchlen += MinMatch;
+
+        if (matchlen > dstlen - out)
+            return false;
+
+        // the match may overlap with what it produces
+        if (offset == 1)
+            memset(&dst[out], dst[out - 1], matchlen);
+        else if (offset >= matchlen)
+            memcpy(&dst[out], &dst[out - offset], matchlen);
+        else
+        {
+            for (u32 j = 0; j < matchlen; j++)
+                dst[out + j] = dst[out - offset + j];
+        }
+        out += matchlen;
+    }
+
+    return out == dstlen;
+}
+
+}
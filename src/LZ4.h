@@ -0,0 +1,42 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "types.h"
+
+// small LZ4 block format compressor, used for savestate files
+//
+// greedy single-probe matching: not the best ratio, but fast, and more than
+// enough for savestates, which are mostly made of zero filled memory
+
+namespace LZ4
+{
+
+// compresses len bytes from src into dst
+// returns the compressed length, or 0 if it doesn't fit in dstlen bytes
+u32 Compress(const u8* src, u32 len, u8* dst, u32 dstlen);
+
+// decompresses a block which must expand to exactly dstlen bytes
+// returns false if the data is corrupt
+bool Decompress(const u8* src, u32 len, u8* dst, u32 dstlen);
+
+}
+
+#endif // LZ4_H
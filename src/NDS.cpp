@@ -18,9 +18,13 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
 #include <inttypes.h>
+#include <algorithm>
+#include <vector>
 #include "NDS.h"
 #include "ARM.h"
+#include "ARMDecodeCache.h"
 #include "NDSCart.h"
 #include "GBACart.h"
 #include "DMA.h"
@@ -31,8 +35,10 @@
 #include "RTC.h"
 #include "Wifi.h"
 #include "AREngine.h"
+#include "Rewind.h"
 #include "Platform.h"
 #include "FreeBIOS.h"
+#include "Profiler.h"
 
 #ifdef JIT_ENABLED
 #include "ARMJIT.h"
@@ -86,6 +92,7 @@ ARMv4* ARM7;
 #ifdef JIT_ENABLED
 bool EnableJIT;
 #endif
+bool EnableDecodeCache;
 
 u32 NumFrames;
 u32 NumLagFrames;
@@ -93,6 +100,10 @@ bool LagFrameFlag;
 u64 LastSysClockCycles;
 u64 FrameStartTimestamp;
 
+u32 RunAheadFrames = 0;
+Savestate* RunAheadState = nullptr;
+bool RunningAhead = false;
+
 int CurCPU;
 
 const s32 kMaxIterationCycles = 64;
@@ -108,6 +119,12 @@ u64 SysTimestamp;
 SchedEvent SchedList[Event_MAX];
 u32 SchedListMask;
 
+// scheduled events are also kept in a binary min-heap ordered by timestamp
+// so the next event is always at the top, and RunSystem only touches due events
+u8 SchedHeap[Event_MAX];
+u8 SchedHeapPos[Event_MAX]; // position of each event in the heap, 0xFF if not queued
+u32 SchedHeapSize;
+
 u32 CPUStop;
 
 u8 ARM9BIOS[0x1000];
@@ -125,6 +142,26 @@ MemRegion SWRAM_ARM7;
 
 u8* ARM7WRAM;
 
+u8 DirtyPages[DirtyPages_Count];
+u8 CodePages[CodePages_Count];
+
+u8* ARM9ReadTLB[TLBSize];
+u8* ARM9WriteTLB[TLBSize];
+u8* ARM7ReadTLB[TLBSize];
+u8* ARM7WriteTLB[TLBSize];
+u16 ARM9WriteTLBPage[TLBSize];
+u16 ARM7WriteTLBPage[TLBSize];
+
+struct IncrementalSavestate
+{
+    Savestate* File;
+    bool Valid;         // the buffer holds a state we saved or loaded
+    u32 MemoryOffset;   // where the memory starts in the buffer, to make sure the layout is still the same
+    u32 MainRAMSize;
+    u8 Stale[DirtyPages_Count]; // pages which may differ between the emulated memory and the buffer
+};
+std::vector<IncrementalSavestate> IncrementalStates;
+
 u16 ExMemCnt[2];
 
 // TODO: these belong in NDSCart!
@@ -175,6 +212,7 @@ bool Running;
 
 bool RunningGame;
 
+void RebuildSchedHeap();
 void DivDone(u32 param);
 void SqrtDone(u32 param);
 void RunTimer(u32 tid, s32 cycles);
@@ -216,15 +254,21 @@ bool Init()
     if (!DSi::Init()) return false;
 
     if (!AREngine::Init()) return false;
+    if (!Rewind::Init()) return false;
 
     return true;
 }
 
 void DeInit()
 {
+    // the run-ahead and rewind buffers are freed below
+    IncrementalStates.clear();
+
 #ifdef JIT_ENABLED
+    ARMJIT_Memory::SetWriteTracking(false);
     ARMJIT::DeInit();
 #endif
+    ARMDecodeCache::Reset();
 
     delete ARM9;
     delete ARM7;
@@ -240,9 +284,13 @@ void DeInit()
     RTC::DeInit();
     Wifi::DeInit();
 
+    delete RunAheadState;
+    RunAheadState = nullptr;
+
     DSi::DeInit();
 
     AREngine::DeInit();
+    Rewind::DeInit();
 }
 
 
@@ -510,6 +558,10 @@ void Reset()
 
 #ifdef JIT_ENABLED
     EnableJIT = Platform::GetConfigBool(Platform::JIT_Enable);
+    // JIT code doesn't go through the memory handlers, the decoded code would go stale
+    EnableDecodeCache = !EnableJIT && Platform::GetConfigBool(Platform::DecodeCache_Enable);
+#else
+    EnableDecodeCache = Platform::GetConfigBool(Platform::DecodeCache_Enable);
 #endif
 
     RunningGame = false;
@@ -593,6 +645,8 @@ void Reset()
     memset(MainRAM, 0, MainRAMMask + 1);
     memset(SharedWRAM, 0, 0x8000);
     memset(ARM7WRAM, 0, 0x10000);
+    memset(DirtyPages, 1, sizeof(DirtyPages));
+    ARMDecodeCache::Reset();
 
     MapSharedWRAM(0);
 
@@ -647,6 +701,8 @@ void Reset()
 
     memset(SchedList, 0, sizeof(SchedList));
     SchedListMask = 0;
+    SchedHeapSize = 0;
+    memset(SchedHeapPos, 0xFF, sizeof(SchedHeapPos));
 
     KeyInput = 0x007F03FF;
     KeyCnt = 0;
@@ -683,6 +739,9 @@ void Reset()
     SPU::SetDegrade10Bit(degradeAudio);
 
     AREngine::Reset();
+    Rewind::Reset();
+
+    UpdateTLB(0, TLBSize << 12);
 }
 
 void Start()
@@ -801,7 +860,97 @@ bool DoSavestate_Scheduler(Savestate* file)
     return true;
 }
 
-bool DoSavestate(Savestate* file)
+IncrementalSavestate* FindIncrementalSavestate(Savestate* file)
+{
+    for (IncrementalSavestate& inc : IncrementalStates)
+    {
+        if (inc.File == file)
+            return &inc;
+    }
+    return nullptr;
+}
+
+void RegisterIncrementalSavestate(Savestate* file)
+{
+    if (FindIncrementalSavestate(file))
+        return;
+
+    IncrementalStates.emplace_back();
+    IncrementalSavestate& inc = IncrementalStates.back();
+    inc.File = file;
+    inc.Valid = false;
+    inc.MemoryOffset = 0;
+    inc.MainRAMSize = 0;
+    memset(inc.Stale, 1, sizeof(inc.Stale));
+
+#ifdef JIT_ENABLED
+    ARMJIT_Memory::SetWriteTracking(true);
+#endif
+}
+
+void UnregisterIncrementalSavestate(Savestate* file)
+{
+    for (auto it = IncrementalStates.begin(); it != IncrementalStates.end(); it++)
+    {
+        if (it->File == file)
+        {
+            IncrementalStates.erase(it);
+
+#ifdef JIT_ENABLED
+            if (IncrementalStates.empty())
+                ARMJIT_Memory::SetWriteTracking(false);
+#endif
+            return;
+        }
+    }
+}
+
+// moves the pages written to since the last savestate over to the stale lists
+void UpdateIncrementalSavestates()
+{
+    if (IncrementalStates.empty())
+        return;
+
+    for (IncrementalSavestate& inc : IncrementalStates)
+    {
+        for (u32 i = 0; i < DirtyPages_Count; i++)
+            inc.Stale[i] |= DirtyPages[i];
+    }
+
+    memset(DirtyPages, 0, sizeof(DirtyPages));
+
+#ifdef JIT_ENABLED
+    ARMJIT_Memory::RestartWriteTracking();
+#endif
+}
+
+void InvalidateCodePage(u32 page)
+{
+    ARMDecodeCache::InvalidatePage(page);
+}
+
+// page: CodePages index of the start of the memory
+// stale: only pages which have their flag set are saved/loaded, nullptr to do all of them
+void DoSavestate_Memory(Savestate* file, u8* mem, u32 len, u32 page, const u8* stale)
+{
+    for (u32 i = 0; i < len; i += 0x1000)
+    {
+        u32 chunk = std::min(len - i, 0x1000u);
+        if (stale && !stale[i >> 12])
+        {
+            file->Skip(chunk);
+            continue;
+        }
+
+        file->VarArray(&mem[i], chunk);
+        if (!file->Saving && CodePages[page + (i >> 12)])
+            InvalidateCodePage(page + (i >> 12));
+    }
+}
+
+// jitcheckpoint: when loading back a state saved right after ARMJIT::CreateCheckpoint(),
+// JIT blocks compiled before can be kept. 0 if the state could be from anywhere
+bool DoSavestate(Savestate* file, u32 jitcheckpoint)
 {
     file->Section("NDSG");
 
@@ -821,13 +970,67 @@ bool DoSavestate(Savestate* file)
         }
     }
 
-    file->VarArray(MainRAM, MainRAMMaxSize);
-    file->VarArray(SharedWRAM, SharedWRAMSize);
-    file->VarArray(ARM7WRAM, ARM7WRAMSize);
+    // the DS only has 4MB of main RAM, no need to save more
+    // (the DSi can switch between 4MB and 16MB, keep all of it there)
+    // older states always contain the DSi-sized main RAM
+    u32 mainramsize = (ConsoleType == 1) ? MainRAMMaxSize : 0x400000;
+    if (file->IsAtLeastVersion(10, 1))
+        file->Var32(&mainramsize);
+    else
+        mainramsize = MainRAMMaxSize;
+    if (mainramsize > MainRAMMaxSize)
+    {
+        Log(LogLevel::Error, "savestate: bad main RAM size %08X\n", mainramsize);
+        return false;
+    }
+
+    // incremental savestates: only the pages that changed are copied
+    UpdateIncrementalSavestates();
+    IncrementalSavestate* inc = FindIncrementalSavestate(file);
+    u32 memoffset = file->Length();
+    bool incremental = inc && inc->Valid && inc->MemoryOffset == memoffset && inc->MainRAMSize == mainramsize;
+
+    DoSavestate_Memory(file, MainRAM, mainramsize, DirtyPages_MainRAM,
+                       incremental ? &inc->Stale[DirtyPages_MainRAM] : nullptr);
+    DoSavestate_Memory(file, SharedWRAM, SharedWRAMSize, DirtyPages_SharedWRAM,
+                       incremental ? &inc->Stale[DirtyPages_SharedWRAM] : nullptr);
+    DoSavestate_Memory(file, ARM7WRAM, ARM7WRAMSize, DirtyPages_ARM7WRAM,
+                       incremental ? &inc->Stale[DirtyPages_ARM7WRAM] : nullptr);
+
+    if (!file->Saving)
+    {
+        // the memory now matches the state that was loaded
+        // so other buffers differ from it wherever that state did
+        for (IncrementalSavestate& other : IncrementalStates)
+        {
+            if (&other == inc) continue;
+
+            if (incremental && !file->Error)
+            {
+                for (u32 i = 0; i < DirtyPages_Count; i++)
+                    other.Stale[i] |= inc->Stale[i];
+            }
+            else
+                memset(other.Stale, 1, sizeof(other.Stale));
+        }
+    }
+
+    if (inc)
+    {
+        inc->Valid = !file->Error;
+        inc->MemoryOffset = memoffset;
+        inc->MainRAMSize = mainramsize;
+        memset(inc->Stale, file->Error ? 1 : 0, sizeof(inc->Stale));
+    }
 
     //file->VarArray(ARM9BIOS, 0x1000);
     //file->VarArray(ARM7BIOS, 0x4000);
 
+    // the memory timing tables only need to be rebuilt if the registers they depend on changed
+    u16 oldexmemcnt[2] = {ExMemCnt[0], ExMemCnt[1]};
+    u16 oldwifiwaitcnt = WifiWaitCnt;
+    u16 oldpowercnt7 = PowerControl7;
+
     file->VarArray(ExMemCnt, 2*sizeof(u16));
     file->VarArray(ROMSeed0, 2*8);
     file->VarArray(ROMSeed1, 2*8);
@@ -879,6 +1082,8 @@ bool DoSavestate(Savestate* file)
         return false;
     }
     file->Var32(&SchedListMask);
+    if (!file->Saving)
+        RebuildSchedHeap();
     file->Var64(&ARM9Timestamp);
     file->Var64(&ARM9Target);
     file->Var64(&ARM7Timestamp);
@@ -904,10 +1109,14 @@ bool DoSavestate(Savestate* file)
         // but we do need to update the mappings
         MapSharedWRAM(WRAMCnt);
 
-        InitTimings();
-        SetGBASlotTimings();
+        if (ExMemCnt[0] != oldexmemcnt[0] || ExMemCnt[1] != oldexmemcnt[1] ||
+            WifiWaitCnt != oldwifiwaitcnt || PowerControl7 != oldpowercnt7)
+        {
+            InitTimings();
+            SetGBASlotTimings();
 
-        UpdateWifiTimings();
+            UpdateWifiTimings();
+        }
     }
 
     for (int i = 0; i < 8; i++)
@@ -934,13 +1143,14 @@ bool DoSavestate(Savestate* file)
 
         SPU::SetPowerCnt(PowerControl7 & 0x0001);
         Wifi::SetPowerCnt(PowerControl7 & 0x0002);
+
+        UpdateTLB(0, TLBSize << 12);
     }
 
 #ifdef JIT_ENABLED
     if (!file->Saving)
     {
-        ARMJIT::ResetBlockCache();
-        ARMJIT_Memory::Reset();
+        ARMJIT::RestoreCheckpoint(jitcheckpoint);
     }
 #endif
 
@@ -949,6 +1159,11 @@ bool DoSavestate(Savestate* file)
     return true;
 }
 
+bool DoSavestate(Savestate* file)
+{
+    return DoSavestate(file, 0);
+}
+
 void SetConsoleType(int type)
 {
     ConsoleType = type;
@@ -1008,22 +1223,90 @@ void LoadBIOS()
 }
 
 
-u64 NextTarget()
+bool SchedHeapLess(u32 a, u32 b)
 {
-    u64 minEvent = UINT64_MAX;
+    // ties are broken by event ID, to keep the same ordering as the event list
+    if (SchedList[a].Timestamp != SchedList[b].Timestamp)
+        return SchedList[a].Timestamp < SchedList[b].Timestamp;
+    return a < b;
+}
+
+void SchedHeapSet(u32 pos, u32 id)
+{
+    SchedHeap[pos] = id;
+    SchedHeapPos[id] = pos;
+}
 
-    u32 mask = SchedListMask;
-    for (int i = 0; i < Event_MAX; i++)
+void SchedHeapSiftUp(u32 pos)
+{
+    u32 id = SchedHeap[pos];
+    while (pos > 0)
     {
-        if (!mask) break;
-        if (mask & 0x1)
-        {
-            if (SchedList[i].Timestamp < minEvent)
-                minEvent = SchedList[i].Timestamp;
-        }
+        u32 parent = (pos - 1) >> 1;
+        if (!SchedHeapLess(id, SchedHeap[parent])) break;
 
-        mask >>= 1;
+        SchedHeapSet(pos, SchedHeap[parent]);
+        pos = parent;
     }
+    SchedHeapSet(pos, id);
+}
+
+void SchedHeapSiftDown(u32 pos)
+{
+    u32 id = SchedHeap[pos];
+    for (;;)
+    {
+        u32 child = (pos << 1) + 1;
+        if (child >= SchedHeapSize) break;
+        if ((child + 1) < SchedHeapSize && SchedHeapLess(SchedHeap[child + 1], SchedHeap[child]))
+            child++;
+        if (!SchedHeapLess(SchedHeap[child], id)) break;
+
+        SchedHeapSet(pos, SchedHeap[child]);
+        pos = child;
+    }
+    SchedHeapSet(pos, id);
+}
+
+void SchedHeapInsert(u32 id)
+{
+    u32 pos = SchedHeapSize++;
+    SchedHeapSet(pos, id);
+    SchedHeapSiftUp(pos);
+}
+
+void SchedHeapRemove(u32 id)
+{
+    u32 pos = SchedHeapPos[id];
+    if (pos == 0xFF) return;
+
+    SchedHeapPos[id] = 0xFF;
+    SchedHeapSize--;
+    if (pos == SchedHeapSize) return;
+
+    // move the last event into the hole and restore the heap order around it
+    SchedHeapSet(pos, SchedHeap[SchedHeapSize]);
+    if (pos > 0 && SchedHeapLess(SchedHeap[pos], SchedHeap[(pos - 1) >> 1]))
+        SchedHeapSiftUp(pos);
+    else
+        SchedHeapSiftDown(pos);
+}
+
+void RebuildSchedHeap()
+{
+    SchedHeapSize = 0;
+    memset(SchedHeapPos, 0xFF, sizeof(SchedHeapPos));
+
+    for (u32 i = 0; i < Event_MAX; i++)
+    {
+        if (SchedListMask & (1<<i))
+            SchedHeapInsert(i);
+    }
+}
+
+u64 NextTarget()
+{
+    u64 minEvent = SchedHeapSize ? SchedList[SchedHeap[0]].Timestamp : UINT64_MAX;
 
     u64 max = SysTimestamp + kMaxIterationCycles;
 
@@ -1035,22 +1318,35 @@ u64 NextTarget()
 
 void RunSystem(u64 timestamp)
 {
+    PROFILE_SCOPE(Profiler::Counter_Scheduler);
+
     SysTimestamp = timestamp;
 
-    u32 mask = SchedListMask;
-    for (int i = 0; i < Event_MAX; i++)
+    // take out every event that is due at this point
+    // events scheduled by the callbacks below will be run on the next pass
+    u32 due = 0;
+    while (SchedHeapSize && SchedList[SchedHeap[0]].Timestamp <= SysTimestamp)
     {
-        if (!mask) break;
-        if (mask & 0x1)
-        {
-            if (SchedList[i].Timestamp <= SysTimestamp)
-            {
-                SchedListMask &= ~(1<<i);
-                SchedList[i].Func(SchedList[i].Param);
-            }
-        }
+        u32 id = SchedHeap[0];
+        due |= (1<<id);
+        SchedHeapRemove(id);
+    }
 
-        mask >>= 1;
+    // run them in event ID order, like the old linear scan did
+    while (due)
+    {
+        u32 i = __builtin_ctz(due);
+        due &= ~(1<<i);
+
+        // the event may have been cancelled or rescheduled by a previous callback
+        if (!(SchedListMask & (1<<i))) continue;
+        if (SchedList[i].Timestamp > SysTimestamp) continue;
+
+        SchedListMask &= ~(1<<i);
+        SchedHeapRemove(i);
+
+        PROFILE_SCOPE(Profiler::Counter_Event + i);
+        SchedList[i].Func(SchedList[i].Param);
     }
 }
 
@@ -1145,7 +1441,11 @@ u32 RunFrame()
             ARM7Timestamp-SysTimestamp,
             GPU3D::Timestamp-SysTimestamp);
 #endif
-        SPU::TransferOutput();
+        // speculative run-ahead frames are emulated again later, they mustn't be heard twice
+        if (RunningAhead)
+            SPU::DiscardOutput();
+        else
+            SPU::TransferOutput();
     }
 
     // In the context of TASes, frame count is traditionally the primary measure of emulated time,
@@ -1160,7 +1460,7 @@ u32 RunFrame()
         return 263;
 }
 
-u32 RunFrame()
+u32 RunFrameInternal()
 {
 #ifdef JIT_ENABLED
     if (EnableJIT)
@@ -1174,6 +1474,105 @@ u32 RunFrame()
             : RunFrame<false, 0>();
 }
 
+u32 RunFrame()
+{
+    if (RunAheadFrames == 0 || !Running)
+        return RunFrameInternal();
+
+    // run-ahead: emulate the real frame, snapshot it, then run the following
+    // frames with the same input and only present the last one
+    // the snapshot is loaded back afterwards, so the speculative frames leave no trace
+    // (besides side effects on the host like save memory writeback or wifi)
+
+    // only draw the last frame, see GPU::StartFrame()
+    // with RenderSkipCount at 1 the pattern lines up again on the next call
+    u32 renderskip = GPU::RenderSkip;
+    GPU::RenderSkip = RunAheadFrames;
+    GPU::RenderSkipCount = 1;
+
+    u32 ret = RunFrameInternal();
+
+    if (!RunAheadState)
+    {
+        RunAheadState = new Savestate();
+        RegisterIncrementalSavestate(RunAheadState);
+    }
+    else
+        RunAheadState->Rewind(true);
+
+    bool saved = DoSavestate(RunAheadState) && !RunAheadState->Error;
+#ifdef JIT_ENABLED
+    u32 checkpoint = ARMJIT::CreateCheckpoint();
+#else
+    u32 checkpoint = 0;
+#endif
+
+    if (saved)
+    {
+        u32 audiopos = SPU::GetOutputWritePosition();
+
+        RunningAhead = true;
+        for (u32 i = 0; i < RunAheadFrames; i++)
+            RunFrameInternal();
+        RunningAhead = false;
+
+        // only the real frame's samples may have been output
+        assert(SPU::GetOutputWritePosition() == audiopos);
+
+        RunAheadState->Rewind(false);
+        DoSavestate(RunAheadState, checkpoint);
+    }
+    else
+        Log(LogLevel::Error, "run-ahead: failed to save state\n");
+
+    GPU::RenderSkip = renderskip;
+    return ret;
+}
+
+void SetRunAhead(u32 frames)
+{
+    RunAheadFrames = frames;
+    if (frames == 0 && RunAheadState)
+    {
+        UnregisterIncrementalSavestate(RunAheadState);
+        delete RunAheadState;
+        RunAheadState = nullptr;
+    }
+}
+
+void SetRenderSkip(u32 frames, u32 pos)
+{
+    // frame pos of the current round of (frames+1) is about to run
+    u32 count = frames ? (pos + 1) % (frames + 1) : 0;
+    if (frames == GPU::RenderSkip && (frames == 0 || count == GPU::RenderSkipCount))
+        return;
+
+    GPU::RenderSkip = frames;
+    GPU::RenderSkipCount = count;
+
+    // whether the next frame is drawn was decided with the old pattern, see GPU::StartFrame()
+    // if it's drawn after all, its 3D scene is rendered when it's needed
+    GPU::SkipNextFrame = count != 0 && !GPU3D::CurrentRenderer->Accelerated;
+}
+
+bool GetProfileStats(Profiler::CounterStats* stats)
+{
+#ifdef PROFILING_ENABLED
+    memcpy(stats, Profiler::Counters, sizeof(Profiler::Counters));
+    return true;
+#else
+    memset(stats, 0, sizeof(Profiler::CounterStats) * Profiler::Counter_MAX);
+    return false;
+#endif
+}
+
+void ResetProfileStats()
+{
+#ifdef PROFILING_ENABLED
+    Profiler::Reset();
+#endif
+}
+
 void Reschedule(u64 target)
 {
     if (CurCPU == 0)
@@ -1212,6 +1611,7 @@ void ScheduleEvent(u32 id, bool periodic, s32 delay, void (*func)(u32), u32 para
     evt->Param = param;
 
     SchedListMask |= (1<<id);
+    SchedHeapInsert(id);
 
     Reschedule(evt->Timestamp);
 }
@@ -1231,6 +1631,7 @@ void ScheduleEvent(u32 id, u64 timestamp, void (*func)(u32), u32 param)
     evt->Param = param;
 
     SchedListMask |= (1<<id);
+    SchedHeapInsert(id);
 
     Reschedule(evt->Timestamp);
 }
@@ -1238,6 +1639,7 @@ void ScheduleEvent(u32 id, u64 timestamp, void (*func)(u32), u32 param)
 void CancelEvent(u32 id)
 {
     SchedListMask &= ~(1<<id);
+    SchedHeapRemove(id);
 }
 
 
@@ -1339,6 +1741,8 @@ void MapSharedWRAM(u8 val)
 #ifdef JIT_ENABLED
     ARMJIT_Memory::RemapSWRAM();
 #endif
+    // the ARM7 might be running code from shared WRAM
+    ARMDecodeCache::Generation++;
 
     WRAMCnt = val;
 
@@ -1372,6 +1776,91 @@ void MapSharedWRAM(u8 val)
         SWRAM_ARM7.Mask = 0x7FFF;
         break;
     }
+
+    UpdateTLB(0x03000000, 0x04000000);
+}
+
+// host memory behind a page, for the TLB
+// nullptr if accesses to it need to go through the memory handlers
+u8* GetTLBPage(u32 num, u32 addr, bool write)
+{
+    switch (addr & 0xFF000000)
+    {
+    case 0x02000000:
+        // the DSi ARM9 handlers have a hack for one address in there
+        if (ConsoleType == 1 && num == 0 && (addr >> 12) == (0x02FE71B0 >> 12))
+            return nullptr;
+        return &MainRAM[addr & MainRAMMask];
+
+    case 0x03000000:
+        // new WRAM can be mapped over it on the DSi
+        if (ConsoleType == 1)
+            return nullptr;
+
+        if (num == 0)
+            return SWRAM_ARM9.Mem ? &SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask] : nullptr;
+        if (addr < 0x03800000 && SWRAM_ARM7.Mem)
+            return &SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask];
+        return &ARM7WRAM[addr & (ARM7WRAMSize - 1)];
+
+    case 0x06000000:
+        if (write)
+            return nullptr;
+
+        if (num == 0)
+        {
+            u8* ptr;
+            switch (addr & 0x00E00000)
+            {
+            case 0x00000000: ptr = GPU::VRAMPtr_ABG[(addr >> 14) & 0x1F]; break;
+            case 0x00200000: ptr = GPU::VRAMPtr_BBG[(addr >> 14) & 0x7]; break;
+            case 0x00400000: ptr = GPU::VRAMPtr_AOBJ[(addr >> 14) & 0xF]; break;
+            case 0x00600000: ptr = GPU::VRAMPtr_BOBJ[(addr >> 14) & 0x7]; break;
+            default: return nullptr;
+            }
+            return ptr ? &ptr[addr & 0x3FFF] : nullptr;
+        }
+        else
+        {
+            u32 mask = GPU::VRAMMap_ARM7[(addr >> 17) & 0x1];
+            if (mask == (1<<2)) return &GPU::VRAM_C[addr & 0x1FFFF];
+            if (mask == (1<<3)) return &GPU::VRAM_D[addr & 0x1FFFF];
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+u16 GetTLBDirtyPage(const u8* ptr)
+{
+    if (ptr >= MainRAM && ptr < MainRAM + MainRAMMaxSize)
+        return DirtyPages_MainRAM + ((ptr - MainRAM) >> 12);
+    if (ptr >= SharedWRAM && ptr < SharedWRAM + SharedWRAMSize)
+        return DirtyPages_SharedWRAM + ((ptr - SharedWRAM) >> 12);
+    return DirtyPages_ARM7WRAM + ((ptr - ARM7WRAM) >> 12);
+}
+
+void UpdateTLB(u32 start, u32 end)
+{
+    // the JIT notices writes to its code in the memory handlers
+    bool writes = true;
+#ifdef JIT_ENABLED
+    writes = !EnableJIT;
+#endif
+
+    for (u32 addr = start; addr < end; addr += 0x1000)
+    {
+        u32 page = addr >> 12;
+
+        ARM9ReadTLB[page] = GetTLBPage(0, addr, false);
+        ARM7ReadTLB[page] = GetTLBPage(1, addr, false);
+
+        ARM9WriteTLB[page] = writes ? GetTLBPage(0, addr, true) : nullptr;
+        ARM7WriteTLB[page] = writes ? GetTLBPage(1, addr, true) : nullptr;
+        if (ARM9WriteTLB[page]) ARM9WriteTLBPage[page] = GetTLBDirtyPage(ARM9WriteTLB[page]);
+        if (ARM7WriteTLB[page]) ARM7WriteTLBPage[page] = GetTLBDirtyPage(ARM7WriteTLB[page]);
+    }
 }
 
 
@@ -2235,6 +2724,7 @@ void ARM9Write8(u32 addr, u8 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        MarkMainRAMDirty(addr);
         *(u8*)&MainRAM[addr & MainRAMMask] = val;
         return;
 
@@ -2244,6 +2734,7 @@ void ARM9Write8(u32 addr, u8 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_SharedWRAM>(addr);
 #endif
+            MarkSharedWRAMDirty(&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask]);
             *(u8*)&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask] = val;
         }
         return;
@@ -2280,6 +2771,7 @@ void ARM9Write16(u32 addr, u16 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        MarkMainRAMDirty(addr);
         *(u16*)&MainRAM[addr & MainRAMMask] = val;
         return;
 
@@ -2289,6 +2781,7 @@ void ARM9Write16(u32 addr, u16 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_SharedWRAM>(addr);
 #endif
+            MarkSharedWRAMDirty(&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask]);
             *(u16*)&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask] = val;
         }
         return;
@@ -2346,6 +2839,7 @@ void ARM9Write32(u32 addr, u32 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        MarkMainRAMDirty(addr);
         *(u32*)&MainRAM[addr & MainRAMMask] = val;
         return ;
 
@@ -2355,6 +2849,7 @@ void ARM9Write32(u32 addr, u32 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_SharedWRAM>(addr);
 #endif
+            MarkSharedWRAMDirty(&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask]);
             *(u32*)&SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask] = val;
         }
         return;
@@ -2647,6 +3142,7 @@ void ARM7Write8(u32 addr, u8 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        MarkMainRAMDirty(addr);
         *(u8*)&MainRAM[addr & MainRAMMask] = val;
         return;
 
@@ -2656,6 +3152,7 @@ void ARM7Write8(u32 addr, u8 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_SharedWRAM>(addr);
 #endif
+            MarkSharedWRAMDirty(&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask]);
             *(u8*)&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask] = val;
             return;
         }
@@ -2664,6 +3161,7 @@ void ARM7Write8(u32 addr, u8 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
 #endif
+            MarkARM7WRAMDirty(addr);
             *(u8*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
             return;
         }
@@ -2672,6 +3170,7 @@ void ARM7Write8(u32 addr, u8 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
 #endif
+        MarkARM7WRAMDirty(addr);
         *(u8*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
         return;
 
@@ -2716,6 +3215,7 @@ void ARM7Write16(u32 addr, u16 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        MarkMainRAMDirty(addr);
         *(u16*)&MainRAM[addr & MainRAMMask] = val;
         return;
 
@@ -2725,6 +3225,7 @@ void ARM7Write16(u32 addr, u16 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_SharedWRAM>(addr);
 #endif
+            MarkSharedWRAMDirty(&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask]);
             *(u16*)&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask] = val;
             return;
         }
@@ -2733,6 +3234,7 @@ void ARM7Write16(u32 addr, u16 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
 #endif
+            MarkARM7WRAMDirty(addr);
             *(u16*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
             return;
         }
@@ -2741,6 +3243,7 @@ void ARM7Write16(u32 addr, u16 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
 #endif
+        MarkARM7WRAMDirty(addr);
         *(u16*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
         return;
 
@@ -2796,6 +3299,7 @@ void ARM7Write32(u32 addr, u32 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
+        MarkMainRAMDirty(addr);
         *(u32*)&MainRAM[addr & MainRAMMask] = val;
         return;
 
@@ -2805,6 +3309,7 @@ void ARM7Write32(u32 addr, u32 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_SharedWRAM>(addr);
 #endif
+            MarkSharedWRAMDirty(&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask]);
             *(u32*)&SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask] = val;
             return;
         }
@@ -2813,6 +3318,7 @@ void ARM7Write32(u32 addr, u32 val)
 #ifdef JIT_ENABLED
             ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
 #endif
+            MarkARM7WRAMDirty(addr);
             *(u32*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
             return;
         }
@@ -2821,6 +3327,7 @@ void ARM7Write32(u32 addr, u32 val)
 #ifdef JIT_ENABLED
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_WRAM7>(addr);
 #endif
+        MarkARM7WRAMDirty(addr);
         *(u32*)&ARM7WRAM[addr & (ARM7WRAMSize - 1)] = val;
         return;
 
@@ -3322,6 +3829,49 @@ u32 ARM9IORead32(u32 addr)
     return 0;
 }
 
+void ARM9IPCFIFOWrite(u32 addr, u32 val)
+{
+    if (IPCFIFOCnt9 & 0x8000)
+    {
+        if (IPCFIFO9.IsFull())
+            IPCFIFOCnt9 |= 0x4000;
+        else
+        {
+            bool wasempty = IPCFIFO9.IsEmpty();
+            IPCFIFO9.Write(val);
+            if ((IPCFIFOCnt7 & 0x0400) && wasempty)
+                SetIRQ(1, IRQ_IPCRecv);
+        }
+    }
+}
+
+void ARM7IPCFIFOWrite(u32 addr, u32 val)
+{
+    if (IPCFIFOCnt7 & 0x8000)
+    {
+        if (IPCFIFO7.IsFull())
+            IPCFIFOCnt7 |= 0x4000;
+        else
+        {
+            bool wasempty = IPCFIFO7.IsEmpty();
+            IPCFIFO7.Write(val);
+            if ((IPCFIFOCnt9 & 0x0400) && wasempty)
+                SetIRQ(0, IRQ_IPCRecv);
+        }
+    }
+}
+
+void DMA9FillWrite(u32 addr, u32 val)
+{
+    DMA9Fill[(addr >> 2) & 0x3] = val;
+}
+
+u32 ARM9ROMDataRead(u32 addr)
+{
+    if (!(ExMemCnt[0] & (1<<11))) return NDSCart::ReadROMData();
+    return 0;
+}
+
 void ARM9IOWrite8(u32 addr, u8 val)
 {
     switch (addr)
@@ -3615,10 +4165,12 @@ void ARM9IOWrite32(u32 addr, u32 val)
     case 0x040000D8: DMAs[3]->DstAddr = val; return;
     case 0x040000DC: DMAs[3]->WriteCnt(val); return;
 
-    case 0x040000E0: DMA9Fill[0] = val; return;
-    case 0x040000E4: DMA9Fill[1] = val; return;
-    case 0x040000E8: DMA9Fill[2] = val; return;
-    case 0x040000EC: DMA9Fill[3] = val; return;
+    case 0x040000E0:
+    case 0x040000E4:
+    case 0x040000E8:
+    case 0x040000EC:
+        DMA9FillWrite(addr, val);
+        return;
 
     case 0x04000100:
         Timers[0].Reload = val & 0xFFFF;
@@ -3646,18 +4198,7 @@ void ARM9IOWrite32(u32 addr, u32 val)
         ARM9IOWrite16(addr, val);
         return;
     case 0x04000188:
-        if (IPCFIFOCnt9 & 0x8000)
-        {
-            if (IPCFIFO9.IsFull())
-                IPCFIFOCnt9 |= 0x4000;
-            else
-            {
-                bool wasempty = IPCFIFO9.IsEmpty();
-                IPCFIFO9.Write(val);
-                if ((IPCFIFOCnt7 & 0x0400) && wasempty)
-                    SetIRQ(1, IRQ_IPCRecv);
-            }
-        }
+        ARM9IPCFIFOWrite(addr, val);
         return;
 
     case 0x040001A0:
@@ -4334,18 +4875,7 @@ void ARM7IOWrite32(u32 addr, u32 val)
         ARM7IOWrite16(addr, val);
         return;
     case 0x04000188:
-        if (IPCFIFOCnt7 & 0x8000)
-        {
-            if (IPCFIFO7.IsFull())
-                IPCFIFOCnt7 |= 0x4000;
-            else
-            {
-                bool wasempty = IPCFIFO7.IsEmpty();
-                IPCFIFO7.Write(val);
-                if ((IPCFIFOCnt9 & 0x0400) && wasempty)
-                    SetIRQ(0, IRQ_IPCRecv);
-            }
-        }
+        ARM7IPCFIFOWrite(addr, val);
         return;
 
     case 0x040001A0:
@@ -28,6 +28,8 @@
 // with this enabled, to make sure it doesn't desync
 //#define DEBUG_CHECK_DESYNC
 
+namespace Profiler { struct CounterStats; }
+
 namespace NDS
 {
 
@@ -171,6 +173,7 @@ enum
 #ifdef JIT_ENABLED
 extern bool EnableJIT;
 #endif
+extern bool EnableDecodeCache;
 extern int ConsoleType;
 extern int CurCPU;
 
@@ -222,6 +225,75 @@ extern u32 KeyInput;
 const u32 ARM7WRAMSize = 0x10000;
 extern u8* ARM7WRAM;
 
+// one flag per 4KB page of main RAM/shared WRAM/ARM7 WRAM, set when the page is written to
+// used to only save what changed to incremental savestates, see RegisterIncrementalSavestate()
+const u32 DirtyPages_MainRAM = 0;
+const u32 DirtyPages_SharedWRAM = DirtyPages_MainRAM + (MainRAMMaxSize >> 12);
+const u32 DirtyPages_ARM7WRAM = DirtyPages_SharedWRAM + (SharedWRAMSize >> 12);
+const u32 DirtyPages_Count = DirtyPages_ARM7WRAM + (ARM7WRAMSize >> 12);
+extern u8 DirtyPages[DirtyPages_Count];
+
+// one flag per 4KB page, set when the interpreter decode cache has blocks from it
+// same layout as DirtyPages, followed by the 32KB of ITCM
+const u32 CodePages_ITCM = DirtyPages_Count;
+const u32 CodePages_Count = CodePages_ITCM + (0x8000 >> 12);
+extern u8 CodePages[CodePages_Count];
+
+void InvalidateCodePage(u32 page);
+
+// called by the memory handlers on every write
+inline void MarkPageDirty(u32 page)
+{
+    DirtyPages[page] = 1;
+    if (CodePages[page]) InvalidateCodePage(page);
+}
+
+inline void MarkMainRAMDirty(u32 addr)
+{
+    MarkPageDirty(DirtyPages_MainRAM + ((addr & MainRAMMask) >> 12));
+}
+
+inline void MarkSharedWRAMDirty(const u8* ptr)
+{
+    MarkPageDirty(DirtyPages_SharedWRAM + ((ptr - SharedWRAM) >> 12));
+}
+
+inline void MarkARM7WRAMDirty(u32 addr)
+{
+    MarkPageDirty(DirtyPages_ARM7WRAM + ((addr & (ARM7WRAMSize - 1)) >> 12));
+}
+
+// ITCM isn't saved incrementally, writes to it only matter for the decode cache
+inline void InvalidateITCMCode(u32 addr)
+{
+    u32 page = CodePages_ITCM + ((addr & 0x7FFF) >> 12);
+    if (CodePages[page]) InvalidateCodePage(page);
+}
+
+// software TLB for the interpreter's bus accesses, over the first 128MB of the address space
+// each 4KB page of plain memory (main RAM, WRAM, VRAM banks mapped alone) points to its
+// host memory, other pages are nullptr and go through the memory handlers.
+// VRAM is only mapped for reading, as writes to it need to be flagged for the renderer.
+// has to be updated with UpdateTLB() whenever the memory map changes
+const u32 TLBSize = 0x08000000 >> 12;
+extern u8* ARM9ReadTLB[TLBSize];
+extern u8* ARM9WriteTLB[TLBSize];
+extern u8* ARM7ReadTLB[TLBSize];
+extern u8* ARM7WriteTLB[TLBSize];
+// DirtyPages index of each page in the write TLBs, to be passed to MarkPageDirty()
+extern u16 ARM9WriteTLBPage[TLBSize];
+extern u16 ARM7WriteTLBPage[TLBSize];
+
+void UpdateTLB(u32 start, u32 end);
+
+// returns the host memory for addr, or nullptr if the access has to go through the memory handlers
+inline u8* LookUpTLB(u8* const* tlb, u32 addr)
+{
+    u32 page = addr >> 12;
+    if (page >= TLBSize || !tlb[page]) return nullptr;
+    return &tlb[page][addr & 0xFFF];
+}
+
 bool Init();
 void DeInit();
 void Reset();
@@ -230,6 +302,15 @@ void Stop();
 
 bool DoSavestate(Savestate* file);
 
+// incremental savestates: a savestate buffer which is saved to over and over
+// (rewind, run-ahead, autosaves) can be registered, from then on only the pages
+// of main RAM and WRAM which differ between the buffer and the emulated memory
+// are copied, when saving to or loading from it. the rest of the state is always
+// saved completely. the buffer must stay registered for as long as it's used this
+// way, and must not be modified outside of DoSavestate() in the meantime
+void RegisterIncrementalSavestate(Savestate* file);
+void UnregisterIncrementalSavestate(Savestate* file);
+
 void SetARM9RegionTimings(u32 addrstart, u32 addrend, u32 region, int buswidth, int nonseq, int seq);
 void SetARM7RegionTimings(u32 addrstart, u32 addrend, u32 region, int buswidth, int nonseq, int seq);
 
@@ -252,6 +333,28 @@ void EjectGBACart();
 
 u32 RunFrame();
 
+// draw only one frame out of every (frames+1), for fast-forwarding
+// emulation itself is unaffected, including display capture
+// the framebuffers keep the last drawn frame, see GPU::SkipFrame
+// pos is how many frames of the current round already ran, the last one
+// (pos == frames) is drawn. the pattern only changes when it doesn't line up
+// with pos anymore, so this can be called before every frame.
+void SetRenderSkip(u32 frames, u32 pos);
+
+// run-ahead: every RunFrame() call emulates the frame, then runs the given
+// amount of frames ahead with the current input and presents the last one,
+// before going back to the state after the first frame. hides that many
+// frames of input lag from the game itself, at the cost of more emulation work
+// the state is kept in memory and JIT blocks compiled before the snapshot are kept
+// shouldn't be used with local multiplayer, the speculative frames send packets too
+void SetRunAhead(u32 frames);
+
+// host time/call counts per subsystem since the last ResetProfileStats()
+// stats must hold Profiler::Counter_MAX entries, see Profiler.h for the list
+// returns false if the core was built without profiling support
+bool GetProfileStats(Profiler::CounterStats* stats);
+void ResetProfileStats();
+
 void TouchScreen(u16 x, u16 y);
 void ReleaseScreen();
 
@@ -329,6 +432,13 @@ void ARM7IOWrite8(u32 addr, u8 val);
 void ARM7IOWrite16(u32 addr, u16 val);
 void ARM7IOWrite32(u32 addr, u32 val);
 
+// frequently accessed registers, the JIT calls these directly
+// instead of going through the IO read/write switch
+void ARM9IPCFIFOWrite(u32 addr, u32 val);
+void ARM7IPCFIFOWrite(u32 addr, u32 val);
+void DMA9FillWrite(u32 addr, u32 val);
+u32 ARM9ROMDataRead(u32 addr);
+
 }
 
 #endif // NDS_H
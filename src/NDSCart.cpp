@@ -441,9 +441,26 @@ void CartRetail::DoSavestate(Savestate* file)
         SRAM = nullptr;
         if (SRAMLength) SRAM = new u8[SRAMLength];
     }
+    // states are loaded every frame with run-ahead, only write back the save
+    // memory if the loaded contents actually differ
+    bool sramchanged = false;
     if (SRAMLength)
     {
-        file->VarArray(SRAM, SRAMLength);
+        if (file->Saving || SRAMLength != oldlen)
+        {
+            file->VarArray(SRAM, SRAMLength);
+            sramchanged = true;
+        }
+        else
+        {
+            SRAMLoadBuffer.resize(SRAMLength);
+            file->VarArray(SRAMLoadBuffer.data(), SRAMLength);
+            if (memcmp(SRAMLoadBuffer.data(), SRAM, SRAMLength))
+            {
+                memcpy(SRAM, SRAMLoadBuffer.data(), SRAMLength);
+                sramchanged = true;
+            }
+        }
     }
 
     // SPI status shito
@@ -452,7 +469,7 @@ void CartRetail::DoSavestate(Savestate* file)
     file->Var32(&SRAMAddr);
     file->Var8(&SRAMStatus);
 
-    if ((!file->Saving) && SRAM)
+    if ((!file->Saving) && SRAM && sramchanged)
         Platform::WriteNDSSave(SRAM, SRAMLength, 0, SRAMLength);
 }
 
@@ -20,6 +20,7 @@
 #define NDSCART_H
 
 #include <string>
+#include <vector>
 
 #include "types.h"
 #include "Savestate.h"
@@ -105,6 +106,9 @@ protected:
     u32 SRAMLength;
     u32 SRAMType;
 
+    // where loaded states are compared against SRAM, see DoSavestate()
+    std::vector<u8> SRAMLoadBuffer;
+
     u8 SRAMCmd;
     u32 SRAMAddr;
     u32 SRAMFirstAddr;
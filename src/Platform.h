@@ -46,7 +46,10 @@ enum ConfigEntry
     JIT_LiteralOptimizations,
     JIT_BranchOptimizations,
     JIT_FastMemory,
+    JIT_BackgroundCompilation,
 #endif
+    DecodeCache_Enable,
+    DecodeCache_IdleLoops,
 
     ExternalBIOSEnable,
 
@@ -0,0 +1,90 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <chrono>
+#include "Profiler.h"
+
+namespace Profiler
+{
+
+const char* GetCounterName(u32 counter)
+{
+    static const char* names[Counter_Event] =
+    {
+        "arm9",
+        "arm9_jit",
+        "arm7",
+        "arm7_jit",
+        "jit_compile",
+        "gpu2d",
+        "gpu3d",
+        "gpu3d_render",
+        "spu",
+        "dma",
+        "scheduler",
+    };
+
+    static const char* eventnames[NDS::Event_MAX] =
+    {
+        "event_lcd",
+        "event_spu",
+        "event_wifi",
+
+        "event_displayfifo",
+        "event_romtransfer",
+        "event_romspitransfer",
+        "event_spitransfer",
+        "event_div",
+        "event_sqrt",
+
+        "event_dsi_sdmmctransfer",
+        "event_dsi_sdiotransfer",
+        "event_dsi_nwifi",
+        "event_dsi_camirq",
+        "event_dsi_camtransfer",
+        "event_dsi_dsp",
+    };
+
+    if (counter < Counter_Event) return names[counter];
+    if (counter < Counter_MAX) return eventnames[counter - Counter_Event];
+    return "";
+}
+
+#ifdef PROFILING_ENABLED
+
+CounterStats Counters[Counter_MAX];
+
+thread_local u32 ActiveCounter = Counter_MAX;
+thread_local u64 ActiveStart = 0;
+
+void Reset()
+{
+    memset(Counters, 0, sizeof(Counters));
+    ActiveStart = GetTime();
+}
+
+u64 GetTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
+
+}
@@ -0,0 +1,121 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "types.h"
+#include "NDS.h"
+
+// host-side time accounting for the main emulation subsystems
+//
+// only compiled in when PROFILING_ENABLED is defined (ENABLE_PROFILING in CMake),
+// otherwise PROFILE_SCOPE expands to nothing.
+//
+// time is accounted exclusively: when a scope is entered while another one is
+// active (for example SPU::Mix running from its scheduler event), the outer scope
+// is paused until the inner one is left. summing all counters thus never counts
+// the same host time twice. call counts are always exact.
+
+namespace Profiler
+{
+
+enum
+{
+    Counter_ARM9 = 0,   // ARMv5::Execute
+    Counter_ARM9JIT,    // ARMv5::ExecuteJIT
+    Counter_ARM7,       // ARMv4::Execute
+    Counter_ARM7JIT,    // ARMv4::ExecuteJIT
+    Counter_JITCompile, // ARMJIT::CompileBlock
+    Counter_GPU2D,      // 2D scanline and sprite rendering
+    Counter_GPU3D,      // geometry engine and renderer synchronisation
+    Counter_GPU3DRender,// software rasteriser (SoftRenderer::RenderPolygons)
+    Counter_SPU,        // SPU::Mix
+    Counter_DMA,        // DMA::Run
+    Counter_Scheduler,  // event dispatch overhead
+
+    // one counter per scheduler event, indexed by event ID
+    Counter_Event,
+
+    Counter_MAX = Counter_Event + NDS::Event_MAX
+};
+
+struct CounterStats
+{
+    u64 Time;   // host nanoseconds
+    u64 Calls;
+};
+
+const char* GetCounterName(u32 counter);
+
+#ifdef PROFILING_ENABLED
+
+extern CounterStats Counters[Counter_MAX];
+
+extern thread_local u32 ActiveCounter;
+extern thread_local u64 ActiveStart;
+
+void Reset();
+u64 GetTime();
+
+inline u32 Enter(u32 counter)
+{
+    u64 now = GetTime();
+    u32 parent = ActiveCounter;
+    if (parent != Counter_MAX)
+        Counters[parent].Time += now - ActiveStart;
+
+    Counters[counter].Calls++;
+    ActiveCounter = counter;
+    ActiveStart = now;
+    return parent;
+}
+
+inline void Leave(u32 parent)
+{
+    u64 now = GetTime();
+    Counters[ActiveCounter].Time += now - ActiveStart;
+
+    ActiveCounter = parent;
+    ActiveStart = now;
+}
+
+class Scope
+{
+public:
+    explicit Scope(u32 counter) : Parent(Enter(counter)) {}
+    ~Scope() { Leave(Parent); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    u32 Parent;
+};
+
+#define PROFILE_SCOPE(counter) Profiler::Scope _profile_scope(counter)
+
+#else
+
+#define PROFILE_SCOPE(counter)
+
+#endif
+
+}
+
+#endif // PROFILER_H
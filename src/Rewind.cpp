@@ -0,0 +1,486 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "NDS.h"
+#include "Rewind.h"
+#include "Savestate.h"
+#include "Platform.h"
+
+using Platform::Log;
+using Platform::LogLevel;
+
+namespace Rewind
+{
+
+// a new keyframe is stored after this many deltas
+const u32 KeyframeInterval = 30;
+
+/*
+    encoded snapshot format
+
+    sequence of runs:
+    00 - amount of unchanged bytes before the run
+    04 - length of the run
+    08 - run data: XOR with the keyframe, or raw data for keyframes
+
+    bytes past the last run are unchanged
+*/
+
+struct Entry
+{
+    u32 Offset;         // position in the ring
+    u32 Length;         // encoded length
+    u32 StateLength;    // decoded length
+    bool Keyframe;
+};
+
+u32 Interval;
+u32 FrameCount;
+
+u8* Ring;
+u32 RingSize;
+u32 RingWritePos;
+std::deque<Entry> Entries;
+
+// decoded copy of the last keyframe, deltas are made against it
+std::vector<u8> KeyState;
+u32 DeltasSinceKey;
+bool NeedKeyframe;
+
+std::vector<u8> EncodeBuffer;
+std::vector<u8> DecodeBuffer;
+
+// the emulator thread saves to CaptureState, which is then
+// swapped with PendingState and handed over to the worker thread
+Savestate* CaptureState;
+Savestate* PendingState;
+
+Platform::Thread* WorkerThread;
+Platform::Semaphore* Sema_WorkStart;
+Platform::Semaphore* Sema_WorkDone;
+std::atomic_bool WorkerRunning;
+std::atomic_bool WorkerBusy;
+bool WorkPending;
+
+void WorkerFunc();
+
+
+bool Init()
+{
+    Interval = 0;
+    FrameCount = 0;
+
+    Ring = nullptr;
+    RingSize = 0;
+    RingWritePos = 0;
+
+    DeltasSinceKey = 0;
+    NeedKeyframe = true;
+
+    CaptureState = nullptr;
+    PendingState = nullptr;
+
+    WorkerThread = nullptr;
+    Sema_WorkStart = Platform::Semaphore_Create();
+    Sema_WorkDone = Platform::Semaphore_Create();
+    WorkerRunning = false;
+    WorkerBusy = false;
+    WorkPending = false;
+
+    return true;
+}
+
+void WaitIdle()
+{
+    if (!WorkPending) return;
+
+    Platform::Semaphore_Wait(Sema_WorkDone);
+    WorkPending = false;
+}
+
+void StartWorker()
+{
+    if (WorkerRunning) return;
+
+    WorkerRunning = true;
+    WorkerThread = Platform::Thread_Create(WorkerFunc);
+}
+
+void StopWorker()
+{
+    if (!WorkerRunning) return;
+
+    WaitIdle();
+
+    WorkerRunning = false;
+    Platform::Semaphore_Post(Sema_WorkStart);
+    Platform::Thread_Wait(WorkerThread);
+    Platform::Thread_Free(WorkerThread);
+    WorkerThread = nullptr;
+}
+
+void Clear()
+{
+    Entries.clear();
+    RingWritePos = 0;
+
+    DeltasSinceKey = 0;
+    NeedKeyframe = true;
+
+    FrameCount = 0;
+}
+
+void FreeBuffers()
+{
+    if (CaptureState) NDS::UnregisterIncrementalSavestate(CaptureState);
+    if (PendingState) NDS::UnregisterIncrementalSavestate(PendingState);
+    delete CaptureState;
+    delete PendingState;
+    CaptureState = nullptr;
+    PendingState = nullptr;
+
+    KeyState = std::vector<u8>();
+    EncodeBuffer = std::vector<u8>();
+    DecodeBuffer = std::vector<u8>();
+}
+
+void DeInit()
+{
+    StopWorker();
+    FreeBuffers();
+
+    delete[] Ring;
+    Ring = nullptr;
+    RingSize = 0;
+    Entries.clear();
+
+    Platform::Semaphore_Free(Sema_WorkStart);
+    Platform::Semaphore_Free(Sema_WorkDone);
+}
+
+void Reset()
+{
+    WaitIdle();
+    Clear();
+}
+
+void SetConfig(u32 interval, u32 buffersize)
+{
+    if (interval == Interval && buffersize == RingSize)
+        return;
+
+    WaitIdle();
+
+    if (buffersize != RingSize)
+    {
+        delete[] Ring;
+        Ring = buffersize ? new u8[buffersize] : nullptr;
+        RingSize = buffersize;
+        Clear();
+    }
+
+    Interval = interval;
+
+    if (Interval && RingSize)
+        StartWorker();
+    else
+    {
+        StopWorker();
+        FreeBuffers();
+        Clear();
+    }
+}
+
+
+inline bool Differs(const u8* state, const u8* base, u32 offset, u32 len)
+{
+    if (len == 8)
+    {
+        u64 a, b = 0;
+        memcpy(&a, &state[offset], 8);
+        if (base) memcpy(&b, &base[offset], 8);
+        return a != b;
+    }
+
+    for (u32 i = 0; i < len; i++)
+    {
+        if (state[offset+i] != (base ? base[offset+i] : 0))
+            return true;
+    }
+    return false;
+}
+
+void EmitRun(const u8* state, const u8* base, u32 skip, u32 offset, u32 len)
+{
+    size_t pos = EncodeBuffer.size();
+    EncodeBuffer.resize(pos + 8 + len);
+    u8* out = &EncodeBuffer[pos];
+
+    memcpy(&out[0], &skip, 4);
+    memcpy(&out[4], &len, 4);
+    out += 8;
+
+    if (base)
+    {
+        for (u32 i = 0; i < len; i++)
+            out[i] = state[offset+i] ^ base[offset+i];
+    }
+    else
+        memcpy(out, &state[offset], len);
+}
+
+void EncodeSpan(const u8* state, const u8* base, u32 start, u32 end, u32& lastend)
+{
+    u32 i = start;
+    while (i < end)
+    {
+        u32 n = std::min(end - i, 8u);
+        if (!Differs(state, base, i, n))
+        {
+            i += n;
+            continue;
+        }
+
+        u32 runstart = i;
+        do
+        {
+            i += n;
+            n = std::min(end - i, 8u);
+        }
+        while (i < end && Differs(state, base, i, n));
+
+        EmitRun(state, base, runstart - lastend, runstart, i - runstart);
+        lastend = i;
+    }
+}
+
+// base: keyframe to make the delta against, nullptr for keyframes
+void EncodeState(const u8* state, const u8* base, u32 len)
+{
+    EncodeBuffer.clear();
+
+    u32 lastend = 0;
+    u32 offset = 0x10;
+    EncodeSpan(state, base, 0, offset, lastend);
+
+    while (offset + 0x10 <= len)
+    {
+        u32 sectionlen;
+        memcpy(&sectionlen, &state[offset + 0x04], 4);
+        if (sectionlen < 0x10 || sectionlen > len - offset)
+            break;
+
+        // most sections don't change between two snapshots
+        // this is a lot faster than looking for changes 8 bytes at a time
+        if (!base || memcmp(&state[offset], &base[offset], sectionlen))
+            EncodeSpan(state, base, offset, offset + sectionlen, lastend);
+
+        offset += sectionlen;
+    }
+
+    // shouldn't happen, but just in case
+    EncodeSpan(state, base, offset, len, lastend);
+}
+
+void ApplyDelta(const u8* data, u32 len, u8* out)
+{
+    const u8* end = data + len;
+    u32 pos = 0;
+
+    while (data < end)
+    {
+        u32 skip, runlen;
+        memcpy(&skip, &data[0], 4);
+        memcpy(&runlen, &data[4], 4);
+        data += 8;
+
+        pos += skip;
+        for (u32 i = 0; i < runlen; i++)
+            out[pos+i] ^= data[i];
+
+        data += runlen;
+        pos += runlen;
+    }
+}
+
+// returns false if the entry was a delta and its keyframe had to be dropped to make room
+bool Store(u32 statelen, bool keyframe)
+{
+    u32 len = EncodeBuffer.size();
+    if (len > RingSize)
+    {
+        Entries.clear();
+        RingWritePos = 0;
+        return false;
+    }
+
+    u32 pos = RingWritePos;
+    if (pos + len > RingSize)
+    {
+        // no room left at the end, wrap around
+        // the entries after the write position are the oldest ones
+        while (!Entries.empty() && Entries.front().Offset >= pos)
+            Entries.pop_front();
+
+        pos = 0;
+    }
+
+    while (!Entries.empty() &&
+           Entries.front().Offset < (pos + len) &&
+           (Entries.front().Offset + Entries.front().Length) > pos)
+        Entries.pop_front();
+
+    // deltas are useless without their keyframe
+    while (!Entries.empty() && !Entries.front().Keyframe)
+        Entries.pop_front();
+
+    if (!keyframe && Entries.empty())
+        return false;
+
+    memcpy(&Ring[pos], EncodeBuffer.data(), len);
+    Entries.push_back({pos, len, statelen, keyframe});
+    RingWritePos = pos + len;
+
+    return true;
+}
+
+void Encode(const u8* state, u32 len)
+{
+    bool keyframe = NeedKeyframe || (DeltasSinceKey >= KeyframeInterval) || (KeyState.size() != len);
+
+    for (;;)
+    {
+        EncodeState(state, keyframe ? nullptr : KeyState.data(), len);
+        if (Store(len, keyframe))
+            break;
+
+        if (keyframe)
+        {
+            Log(LogLevel::Warn, "rewind: snapshot of %d bytes doesn't fit in the buffer\n", (u32)EncodeBuffer.size());
+            NeedKeyframe = true;
+            return;
+        }
+
+        keyframe = true;
+    }
+
+    if (keyframe)
+    {
+        KeyState.assign(state, state + len);
+        DeltasSinceKey = 0;
+        NeedKeyframe = false;
+    }
+    else
+        DeltasSinceKey++;
+}
+
+void WorkerFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_WorkStart);
+        if (!WorkerRunning) break;
+
+        Encode((const u8*)PendingState->Buffer(), PendingState->Length());
+
+        WorkerBusy = false;
+        Platform::Semaphore_Post(Sema_WorkDone);
+    }
+}
+
+
+void FrameEnd()
+{
+    if (!Interval || !RingSize) return;
+
+    FrameCount++;
+    if (FrameCount < Interval) return;
+
+    if (WorkPending)
+    {
+        // still busy with the previous snapshot, try again next frame
+        if (WorkerBusy) return;
+        WaitIdle();
+    }
+
+    FrameCount = 0;
+
+    if (!CaptureState)
+    {
+        // only the pages that changed since this buffer was last used are copied
+        CaptureState = new Savestate();
+        NDS::RegisterIncrementalSavestate(CaptureState);
+    }
+    else
+        CaptureState->Rewind(true);
+
+    if (!NDS::DoSavestate(CaptureState) || CaptureState->Error)
+    {
+        Log(LogLevel::Error, "rewind: failed to save state\n");
+        return;
+    }
+
+    std::swap(CaptureState, PendingState);
+
+    WorkPending = true;
+    WorkerBusy = true;
+    Platform::Semaphore_Post(Sema_WorkStart);
+}
+
+bool StepBack()
+{
+    WaitIdle();
+
+    if (Entries.empty())
+        return false;
+
+    Entry& entry = Entries.back();
+
+    int key = Entries.size() - 1;
+    while (!Entries[key].Keyframe)
+        key--;
+
+    DecodeBuffer.assign(entry.StateLength, 0);
+    ApplyDelta(&Ring[Entries[key].Offset], Entries[key].Length, DecodeBuffer.data());
+    if (!entry.Keyframe)
+        ApplyDelta(&Ring[entry.Offset], entry.Length, DecodeBuffer.data());
+
+    Savestate state(DecodeBuffer.data(), entry.StateLength, false);
+    bool ret = !state.Error && NDS::DoSavestate(&state) && !state.Error;
+    if (!ret)
+        Log(LogLevel::Error, "rewind: failed to load state\n");
+
+    // the next snapshot goes where this one was
+    RingWritePos = entry.Offset;
+    if (entry.Keyframe)
+        NeedKeyframe = true;
+    else
+        DeltasSinceKey--;
+
+    Entries.pop_back();
+    FrameCount = 0;
+
+    return ret;
+}
+
+}
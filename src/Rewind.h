@@ -0,0 +1,58 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "types.h"
+
+// rewind history
+//
+// a savestate is taken every Interval frames and stored in a fixed-size
+// memory ring. every few snapshots a keyframe is stored, the others only
+// store what changed since that keyframe (XOR delta, runs of unchanged
+// bytes are skipped). sections that didn't change at all are skipped
+// without looking at their contents.
+//
+// the savestate itself is taken on the emulator thread, the encoding
+// happens on a separate thread. when the ring is full, the oldest
+// snapshots are dropped.
+
+namespace Rewind
+{
+
+bool Init();
+void DeInit();
+
+// drops the whole history
+void Reset();
+
+// interval: frames between two snapshots, 0 disables rewinding
+// buffersize: size of the memory ring, in bytes
+void SetConfig(u32 interval, u32 buffersize);
+
+// to be called after every frame, takes a snapshot when needed
+void FrameEnd();
+
+// loads the most recent snapshot, and removes it from the history
+// returns false if there is nothing to go back to
+bool StepBack();
+
+}
+
+#endif // REWIND_H
@@ -23,6 +23,7 @@
 #include "NDS.h"
 #include "DSi.h"
 #include "SPU.h"
+#include "Profiler.h"
 
 using Platform::Log;
 using Platform::LogLevel;
@@ -67,44 +68,40 @@ const s16 PSGTable[8][8] =
 
 // audio interpolation is an improvement upon the original hardware
 // (which performs no interpolation)
-int InterpType;
 s16 InterpCos[0x100];
 s16 InterpCubic[0x100][4];
 
 const u32 OutputBufferSize = 2*2048;
-s16 OutputBackbuffer[2 * OutputBufferSize];
-u32 OutputBackbufferWritePosition;
 
-s16 OutputFrontBuffer[2 * OutputBufferSize];
-u32 OutputFrontBufferWritePosition;
-u32 OutputFrontBufferReadPosition;
-
-Platform::Mutex* AudioLock;
+struct State
+{
+    int InterpType;
 
-u16 Cnt;
-u8 MasterVolume;
-u16 Bias;
-bool ApplyBias;
-bool Degrade10Bit;
+    s16 OutputBackbuffer[2 * OutputBufferSize];
+    u32 OutputBackbufferWritePosition;
 
-Channel* Channels[16];
-CaptureUnit* Capture[2];
+    s16 OutputFrontBuffer[2 * OutputBufferSize];
+    u32 OutputFrontBufferWritePosition;
+    u32 OutputFrontBufferReadPosition;
 
+    Platform::Mutex* AudioLock;
 
-bool Init()
-{
-    for (int i = 0; i < 16; i++)
-        Channels[i] = new Channel(i);
+    u16 Cnt;
+    u8 MasterVolume;
+    u16 Bias;
+    bool ApplyBias;
+    bool Degrade10Bit;
 
-    Capture[0] = new CaptureUnit(0);
-    Capture[1] = new CaptureUnit(1);
+    Channel* Channels[16];
+    CaptureUnit* Capture[2];
+};
 
-    AudioLock = Platform::Mutex_Create();
+State* Cur;
+State* DefaultState;
 
-    InterpType = 0;
-    ApplyBias = true;
-    Degrade10Bit = false;
 
+bool Init()
+{
     // generate interpolation tables
     // values are 1:1:14 fixed-point
 
@@ -129,61 +126,102 @@ bool Init()
         InterpCubic[i][3] = i3 - i2;
     }
 
+    DefaultState = CreateState();
+    Cur = DefaultState;
+
     return true;
 }
 
 void DeInit()
+{
+    DestroyState(DefaultState);
+    DefaultState = nullptr;
+    Cur = nullptr;
+}
+
+State* CreateState()
+{
+    State* state = new State;
+
+    for (int i = 0; i < 16; i++)
+        state->Channels[i] = new Channel(i);
+
+    state->Capture[0] = new CaptureUnit(0);
+    state->Capture[1] = new CaptureUnit(1);
+
+    state->AudioLock = Platform::Mutex_Create();
+
+    state->InterpType = 0;
+    state->ApplyBias = true;
+    state->Degrade10Bit = false;
+
+    return state;
+}
+
+void DestroyState(State* state)
 {
     for (int i = 0; i < 16; i++)
-        delete Channels[i];
+        delete state->Channels[i];
+
+    delete state->Capture[0];
+    delete state->Capture[1];
+
+    Platform::Mutex_Free(state->AudioLock);
 
-    delete Capture[0];
-    delete Capture[1];
+    delete state;
+}
+
+State* GetCurrentState()
+{
+    return Cur;
+}
 
-    Platform::Mutex_Free(AudioLock);
+void SetCurrentState(State* state)
+{
+    Cur = state;
 }
 
 void Reset()
 {
     InitOutput();
 
-    Cnt = 0;
-    MasterVolume = 0;
-    Bias = 0;
+    Cur->Cnt = 0;
+    Cur->MasterVolume = 0;
+    Cur->Bias = 0;
 
     for (int i = 0; i < 16; i++)
-        Channels[i]->Reset();
+        Cur->Channels[i]->Reset();
 
-    Capture[0]->Reset();
-    Capture[1]->Reset();
+    Cur->Capture[0]->Reset();
+    Cur->Capture[1]->Reset();
 
     NDS::ScheduleEvent(NDS::Event_SPU, true, 1024, Mix, 0);
 }
 
 void Stop()
 {
-    Platform::Mutex_Lock(AudioLock);
-    memset(OutputFrontBuffer, 0, 2*OutputBufferSize*2);
+    Platform::Mutex_Lock(Cur->AudioLock);
+    memset(Cur->OutputFrontBuffer, 0, 2*OutputBufferSize*2);
 
-    OutputBackbufferWritePosition = 0;
-    OutputFrontBufferReadPosition = 0;
-    OutputFrontBufferWritePosition = 0;
-    Platform::Mutex_Unlock(AudioLock);
+    Cur->OutputBackbufferWritePosition = 0;
+    Cur->OutputFrontBufferReadPosition = 0;
+    Cur->OutputFrontBufferWritePosition = 0;
+    Platform::Mutex_Unlock(Cur->AudioLock);
 }
 
 void DoSavestate(Savestate* file)
 {
     file->Section("SPU.");
 
-    file->Var16(&Cnt);
-    file->Var8(&MasterVolume);
-    file->Var16(&Bias);
+    file->Var16(&Cur->Cnt);
+    file->Var8(&Cur->MasterVolume);
+    file->Var16(&Cur->Bias);
 
     for (int i = 0; i < 16; i++)
-        Channels[i]->DoSavestate(file);
+        Cur->Channels[i]->DoSavestate(file);
 
-    Capture[0]->DoSavestate(file);
-    Capture[1]->DoSavestate(file);
+    Cur->Capture[0]->DoSavestate(file);
+    Cur->Capture[1]->DoSavestate(file);
 }
 
 
@@ -195,22 +233,22 @@ void SetPowerCnt(u32 val)
 
 void SetInterpolation(int type)
 {
-    InterpType = type;
+    Cur->InterpType = type;
 }
 
 void SetBias(u16 bias)
 {
-    Bias = bias;
+    Cur->Bias = bias;
 }
 
 void SetApplyBias(bool enable)
 {
-    ApplyBias = enable;
+    Cur->ApplyBias = enable;
 }
 
 void SetDegrade10Bit(bool enable)
 {
-    Degrade10Bit = enable;
+    Cur->Degrade10Bit = enable;
 }
 
 
@@ -525,7 +563,7 @@ s32 Channel::Run()
         // for optional interpolation: save previous samples
         // the interpolated audio will be delayed by a couple samples,
         // but it's easier to deal with this way
-        if ((type < 3) && (InterpType != 0))
+        if ((type < 3) && (Cur->InterpType != 0))
         {
             PrevSample[2] = PrevSample[1];
             PrevSample[1] = PrevSample[0];
@@ -545,12 +583,12 @@ s32 Channel::Run()
     s32 val = (s32)CurSample;
 
     // interpolation (emulation improvement, not a hardware feature)
-    if ((type < 3) && (InterpType != 0))
+    if ((type < 3) && (Cur->InterpType != 0))
     {
         s32 samplepos = ((Timer - TimerReload) * 0x100) / (0x10000 - TimerReload);
         if (samplepos > 0xFF) samplepos = 0xFF;
 
-        switch (InterpType)
+        switch (Cur->InterpType)
         {
         case 1: // linear
             val = ((val           * samplepos) +
@@ -717,26 +755,28 @@ void CaptureUnit::Run(s32 sample)
 
 void Mix(u32 dummy)
 {
+    PROFILE_SCOPE(Profiler::Counter_SPU);
+
     s32 left = 0, right = 0;
     s32 leftoutput = 0, rightoutput = 0;
 
-    if (Cnt & (1<<15))
+    if (Cur->Cnt & (1<<15))
     {
-        s32 ch0 = Channels[0]->DoRun();
-        s32 ch1 = Channels[1]->DoRun();
-        s32 ch2 = Channels[2]->DoRun();
-        s32 ch3 = Channels[3]->DoRun();
+        s32 ch0 = Cur->Channels[0]->DoRun();
+        s32 ch1 = Cur->Channels[1]->DoRun();
+        s32 ch2 = Cur->Channels[2]->DoRun();
+        s32 ch3 = Cur->Channels[3]->DoRun();
 
         // TODO: addition from capture registers
-        Channels[0]->PanOutput(ch0, left, right);
-        Channels[2]->PanOutput(ch2, left, right);
+        Cur->Channels[0]->PanOutput(ch0, left, right);
+        Cur->Channels[2]->PanOutput(ch2, left, right);
 
-        if (!(Cnt & (1<<12))) Channels[1]->PanOutput(ch1, left, right);
-        if (!(Cnt & (1<<13))) Channels[3]->PanOutput(ch3, left, right);
+        if (!(Cur->Cnt & (1<<12))) Cur->Channels[1]->PanOutput(ch1, left, right);
+        if (!(Cur->Cnt & (1<<13))) Cur->Channels[3]->PanOutput(ch3, left, right);
 
         for (int i = 4; i < 16; i++)
         {
-            Channel* chan = Channels[i];
+            Channel* chan = Cur->Channels[i];
 
             s32 channel = chan->DoRun();
             chan->PanOutput(channel, left, right);
@@ -745,7 +785,7 @@ void Mix(u32 dummy)
         // sound capture
         // TODO: other sound capture sources, along with their bugs
 
-        if (Capture[0]->Cnt & (1<<7))
+        if (Cur->Capture[0]->Cnt & (1<<7))
         {
             s32 val = left;
 
@@ -753,10 +793,10 @@ void Mix(u32 dummy)
             if      (val < -0x8000) val = -0x8000;
             else if (val > 0x7FFF)  val = 0x7FFF;
 
-            Capture[0]->Run(val);
+            Cur->Capture[0]->Run(val);
         }
 
-        if (Capture[1]->Cnt & (1<<7))
+        if (Cur->Capture[1]->Cnt & (1<<7))
         {
             s32 val = right;
 
@@ -764,76 +804,76 @@ void Mix(u32 dummy)
             if      (val < -0x8000) val = -0x8000;
             else if (val > 0x7FFF)  val = 0x7FFF;
 
-            Capture[1]->Run(val);
+            Cur->Capture[1]->Run(val);
         }
 
         // final output
 
-        switch (Cnt & 0x0300)
+        switch (Cur->Cnt & 0x0300)
         {
         case 0x0000: // left mixer
             leftoutput = left;
             break;
         case 0x0100: // channel 1
             {
-                s32 pan = 128 - Channels[1]->Pan;
+                s32 pan = 128 - Cur->Channels[1]->Pan;
                 leftoutput = ((s64)ch1 * pan) >> 10;
             }
             break;
         case 0x0200: // channel 3
             {
-                s32 pan = 128 - Channels[3]->Pan;
+                s32 pan = 128 - Cur->Channels[3]->Pan;
                 leftoutput = ((s64)ch3 * pan) >> 10;
             }
             break;
         case 0x0300: // channel 1+3
             {
-                s32 pan1 = 128 - Channels[1]->Pan;
-                s32 pan3 = 128 - Channels[3]->Pan;
+                s32 pan1 = 128 - Cur->Channels[1]->Pan;
+                s32 pan3 = 128 - Cur->Channels[3]->Pan;
                 leftoutput = (((s64)ch1 * pan1) >> 10) + (((s64)ch3 * pan3) >> 10);
             }
             break;
         }
 
-        switch (Cnt & 0x0C00)
+        switch (Cur->Cnt & 0x0C00)
         {
         case 0x0000: // right mixer
             rightoutput = right;
             break;
         case 0x0400: // channel 1
             {
-                s32 pan = Channels[1]->Pan;
+                s32 pan = Cur->Channels[1]->Pan;
                 rightoutput = ((s64)ch1 * pan) >> 10;
             }
             break;
         case 0x0800: // channel 3
             {
-                s32 pan = Channels[3]->Pan;
+                s32 pan = Cur->Channels[3]->Pan;
                 rightoutput = ((s64)ch3 * pan) >> 10;
             }
             break;
         case 0x0C00: // channel 1+3
             {
-                s32 pan1 = Channels[1]->Pan;
-                s32 pan3 = Channels[3]->Pan;
+                s32 pan1 = Cur->Channels[1]->Pan;
+                s32 pan3 = Cur->Channels[3]->Pan;
                 rightoutput = (((s64)ch1 * pan1) >> 10) + (((s64)ch3 * pan3) >> 10);
             }
             break;
         }
     }
 
-    leftoutput = ((s64)leftoutput * MasterVolume) >> 7;
-    rightoutput = ((s64)rightoutput * MasterVolume) >> 7;
+    leftoutput = ((s64)leftoutput * Cur->MasterVolume) >> 7;
+    rightoutput = ((s64)rightoutput * Cur->MasterVolume) >> 7;
 
     leftoutput >>= 8;
     rightoutput >>= 8;
 
     // Add SOUNDBIAS value
     // The value used by all commercial games is 0x200, so we subtract that so it won't offset the final sound output.
-    if (ApplyBias)
+    if (Cur->ApplyBias)
     {
-        leftoutput += (Bias << 6) - 0x8000;
-        rightoutput += (Bias << 6) - 0x8000;
+        leftoutput += (Cur->Bias << 6) - 0x8000;
+        rightoutput += (Cur->Bias << 6) - 0x8000;
     }
 
     if      (leftoutput < -0x8000) leftoutput = -0x8000;
@@ -842,7 +882,7 @@ void Mix(u32 dummy)
     else if (rightoutput > 0x7FFF)  rightoutput = 0x7FFF;
 
     // The original DS and DS lite degrade the output from 16 to 10 bit before output
-    if (Degrade10Bit)
+    if (Cur->Degrade10Bit)
     {
         leftoutput &= 0xFFFFFFC0;
         rightoutput &= 0xFFFFFFC0;
@@ -850,77 +890,92 @@ void Mix(u32 dummy)
 
     // OutputBufferFrame can never get full because it's
     // transfered to OutputBuffer at the end of the frame
-    OutputBackbuffer[OutputBackbufferWritePosition    ] = leftoutput >> 1;
-    OutputBackbuffer[OutputBackbufferWritePosition + 1] = rightoutput >> 1;
-    OutputBackbufferWritePosition += 2;
+    Cur->OutputBackbuffer[Cur->OutputBackbufferWritePosition    ] = leftoutput >> 1;
+    Cur->OutputBackbuffer[Cur->OutputBackbufferWritePosition + 1] = rightoutput >> 1;
+    Cur->OutputBackbufferWritePosition += 2;
 
     NDS::ScheduleEvent(NDS::Event_SPU, true, 1024, Mix, 0);
 }
 
 void TransferOutput()
 {
-    Platform::Mutex_Lock(AudioLock);
-    for (u32 i = 0; i < OutputBackbufferWritePosition; i += 2)
+    Platform::Mutex_Lock(Cur->AudioLock);
+    for (u32 i = 0; i < Cur->OutputBackbufferWritePosition; i += 2)
     {
-        OutputFrontBuffer[OutputFrontBufferWritePosition    ] = OutputBackbuffer[i   ];
-        OutputFrontBuffer[OutputFrontBufferWritePosition + 1] = OutputBackbuffer[i + 1];
+        Cur->OutputFrontBuffer[Cur->OutputFrontBufferWritePosition    ] = Cur->OutputBackbuffer[i   ];
+        Cur->OutputFrontBuffer[Cur->OutputFrontBufferWritePosition + 1] = Cur->OutputBackbuffer[i + 1];
 
-        OutputFrontBufferWritePosition += 2;
-        OutputFrontBufferWritePosition &= OutputBufferSize*2-1;
-        if (OutputFrontBufferWritePosition == OutputFrontBufferReadPosition)
+        Cur->OutputFrontBufferWritePosition += 2;
+        Cur->OutputFrontBufferWritePosition &= OutputBufferSize*2-1;
+        if (Cur->OutputFrontBufferWritePosition == Cur->OutputFrontBufferReadPosition)
         {
             // advance the read position too, to avoid losing the entire FIFO
-            OutputFrontBufferReadPosition += 2;
-            OutputFrontBufferReadPosition &= OutputBufferSize*2-1;
+            Cur->OutputFrontBufferReadPosition += 2;
+            Cur->OutputFrontBufferReadPosition &= OutputBufferSize*2-1;
         }
     }
-    OutputBackbufferWritePosition = 0;
-    Platform::Mutex_Unlock(AudioLock);
+    Cur->OutputBackbufferWritePosition = 0;
+    Platform::Mutex_Unlock(Cur->AudioLock);
+}
+
+// drops the samples mixed this frame, for frames that are emulated but not kept
+void DiscardOutput()
+{
+    Cur->OutputBackbufferWritePosition = 0;
 }
 
 void TrimOutput()
 {
-    Platform::Mutex_Lock(AudioLock);
+    Platform::Mutex_Lock(Cur->AudioLock);
     const int halflimit = (OutputBufferSize / 2);
 
-    int readpos = OutputFrontBufferWritePosition - (halflimit*2);
+    int readpos = Cur->OutputFrontBufferWritePosition - (halflimit*2);
     if (readpos < 0) readpos += (OutputBufferSize*2);
 
-    OutputFrontBufferReadPosition = readpos;
-    Platform::Mutex_Unlock(AudioLock);
+    Cur->OutputFrontBufferReadPosition = readpos;
+    Platform::Mutex_Unlock(Cur->AudioLock);
 }
 
 void DrainOutput()
 {
-    Platform::Mutex_Lock(AudioLock);
-    OutputFrontBufferWritePosition = 0;
-    OutputFrontBufferReadPosition = 0;
-    Platform::Mutex_Unlock(AudioLock);
+    Platform::Mutex_Lock(Cur->AudioLock);
+    Cur->OutputFrontBufferWritePosition = 0;
+    Cur->OutputFrontBufferReadPosition = 0;
+    Platform::Mutex_Unlock(Cur->AudioLock);
 }
 
 void InitOutput()
 {
-    Platform::Mutex_Lock(AudioLock);
-    memset(OutputBackbuffer, 0, 2*OutputBufferSize*2);
-    memset(OutputFrontBuffer, 0, 2*OutputBufferSize*2);
-    OutputFrontBufferReadPosition = 0;
-    OutputFrontBufferWritePosition = 0;
-    Platform::Mutex_Unlock(AudioLock);
+    Platform::Mutex_Lock(Cur->AudioLock);
+    memset(Cur->OutputBackbuffer, 0, 2*OutputBufferSize*2);
+    memset(Cur->OutputFrontBuffer, 0, 2*OutputBufferSize*2);
+    Cur->OutputFrontBufferReadPosition = 0;
+    Cur->OutputFrontBufferWritePosition = 0;
+    Platform::Mutex_Unlock(Cur->AudioLock);
 }
 
 int GetOutputSize()
 {
-    Platform::Mutex_Lock(AudioLock);
+    Platform::Mutex_Lock(Cur->AudioLock);
 
     int ret;
-    if (OutputFrontBufferWritePosition >= OutputFrontBufferReadPosition)
-        ret = OutputFrontBufferWritePosition - OutputFrontBufferReadPosition;
+    if (Cur->OutputFrontBufferWritePosition >= Cur->OutputFrontBufferReadPosition)
+        ret = Cur->OutputFrontBufferWritePosition - Cur->OutputFrontBufferReadPosition;
     else
-        ret = (OutputBufferSize*2) - OutputFrontBufferReadPosition + OutputFrontBufferWritePosition;
+        ret = (OutputBufferSize*2) - Cur->OutputFrontBufferReadPosition + Cur->OutputFrontBufferWritePosition;
 
     ret >>= 1;
 
-    Platform::Mutex_Unlock(AudioLock);
+    Platform::Mutex_Unlock(Cur->AudioLock);
+    return ret;
+}
+
+// where the next samples go in the output buffer, it wraps around
+u32 GetOutputWritePosition()
+{
+    Platform::Mutex_Lock(Cur->AudioLock);
+    u32 ret = Cur->OutputFrontBufferWritePosition;
+    Platform::Mutex_Unlock(Cur->AudioLock);
     return ret;
 }
 
@@ -943,42 +998,42 @@ void Sync(bool wait)
     }
     else if (GetOutputSize() > halflimit)
     {
-        Platform::Mutex_Lock(AudioLock);
+        Platform::Mutex_Lock(Cur->AudioLock);
 
-        int readpos = OutputFrontBufferWritePosition - (halflimit*2);
+        int readpos = Cur->OutputFrontBufferWritePosition - (halflimit*2);
         if (readpos < 0) readpos += (OutputBufferSize*2);
 
-        OutputFrontBufferReadPosition = readpos;
+        Cur->OutputFrontBufferReadPosition = readpos;
 
-        Platform::Mutex_Unlock(AudioLock);
+        Platform::Mutex_Unlock(Cur->AudioLock);
     }
 }
 
 int ReadOutput(s16* data, int samples)
 {
-    Platform::Mutex_Lock(AudioLock);
-    if (OutputFrontBufferReadPosition == OutputFrontBufferWritePosition)
+    Platform::Mutex_Lock(Cur->AudioLock);
+    if (Cur->OutputFrontBufferReadPosition == Cur->OutputFrontBufferWritePosition)
     {
-        Platform::Mutex_Unlock(AudioLock);
+        Platform::Mutex_Unlock(Cur->AudioLock);
         return 0;
     }
 
     for (int i = 0; i < samples; i++)
     {
-        *data++ = OutputFrontBuffer[OutputFrontBufferReadPosition];
-        *data++ = OutputFrontBuffer[OutputFrontBufferReadPosition + 1];
+        *data++ = Cur->OutputFrontBuffer[Cur->OutputFrontBufferReadPosition];
+        *data++ = Cur->OutputFrontBuffer[Cur->OutputFrontBufferReadPosition + 1];
 
-        OutputFrontBufferReadPosition += 2;
-        OutputFrontBufferReadPosition &= ((2*OutputBufferSize)-1);
+        Cur->OutputFrontBufferReadPosition += 2;
+        Cur->OutputFrontBufferReadPosition &= ((2*OutputBufferSize)-1);
 
-        if (OutputFrontBufferWritePosition == OutputFrontBufferReadPosition)
+        if (Cur->OutputFrontBufferWritePosition == Cur->OutputFrontBufferReadPosition)
         {
-            Platform::Mutex_Unlock(AudioLock);
+            Platform::Mutex_Unlock(Cur->AudioLock);
             return i+1;
         }
     }
 
-    Platform::Mutex_Unlock(AudioLock);
+    Platform::Mutex_Unlock(Cur->AudioLock);
     return samples;
 }
 
@@ -987,7 +1042,7 @@ u8 Read8(u32 addr)
 {
     if (addr < 0x04000500)
     {
-        Channel* chan = Channels[(addr >> 4) & 0xF];
+        Channel* chan = Cur->Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
@@ -1001,11 +1056,11 @@ u8 Read8(u32 addr)
     {
         switch (addr)
         {
-        case 0x04000500: return Cnt & 0x7F;
-        case 0x04000501: return Cnt >> 8;
+        case 0x04000500: return Cur->Cnt & 0x7F;
+        case 0x04000501: return Cur->Cnt >> 8;
 
-        case 0x04000508: return Capture[0]->Cnt;
-        case 0x04000509: return Capture[1]->Cnt;
+        case 0x04000508: return Cur->Capture[0]->Cnt;
+        case 0x04000509: return Cur->Capture[1]->Cnt;
         }
     }
 
@@ -1017,7 +1072,7 @@ u16 Read16(u32 addr)
 {
     if (addr < 0x04000500)
     {
-        Channel* chan = Channels[(addr >> 4) & 0xF];
+        Channel* chan = Cur->Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
@@ -1029,10 +1084,10 @@ u16 Read16(u32 addr)
     {
         switch (addr)
         {
-        case 0x04000500: return Cnt;
-        case 0x04000504: return Bias;
+        case 0x04000500: return Cur->Cnt;
+        case 0x04000504: return Cur->Bias;
 
-        case 0x04000508: return Capture[0]->Cnt | (Capture[1]->Cnt << 8);
+        case 0x04000508: return Cur->Capture[0]->Cnt | (Cur->Capture[1]->Cnt << 8);
         }
     }
 
@@ -1044,7 +1099,7 @@ u32 Read32(u32 addr)
 {
     if (addr < 0x04000500)
     {
-        Channel* chan = Channels[(addr >> 4) & 0xF];
+        Channel* chan = Cur->Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
@@ -1055,13 +1110,13 @@ u32 Read32(u32 addr)
     {
         switch (addr)
         {
-        case 0x04000500: return Cnt;
-        case 0x04000504: return Bias;
+        case 0x04000500: return Cur->Cnt;
+        case 0x04000504: return Cur->Bias;
 
-        case 0x04000508: return Capture[0]->Cnt | (Capture[1]->Cnt << 8);
+        case 0x04000508: return Cur->Capture[0]->Cnt | (Cur->Capture[1]->Cnt << 8);
 
-        case 0x04000510: return Capture[0]->DstAddr;
-        case 0x04000518: return Capture[1]->DstAddr;
+        case 0x04000510: return Cur->Capture[0]->DstAddr;
+        case 0x04000518: return Cur->Capture[1]->DstAddr;
         }
     }
 
@@ -1073,7 +1128,7 @@ void Write8(u32 addr, u8 val)
 {
     if (addr < 0x04000500)
     {
-        Channel* chan = Channels[(addr >> 4) & 0xF];
+        Channel* chan = Cur->Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
@@ -1088,20 +1143,20 @@ void Write8(u32 addr, u8 val)
         switch (addr)
         {
         case 0x04000500:
-            Cnt = (Cnt & 0xBF00) | (val & 0x7F);
-            MasterVolume = Cnt & 0x7F;
-            if (MasterVolume == 127) MasterVolume++;
+            Cur->Cnt = (Cur->Cnt & 0xBF00) | (val & 0x7F);
+            Cur->MasterVolume = Cur->Cnt & 0x7F;
+            if (Cur->MasterVolume == 127) Cur->MasterVolume++;
             return;
         case 0x04000501:
-            Cnt = (Cnt & 0x007F) | ((val & 0xBF) << 8);
+            Cur->Cnt = (Cur->Cnt & 0x007F) | ((val & 0xBF) << 8);
             return;
 
         case 0x04000508:
-            Capture[0]->SetCnt(val);
+            Cur->Capture[0]->SetCnt(val);
             if (val & 0x03) Log(LogLevel::Warn, "!! UNSUPPORTED SPU CAPTURE MODE %02X\n", val);
             return;
         case 0x04000509:
-            Capture[1]->SetCnt(val);
+            Cur->Capture[1]->SetCnt(val);
             if (val & 0x03) Log(LogLevel::Warn, "!! UNSUPPORTED SPU CAPTURE MODE %02X\n", val);
             return;
         }
@@ -1114,7 +1169,7 @@ void Write16(u32 addr, u16 val)
 {
     if (addr < 0x04000500)
     {
-        Channel* chan = Channels[(addr >> 4) & 0xF];
+        Channel* chan = Cur->Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
@@ -1122,8 +1177,8 @@ void Write16(u32 addr, u16 val)
         case 0x2: chan->SetCnt((chan->Cnt & 0x0000FFFF) | (val << 16)); return;
         case 0x8:
             chan->SetTimerReload(val);
-            if      ((addr & 0xF0) == 0x10) Capture[0]->SetTimerReload(val);
-            else if ((addr & 0xF0) == 0x30) Capture[1]->SetTimerReload(val);
+            if      ((addr & 0xF0) == 0x10) Cur->Capture[0]->SetTimerReload(val);
+            else if ((addr & 0xF0) == 0x30) Cur->Capture[1]->SetTimerReload(val);
             return;
         case 0xA: chan->SetLoopPos(val); return;
 
@@ -1136,23 +1191,23 @@ void Write16(u32 addr, u16 val)
         switch (addr)
         {
         case 0x04000500:
-            Cnt = val & 0xBF7F;
-            MasterVolume = Cnt & 0x7F;
-            if (MasterVolume == 127) MasterVolume++;
+            Cur->Cnt = val & 0xBF7F;
+            Cur->MasterVolume = Cur->Cnt & 0x7F;
+            if (Cur->MasterVolume == 127) Cur->MasterVolume++;
             return;
 
         case 0x04000504:
-            Bias = val & 0x3FF;
+            Cur->Bias = val & 0x3FF;
             return;
 
         case 0x04000508:
-            Capture[0]->SetCnt(val & 0xFF);
-            Capture[1]->SetCnt(val >> 8);
+            Cur->Capture[0]->SetCnt(val & 0xFF);
+            Cur->Capture[1]->SetCnt(val >> 8);
             if (val & 0x0303) Log(LogLevel::Warn, "!! UNSUPPORTED SPU CAPTURE MODE %04X\n", val);
             return;
 
-        case 0x04000514: Capture[0]->SetLength(val); return;
-        case 0x0400051C: Capture[1]->SetLength(val); return;
+        case 0x04000514: Cur->Capture[0]->SetLength(val); return;
+        case 0x0400051C: Cur->Capture[1]->SetLength(val); return;
         }
     }
 
@@ -1163,7 +1218,7 @@ void Write32(u32 addr, u32 val)
 {
     if (addr < 0x04000500)
     {
-        Channel* chan = Channels[(addr >> 4) & 0xF];
+        Channel* chan = Cur->Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
@@ -1173,8 +1228,8 @@ void Write32(u32 addr, u32 val)
             chan->SetLoopPos(val >> 16);
             val &= 0xFFFF;
             chan->SetTimerReload(val);
-            if      ((addr & 0xF0) == 0x10) Capture[0]->SetTimerReload(val);
-            else if ((addr & 0xF0) == 0x30) Capture[1]->SetTimerReload(val);
+            if      ((addr & 0xF0) == 0x10) Cur->Capture[0]->SetTimerReload(val);
+            else if ((addr & 0xF0) == 0x30) Cur->Capture[1]->SetTimerReload(val);
             return;
         case 0xC: chan->SetLength(val); return;
         }
@@ -1184,25 +1239,25 @@ void Write32(u32 addr, u32 val)
         switch (addr)
         {
         case 0x04000500:
-            Cnt = val & 0xBF7F;
-            MasterVolume = Cnt & 0x7F;
-            if (MasterVolume == 127) MasterVolume++;
+            Cur->Cnt = val & 0xBF7F;
+            Cur->MasterVolume = Cur->Cnt & 0x7F;
+            if (Cur->MasterVolume == 127) Cur->MasterVolume++;
             return;
 
         case 0x04000504:
-            Bias = val & 0x3FF;
+            Cur->Bias = val & 0x3FF;
             return;
 
         case 0x04000508:
-            Capture[0]->SetCnt(val & 0xFF);
-            Capture[1]->SetCnt(val >> 8);
+            Cur->Capture[0]->SetCnt(val & 0xFF);
+            Cur->Capture[1]->SetCnt(val >> 8);
             if (val & 0x0303) Log(LogLevel::Warn, "!! UNSUPPORTED SPU CAPTURE MODE %04X\n", val);
             return;
 
-        case 0x04000510: Capture[0]->SetDstAddr(val); return;
-        case 0x04000514: Capture[0]->SetLength(val & 0xFFFF); return;
-        case 0x04000518: Capture[1]->SetDstAddr(val); return;
-        case 0x0400051C: Capture[1]->SetLength(val & 0xFFFF); return;
+        case 0x04000510: Cur->Capture[0]->SetDstAddr(val); return;
+        case 0x04000514: Cur->Capture[0]->SetLength(val & 0xFFFF); return;
+        case 0x04000518: Cur->Capture[1]->SetDstAddr(val); return;
+        case 0x0400051C: Cur->Capture[1]->SetLength(val & 0xFFFF); return;
         }
     }
 }
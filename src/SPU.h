@@ -26,6 +26,18 @@ namespace SPU
 
 bool Init();
 void DeInit();
+
+// the SPU's state is kept per console, as the first step towards running
+// several consoles in one process. Init() creates one and makes it current,
+// the functions below all work on the current one.
+// the rest of the core and the JIT are still single-instance, a console
+// can only be run while its state is current.
+struct State;
+State* CreateState();
+void DestroyState(State* state);
+State* GetCurrentState();
+void SetCurrentState(State* state);
+
 void Reset();
 void Stop();
 
@@ -46,9 +58,11 @@ void TrimOutput();
 void DrainOutput();
 void InitOutput();
 int GetOutputSize();
+u32 GetOutputWritePosition();
 void Sync(bool wait);
 int ReadOutput(s16* data, int samples);
 void TransferOutput();
+void DiscardOutput();
 
 u8 Read8(u32 addr);
 u16 Read16(u32 addr);
@@ -20,6 +20,7 @@
 #include <cassert>
 #include <cstring>
 #include "Savestate.h"
+#include "LZ4.h"
 #include "Platform.h"
 
 using Platform::Log;
@@ -35,7 +36,7 @@ static const char* SAVESTATE_MAGIC = "MELN";
     04 - version major
     06 - version minor
     08 - length
-    0C - reserved (should be game serial later!)
+    0C - flags (SAVESTATE_FLAG_*), only used in files
 
     section header:
     00 - section magic
@@ -43,6 +44,12 @@ static const char* SAVESTATE_MAGIC = "MELN";
     08 - reserved
     0C - reserved
 
+    compressed files (SAVESTATE_FLAG_COMPRESSED):
+    the header length is the uncompressed length. sections are stored one
+    after another, each with its header followed by its data. in the section
+    header, 08 is the length of the stored data, and 0C is 1 if the data is
+    LZ4 compressed, 0 if it's stored as-is (didn't compress)
+
     Implementation details
 
     version difference:
@@ -58,7 +65,9 @@ Savestate::Savestate(void *buffer, u32 size, bool save) :
     buffer_offset(0),
     buffer_length(size),
     buffer_owned(false),
-    finished(false)
+    finished(false),
+    compress_sections(false),
+    compressed_end(0x10)
 {
     if (Saving)
     {
@@ -108,7 +117,7 @@ Savestate::Savestate(void *buffer, u32 size, bool save) :
             return;
         }
 
-        // The next 4 bytes are reserved
+        // The next 4 bytes are flags, which only matter for files
         buffer_offset += 4;
     }
 }
@@ -122,7 +131,9 @@ Savestate::Savestate(u32 initial_size) :
     buffer_offset(0),
     buffer_length(initial_size),
     buffer_owned(true),
-    finished(false)
+    finished(false),
+    compress_sections(false),
+    compressed_end(0x10)
 {
     buffer = static_cast<u8 *>(malloc(buffer_length));
 
@@ -248,11 +259,28 @@ void Savestate::VarArray(void* data, u32 len)
     buffer_offset += len;
 }
 
+void Savestate::Skip(u32 len)
+{
+    if (Error || finished) return;
+
+    if (buffer_offset + len > buffer_length)
+    {
+        Log(LogLevel::Error, "savestate: %u-byte skip would exceed %u-byte savestate buffer\n", len, buffer_length);
+        Error = true;
+        return;
+    }
+
+    buffer_offset += len;
+}
+
 void Savestate::Finish()
 {
     if (Error || finished) return;
-    CloseCurrentSection();
-    WriteStateLength();
+    if (Saving)
+    {
+        CloseCurrentSection();
+        WriteStateLength();
+    }
     finished = true;
 }
 
@@ -264,6 +292,16 @@ void Savestate::Rewind(bool save)
 
     buffer_offset = 0;
     finished = false;
+    compressed.clear();
+    compressed_end = 0x10;
+
+    if (Saving)
+        WriteSavestateHeader();
+}
+
+void Savestate::CompressSections()
+{
+    compress_sections = true;
 }
 
 void Savestate::CloseCurrentSection()
@@ -279,6 +317,9 @@ void Savestate::CloseCurrentSection()
         // (specifically the first 4 bytes after the magic number)
         memcpy(buffer + CurSection + 4, &section_length, sizeof(section_length));
 
+        if (compress_sections)
+            CompressSection(CurSection, section_length);
+
         CurSection = NO_SECTION;
     }
 }
@@ -325,7 +366,7 @@ void Savestate::WriteSavestateHeader()
     u32 zero = 0;
     Var32(&zero);
 
-    // The following 4 bytes are reserved
+    // The following 4 bytes are flags, none of which apply to states in memory
     Var32(&zero);
 }
 
@@ -340,14 +381,161 @@ void Savestate::WriteStateLength()
     memcpy(buffer + 0x08, &state_length, sizeof(state_length));
 }
 
+// appends a section in the compressed file format to out
+static void PackSection(const u8* section, u32 section_length, std::vector<u8>& out)
+{
+    const u8* data = section + 0x10;
+    u32 datalen = section_length - 0x10;
+
+    u32 start = out.size();
+    out.resize(start + 0x10 + datalen);
+    u8* sectionheader = &out[start];
+
+    // sections which don't get smaller are stored as-is
+    u32 packedlen = datalen ? LZ4::Compress(data, datalen, sectionheader + 0x10, datalen) : 0;
+    u32 storedlen = packedlen ? packedlen : datalen;
+    u32 compressed = packedlen ? 1 : 0;
+    if (!packedlen)
+        memcpy(sectionheader + 0x10, data, datalen);
+
+    memcpy(sectionheader, section, 8);
+    memcpy(&sectionheader[0x08], &storedlen, 4);
+    memcpy(&sectionheader[0x0C], &compressed, 4);
+
+    out.resize(start + 0x10 + storedlen);
+}
+
+void Savestate::CompressSection(u32 offset, u32 length)
+{
+    // if sections were closed before compression was enabled,
+    // WriteFile() has to compress everything itself
+    if (offset != compressed_end)
+        return;
+
+    PackSection(buffer + offset, length, compressed);
+    compressed_end = offset + length;
+}
+
+bool Savestate::WriteFile(FILE* file, bool compress) const
+{
+    u32 len = buffer_offset;
+
+    if (!compress)
+        return fwrite(buffer, len, 1, file) == 1;
+
+    u8 header[0x10];
+    memcpy(header, buffer, 0x10);
+    u32 flags = SAVESTATE_FLAG_COMPRESSED;
+    memcpy(&header[0x0C], &flags, 4);
+    if (fwrite(header, 0x10, 1, file) != 1)
+        return false;
+
+    // the sections were compressed as they were written
+    if (compressed_end == len)
+        return compressed.empty() || fwrite(compressed.data(), compressed.size(), 1, file) == 1;
+
+    std::vector<u8> packed;
+    for (u32 offset = 0x10; offset < len;)
+    {
+        u32 section_length = 0;
+        if (len - offset >= 0x10)
+            memcpy(&section_length, buffer + offset + 4, sizeof(section_length));
+        if (section_length < 0x10 || section_length > len - offset)
+        {
+            Log(LogLevel::Error, "savestate: bad section at %08X, can't compress\n", offset);
+            return false;
+        }
+
+        packed.clear();
+        PackSection(buffer + offset, section_length, packed);
+        if (fwrite(packed.data(), packed.size(), 1, file) != 1)
+            return false;
+
+        offset += section_length;
+    }
+
+    return true;
+}
+
+bool Savestate::Decompress(std::vector<u8>& data)
+{
+    if (data.size() < 0x10)
+        return true;
+
+    u32 flags = 0;
+    memcpy(&flags, &data[0x0C], 4);
+    if (!(flags & SAVESTATE_FLAG_COMPRESSED))
+        return true;
+
+    u32 len = 0;
+    memcpy(&len, &data[0x08], 4);
+    if (len < 0x10)
+        return false;
+
+    std::vector<u8> out(len);
+    memcpy(out.data(), data.data(), 0x10);
+    flags &= ~SAVESTATE_FLAG_COMPRESSED;
+    memcpy(&out[0x0C], &flags, 4);
+
+    u32 in = 0x10;
+    u32 offset = 0x10;
+    while (in < data.size())
+    {
+        if (data.size() - in < 0x10)
+            return false;
+
+        u32 section_length, storedlen, compressed;
+        memcpy(&section_length, &data[in + 0x04], 4);
+        memcpy(&storedlen, &data[in + 0x08], 4);
+        memcpy(&compressed, &data[in + 0x0C], 4);
+
+        if (section_length < 0x10 || section_length > len - offset)
+            return false;
+        if (storedlen > data.size() - in - 0x10)
+            return false;
+
+        u32 datalen = section_length - 0x10;
+        memcpy(&out[offset], &data[in], 8);
+        memset(&out[offset + 0x08], 0, 8);
+
+        const u8* src = &data[in + 0x10];
+        if (compressed)
+        {
+            if (!LZ4::Decompress(src, storedlen, &out[offset + 0x10], datalen))
+                return false;
+        }
+        else
+        {
+            if (storedlen != datalen)
+                return false;
+            memcpy(&out[offset + 0x10], src, datalen);
+        }
+
+        in += 0x10 + storedlen;
+        offset += section_length;
+    }
+
+    if (offset != len)
+        return false;
+
+    data = std::move(out);
+    return true;
+}
+
 u32 Savestate::FindSection(const char* magic) const
 {
     if (!magic) return NO_SECTION;
 
+    // the buffer may be larger than the state it holds, if it's being reused
+    u32 state_length = 0;
+    memcpy(&state_length, buffer + 0x08, sizeof(state_length));
+    if (state_length > buffer_length)
+        state_length = buffer_length;
+
     // Start looking at the savestate's beginning, right after its global header
     // (we can't start from the current offset because then we'd lose the ability to rearrange sections)
 
-    for (u32 offset = 0x10; offset < buffer_length;)
+    for (u32 offset = 0x10; offset < state_length;)
     { // Until we've found the desired section...
 
         // Get this section's magic number
@@ -362,7 +550,7 @@ u32 Savestate::FindSection(const char* magic) const
         // Haven't found our section yet. Let's move on to the next one.
 
         u32 section_length_offset = offset + sizeof(read_magic);
-        if (section_length_offset >= buffer_length)
+        if (section_length_offset >= state_length)
         { // If trying to read the section length would take us past the file's end...
             break;
         }
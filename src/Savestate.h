@@ -21,11 +21,15 @@
 
 #include <cstring>
 #include <string>
+#include <vector>
 #include <stdio.h>
 #include "types.h"
 
 #define SAVESTATE_MAJOR 10
-#define SAVESTATE_MINOR 0
+#define SAVESTATE_MINOR 1
+
+// header flags, for savestate files
+#define SAVESTATE_FLAG_COMPRESSED 0x1
 
 class Savestate
 {
@@ -68,11 +72,29 @@ public:
 
     void VarArray(void* data, u32 len);
 
+    // moves past len bytes without reading or writing them
+    // when saving, only valid if the buffer already holds that data (incremental savestates)
+    void Skip(u32 len);
+
     void Finish();
 
-    // TODO rewinds the stream
+    // rewinds the stream, so the same buffer can be reused for another state
+    // (or to load back the state that was just saved)
     void Rewind(bool save);
 
+    // compress every section as soon as it's closed, so WriteFile() with
+    // compression only has to write the result
+    // (only worth it when the state is saved and written from the same thread)
+    void CompressSections();
+
+    // writes the finished state to a file
+    // when compressing, every section is compressed and written separately
+    bool WriteFile(FILE* file, bool compress) const;
+
+    // expands a compressed savestate file that was read into memory
+    // uncompressed files are left as they are. returns false if the file is corrupt
+    static bool Decompress(std::vector<u8>& data);
+
     bool IsAtLeastVersion(u32 major, u32 minor)
     {
         u16 major_version = MajorVersion();
@@ -107,6 +129,7 @@ public:
 private:
     static constexpr u32 NO_SECTION = 0xffffffff;
     void CloseCurrentSection();
+    void CompressSection(u32 offset, u32 length);
     bool Resize(u32 new_length);
     void WriteSavestateHeader();
     void WriteStateLength();
@@ -116,6 +139,10 @@ private:
     u32 buffer_length;
     bool buffer_owned;
     bool finished;
+    bool compress_sections;
+    // the sections closed so far (up to compressed_end), in the compressed file format
+    std::vector<u8> compressed;
+    u32 compressed_end;
 };
 
 #endif // SAVESTATE_H
@@ -0,0 +1,61 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef BENCH_CONFIG_H
+#define BENCH_CONFIG_H
+
+#include <string>
+
+// the benchmark runner has no config file, everything is set from the command line
+
+namespace Config
+{
+
+extern bool Verbose;
+
+extern int ConsoleType;
+extern bool DirectBoot;
+
+#ifdef JIT_ENABLED
+extern bool JIT_Enable;
+extern int JIT_MaxBlockSize;
+extern bool JIT_BranchOptimisations;
+extern bool JIT_LiteralOptimisations;
+extern bool JIT_FastMemory;
+extern bool JIT_BackgroundCompilation;
+extern std::string JIT_CodeCachePath;
+#endif
+extern bool DecodeCacheEnable;
+extern bool DecodeCacheIdleLoops;
+
+extern bool ExternalBIOSEnable;
+
+extern std::string BIOS9Path;
+extern std::string BIOS7Path;
+extern std::string FirmwarePath;
+
+extern std::string DSiBIOS9Path;
+extern std::string DSiBIOS7Path;
+extern std::string DSiFirmwarePath;
+extern std::string DSiNANDPath;
+
+extern bool Threaded3D;
+
+}
+
+#endif // BENCH_CONFIG_H
@@ -0,0 +1,448 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// headless benchmark runner
+//
+// boots a ROM on the core alone and runs it for a fixed amount of frames,
+// as fast as possible: no frame limiter, no audio sync, no presentation.
+// results are written as JSON so they can be compared across builds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+#include "Platform.h"
+#include "Profiler.h"
+
+#include "NDS.h"
+#include "GPU.h"
+#include "Rewind.h"
+#ifdef JIT_ENABLED
+#include "ARMJIT.h"
+#endif
+
+
+namespace Config
+{
+
+bool Verbose = false;
+
+int ConsoleType = 0;
+bool DirectBoot = true;
+
+#ifdef JIT_ENABLED
+bool JIT_Enable = false;
+int JIT_MaxBlockSize = 32;
+bool JIT_BranchOptimisations = true;
+bool JIT_LiteralOptimisations = true;
+bool JIT_FastMemory = true;
+bool JIT_BackgroundCompilation = false;
+std::string JIT_CodeCachePath;
+#endif
+bool DecodeCacheEnable = false;
+bool DecodeCacheIdleLoops = true;
+
+bool ExternalBIOSEnable = false;
+
+std::string BIOS9Path;
+std::string BIOS7Path;
+std::string FirmwarePath;
+
+std::string DSiBIOS9Path;
+std::string DSiBIOS7Path;
+std::string DSiFirmwarePath;
+std::string DSiNANDPath;
+
+bool Threaded3D = false;
+
+}
+
+
+void PrintUsage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options] <rom>\n"
+        "\n"
+        "  -f, --frames <n>         number of frames to measure (default: 3600)\n"
+        "  -w, --warmup <n>         number of frames to run before measuring (default: 0)\n"
+        "  -o, --output <file>      write the JSON report to a file instead of stdout\n"
+        "  -s, --render-skip <n>    only draw one frame out of every n+1 (default: 0)\n"
+        "  -r, --run-ahead <n>      run n frames ahead of every frame (default: 0)\n"
+        "      --rewind <n>         record a rewind snapshot every n frames (default: 0)\n"
+        "      --dsi                run in DSi mode (requires DSi BIOS/firmware/NAND)\n"
+        "      --firmware-boot      boot through the firmware instead of direct boot\n"
+        "      --bios9 <file>       external DS ARM9 BIOS\n"
+        "      --bios7 <file>       external DS ARM7 BIOS\n"
+        "      --firmware <file>    external DS firmware\n"
+        "      --dsi-bios9 <file>   DSi ARM9 BIOS\n"
+        "      --dsi-bios7 <file>   DSi ARM7 BIOS\n"
+        "      --dsi-firmware <file> DSi firmware\n"
+        "      --dsi-nand <file>    DSi NAND image\n"
+#ifdef JIT_ENABLED
+        "      --jit                enable the JIT recompiler\n"
+        "      --jit-block-size <n> maximum JIT block size (default: 32)\n"
+        "      --jit-no-branch-opt  disable JIT branch optimisations\n"
+        "      --jit-no-literal-opt disable JIT literal optimisations\n"
+        "      --jit-no-fastmem     disable JIT fast memory\n"
+        "      --jit-background     compile JIT blocks on a separate thread\n"
+        "      --jit-code-cache <file> load compiled JIT code from a file, and save it after the run\n"
+#endif
+        "      --decode-cache       run the interpreter from decoded blocks (experimental)\n"
+        "      --no-idle-loops      with --decode-cache, don't skip idle loops\n"
+        "      --threaded-3d        render 3D on a separate thread\n"
+        "  -v, --verbose            print emulator log output to stderr\n",
+        argv0);
+}
+
+bool ReadFile(const std::string& path, std::vector<u8>& data)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (len <= 0 || len > 0x40000000)
+    {
+        fclose(f);
+        return false;
+    }
+
+    data.resize(len);
+    size_t nread = fread(data.data(), len, 1, f);
+    fclose(f);
+
+    return nread == 1;
+}
+
+std::string EscapeJSON(const std::string& str)
+{
+    std::string ret;
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            ret += '\\';
+            ret += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char tmp[8];
+            snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+            ret += tmp;
+        }
+        else
+            ret += c;
+    }
+    return ret;
+}
+
+#ifdef JIT_ENABLED
+const char* JITRegionNames[ARMJIT_Memory::memregions_Count] =
+{
+    "other", "itcm", "dtcm", "bios9", "main_ram", "shared_wram", "io9", "vram",
+    "bios7", "wram7", "io7", "wifi", "vwram",
+    "bios9_dsi", "bios7_dsi", "nwram_a", "nwram_b", "nwram_c"
+};
+
+void WriteJITStats(FILE* out)
+{
+    ARMJIT::Stats stats;
+    ARMJIT::GetStats(&stats);
+
+    fprintf(out, "  \"jit_stats\": {\n");
+    fprintf(out, "    \"blocks_compiled\": [%llu, %llu],\n",
+            (unsigned long long)stats.BlocksCompiled[0], (unsigned long long)stats.BlocksCompiled[1]);
+    fprintf(out, "    \"blocks_restored\": [%llu, %llu],\n",
+            (unsigned long long)stats.BlocksRestored[0], (unsigned long long)stats.BlocksRestored[1]);
+    fprintf(out, "    \"compile_time\": %.6f,\n", stats.CompileTime / 1000000000.0);
+    fprintf(out, "    \"code_size\": %llu,\n", (unsigned long long)stats.CodeSize);
+    fprintf(out, "    \"invalidations\": {");
+    bool first = true;
+    for (u32 i = 0; i < ARMJIT_Memory::memregions_Count; i++)
+    {
+        if (!stats.Invalidations[i]) continue;
+        fprintf(out, "%s \"%s\": %llu", first ? "" : ",", JITRegionNames[i],
+                (unsigned long long)stats.Invalidations[i]);
+        first = false;
+    }
+    fprintf(out, " },\n");
+    fprintf(out, "    \"literal_invalidations\": %llu,\n", (unsigned long long)stats.LiteralInvalidations);
+    fprintf(out, "    \"cache_resets\": %llu,\n", (unsigned long long)stats.CacheResets);
+    fprintf(out, "    \"evictions\": %llu,\n", (unsigned long long)stats.Evictions);
+    fprintf(out, "    \"evicted_blocks\": %llu,\n", (unsigned long long)stats.EvictedBlocks);
+    fprintf(out, "    \"lookups\": [%llu, %llu],\n",
+            (unsigned long long)stats.Lookups[0], (unsigned long long)stats.Lookups[1]);
+#ifdef PROFILING_ENABLED
+    fprintf(out, "    \"linked_transitions\": [%llu, %llu]\n",
+            (unsigned long long)stats.LinkedTransitions[0], (unsigned long long)stats.LinkedTransitions[1]);
+#else
+    fprintf(out, "    \"linked_transitions\": null\n");
+#endif
+    fprintf(out, "  },\n");
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    std::string rompath;
+    std::string outpath;
+    u32 numframes = 3600;
+    u32 warmupframes = 0;
+    u32 renderskip = 0;
+    u32 runahead = 0;
+    u32 rewindinterval = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasval = (i+1) < argc;
+
+        if ((arg == "-f" || arg == "--frames") && hasval)
+            numframes = strtoul(argv[++i], nullptr, 0);
+        else if ((arg == "-w" || arg == "--warmup") && hasval)
+            warmupframes = strtoul(argv[++i], nullptr, 0);
+        else if ((arg == "-o" || arg == "--output") && hasval)
+            outpath = argv[++i];
+        else if ((arg == "-s" || arg == "--render-skip") && hasval)
+            renderskip = strtoul(argv[++i], nullptr, 0);
+        else if ((arg == "-r" || arg == "--run-ahead") && hasval)
+            runahead = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--rewind" && hasval)
+            rewindinterval = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--dsi")
+            Config::ConsoleType = 1;
+        else if (arg == "--firmware-boot")
+            Config::DirectBoot = false;
+        else if (arg == "--bios9" && hasval)
+            Config::BIOS9Path = argv[++i];
+        else if (arg == "--bios7" && hasval)
+            Config::BIOS7Path = argv[++i];
+        else if (arg == "--firmware" && hasval)
+            Config::FirmwarePath = argv[++i];
+        else if (arg == "--dsi-bios9" && hasval)
+            Config::DSiBIOS9Path = argv[++i];
+        else if (arg == "--dsi-bios7" && hasval)
+            Config::DSiBIOS7Path = argv[++i];
+        else if (arg == "--dsi-firmware" && hasval)
+            Config::DSiFirmwarePath = argv[++i];
+        else if (arg == "--dsi-nand" && hasval)
+            Config::DSiNANDPath = argv[++i];
+#ifdef JIT_ENABLED
+        else if (arg == "--jit")
+            Config::JIT_Enable = true;
+        else if (arg == "--jit-block-size" && hasval)
+            Config::JIT_MaxBlockSize = strtol(argv[++i], nullptr, 0);
+        else if (arg == "--jit-no-branch-opt")
+            Config::JIT_BranchOptimisations = false;
+        else if (arg == "--jit-no-literal-opt")
+            Config::JIT_LiteralOptimisations = false;
+        else if (arg == "--jit-no-fastmem")
+            Config::JIT_FastMemory = false;
+        else if (arg == "--jit-background")
+            Config::JIT_BackgroundCompilation = true;
+        else if (arg == "--jit-code-cache" && hasval)
+            Config::JIT_CodeCachePath = argv[++i];
+#endif
+        else if (arg == "--decode-cache")
+            Config::DecodeCacheEnable = true;
+        else if (arg == "--no-idle-loops")
+            Config::DecodeCacheIdleLoops = false;
+        else if (arg == "--threaded-3d")
+            Config::Threaded3D = true;
+        else if (arg == "-v" || arg == "--verbose")
+            Config::Verbose = true;
+        else if (arg[0] != '-' && rompath.empty())
+            rompath = arg;
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (rompath.empty())
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    Config::ExternalBIOSEnable = !Config::BIOS9Path.empty() &&
+                                 !Config::BIOS7Path.empty() &&
+                                 !Config::FirmwarePath.empty();
+
+    std::vector<u8> romdata;
+    if (!ReadFile(rompath, romdata))
+    {
+        fprintf(stderr, "failed to read ROM %s\n", rompath.c_str());
+        return 1;
+    }
+
+    Platform::Init(argc, argv);
+
+    if (!NDS::Init())
+    {
+        fprintf(stderr, "failed to initialize the emulator core\n");
+        return 1;
+    }
+
+    GPU::RenderSettings videosettings;
+    videosettings.Soft_Threaded = Config::Threaded3D;
+    videosettings.GL_ScaleFactor = 1;
+    videosettings.GL_BetterPolygons = false;
+
+    GPU::InitRenderer(0);
+    GPU::SetRenderSettings(0, videosettings);
+
+    NDS::SetConsoleType(Config::ConsoleType);
+    NDS::Reset();
+
+    if (!NDS::LoadCart(romdata.data(), romdata.size(), nullptr, 0))
+    {
+        fprintf(stderr, "failed to load ROM %s\n", rompath.c_str());
+        NDS::DeInit();
+        return 1;
+    }
+
+    std::string romname = rompath.substr(rompath.find_last_of("/\\") + 1);
+    if (Config::DirectBoot || NDS::NeedsDirectBoot())
+        NDS::SetupDirectBoot(romname);
+
+#ifdef JIT_ENABLED
+    bool jitcodecache = Config::JIT_Enable && !Config::JIT_CodeCachePath.empty();
+    if (jitcodecache)
+        ARMJIT::LoadCodeCache(Config::JIT_CodeCachePath);
+#endif
+
+    NDS::SetRenderSkip(renderskip, 0);
+    NDS::SetRunAhead(runahead);
+    Rewind::SetConfig(rewindinterval, 64 << 20);
+    NDS::Start();
+
+    for (u32 i = 0; i < warmupframes; i++)
+    {
+        NDS::RunFrame();
+        Rewind::FrameEnd();
+    }
+
+    NDS::ResetProfileStats();
+#ifdef JIT_ENABLED
+    ARMJIT::ResetStats();
+#endif
+
+    u32 lagframes = NDS::NumLagFrames;
+    u64 totalscanlines = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (u32 i = 0; i < numframes; i++)
+    {
+        totalscanlines += NDS::RunFrame();
+        Rewind::FrameEnd();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double walltime = std::chrono::duration<double>(end - start).count();
+
+    lagframes = NDS::NumLagFrames - lagframes;
+
+#ifdef JIT_ENABLED
+    if (jitcodecache && !ARMJIT::SaveCodeCache(Config::JIT_CodeCachePath))
+        fprintf(stderr, "failed to save the JIT code cache to %s\n", Config::JIT_CodeCachePath.c_str());
+#endif
+
+    Profiler::CounterStats profstats[Profiler::Counter_MAX];
+    bool profiling = NDS::GetProfileStats(profstats);
+
+    FILE* out = stdout;
+    if (!outpath.empty())
+    {
+        out = fopen(outpath.c_str(), "w");
+        if (!out)
+        {
+            fprintf(stderr, "failed to open %s for writing\n", outpath.c_str());
+            NDS::DeInit();
+            return 1;
+        }
+    }
+
+    // emulated time is derived from the amount of scanlines run,
+    // as the frame length can vary (VCount writes)
+    double emutime = totalscanlines / (60.0 * 263.0);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": \"%s\",\n", MELONDS_VERSION);
+    fprintf(out, "  \"rom\": \"%s\",\n", EscapeJSON(romname).c_str());
+    fprintf(out, "  \"console\": \"%s\",\n", Config::ConsoleType == 1 ? "dsi" : "ds");
+#ifdef JIT_ENABLED
+    fprintf(out, "  \"jit\": %s,\n", Config::JIT_Enable ? "true" : "false");
+#else
+    fprintf(out, "  \"jit\": false,\n");
+#endif
+    fprintf(out, "  \"threaded_3d\": %s,\n", Config::Threaded3D ? "true" : "false");
+    fprintf(out, "  \"render_skip\": %u,\n", renderskip);
+    fprintf(out, "  \"run_ahead\": %u,\n", runahead);
+    fprintf(out, "  \"rewind_interval\": %u,\n", rewindinterval);
+    fprintf(out, "  \"warmup_frames\": %u,\n", warmupframes);
+    fprintf(out, "  \"frames\": %u,\n", numframes);
+    fprintf(out, "  \"lag_frames\": %u,\n", lagframes);
+    fprintf(out, "  \"wall_time\": %.6f,\n", walltime);
+    fprintf(out, "  \"fps\": %.3f,\n", walltime > 0.0 ? numframes / walltime : 0.0);
+    fprintf(out, "  \"speed\": %.3f,\n", walltime > 0.0 ? emutime / walltime : 0.0);
+#ifdef JIT_ENABLED
+    if (Config::JIT_Enable)
+        WriteJITStats(out);
+#endif
+    if (profiling)
+    {
+        fprintf(out, "  \"profiling\": true,\n");
+        fprintf(out, "  \"subsystems\": {\n");
+        for (u32 i = 0; i < Profiler::Counter_MAX; i++)
+        {
+            fprintf(out, "    \"%s\": { \"time\": %.6f, \"calls\": %llu }%s\n",
+                    Profiler::GetCounterName(i),
+                    profstats[i].Time / 1000000000.0,
+                    (unsigned long long)profstats[i].Calls,
+                    (i+1) < Profiler::Counter_MAX ? "," : "");
+        }
+        fprintf(out, "  }\n");
+    }
+    else
+    {
+        // subsystem times need a core built with ENABLE_PROFILING
+        fprintf(out, "  \"profiling\": false,\n");
+        fprintf(out, "  \"subsystems\": null\n");
+    }
+    fprintf(out, "}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    NDS::Stop();
+    GPU::DeInitRenderer();
+    NDS::DeInit();
+    Platform::DeInit();
+
+    return 0;
+}
@@ -61,6 +61,12 @@ bool GL_BetterPolygons;
 bool LimitFPS;
 bool AudioSync;
 bool ShowOSD;
+bool ShowProfileStats;
+int RunAheadFrames;
+
+bool RewindEnable;
+int RewindInterval;
+int RewindBufferSize;
 
 int ConsoleType;
 bool DirectBoot;
@@ -71,7 +77,11 @@ int JIT_MaxBlockSize = 32;
 bool JIT_BranchOptimisations = true;
 bool JIT_LiteralOptimisations = true;
 bool JIT_FastMemory = true;
+bool JIT_BackgroundCompilation = false;
+bool JIT_CodeCache = false;
 #endif
+bool DecodeCacheEnable;
+bool DecodeCacheIdleLoops;
 
 bool ExternalBIOSEnable;
 
@@ -114,6 +124,8 @@ std::string LANDevice;
 bool DirectLAN;
 
 bool SavestateRelocSRAM;
+bool SavestateCompress;
+bool SavestateAsync;
 
 int AudioInterp;
 int AudioBitrate;
@@ -191,6 +203,7 @@ ConfigEntry ConfigFile[] =
     {"HKKey_PowerButton",         0, &HKKeyMapping[HK_PowerButton],         -1, true},
     {"HKKey_VolumeUp",            0, &HKKeyMapping[HK_VolumeUp],            -1, true},
     {"HKKey_VolumeDown",          0, &HKKeyMapping[HK_VolumeDown],          -1, true},
+    {"HKKey_Rewind",              0, &HKKeyMapping[HK_Rewind],              -1, true},
 
     {"HKJoy_Lid",                 0, &HKJoyMapping[HK_Lid],                 -1, true},
     {"HKJoy_Mic",                 0, &HKJoyMapping[HK_Mic],                 -1, true},
@@ -207,6 +220,7 @@ ConfigEntry ConfigFile[] =
     {"HKJoy_PowerButton",         0, &HKJoyMapping[HK_PowerButton],         -1, true},
     {"HKJoy_VolumeUp",            0, &HKJoyMapping[HK_VolumeUp],            -1, true},
     {"HKJoy_VolumeDown",          0, &HKJoyMapping[HK_VolumeDown],          -1, true},
+    {"HKJoy_Rewind",              0, &HKJoyMapping[HK_Rewind],              -1, true},
 
     {"JoystickID", 0, &JoystickID, 0, true},
 
@@ -237,6 +251,12 @@ ConfigEntry ConfigFile[] =
     {"LimitFPS", 1, &LimitFPS, true, false},
     {"AudioSync", 1, &AudioSync, false},
     {"ShowOSD", 1, &ShowOSD, true, false},
+    {"ShowProfileStats", 1, &ShowProfileStats, false, false},
+    {"RunAheadFrames", 0, &RunAheadFrames, 0, false},
+
+    {"RewindEnable", 1, &RewindEnable, false, false},
+    {"RewindInterval", 0, &RewindInterval, 10, false},
+    {"RewindBufferSize", 0, &RewindBufferSize, 64, false},
 
     {"ConsoleType", 0, &ConsoleType, 0, false},
     {"DirectBoot", 1, &DirectBoot, true, false},
@@ -251,7 +271,11 @@ ConfigEntry ConfigFile[] =
     #else
         {"JIT_FastMemory", 1, &JIT_FastMemory, true, false},
     #endif
+    {"JIT_BackgroundCompilation", 1, &JIT_BackgroundCompilation, false, false},
+    {"JIT_CodeCache", 1, &JIT_CodeCache, false, false},
 #endif
+    {"DecodeCacheEnable", 1, &DecodeCacheEnable, false, false}, // experimental, see ARMDecodeCache.h
+    {"DecodeCacheIdleLoops", 1, &DecodeCacheIdleLoops, true, false},
 
     {"ExternalBIOSEnable", 1, &ExternalBIOSEnable, false, false},
 
@@ -294,6 +318,8 @@ ConfigEntry ConfigFile[] =
     {"DirectLAN", 1, &DirectLAN, false, false},
 
     {"SavStaRelocSRAM", 1, &SavestateRelocSRAM, false, false},
+    {"SavStaCompress", 1, &SavestateCompress, true, false},
+    {"SavStaAsync", 1, &SavestateAsync, true, false},
 
     {"AudioInterp", 0, &AudioInterp, 0, false},
     {"AudioBitrate", 0, &AudioBitrate, 0, false},
@@ -39,6 +39,7 @@ enum
     HK_PowerButton,
     HK_VolumeUp,
     HK_VolumeDown,
+    HK_Rewind,
     HK_MAX
 };
 
@@ -118,6 +119,12 @@ extern bool GL_BetterPolygons;
 extern bool LimitFPS;
 extern bool AudioSync;
 extern bool ShowOSD;
+extern bool ShowProfileStats;
+extern int RunAheadFrames;
+
+extern bool RewindEnable;
+extern int RewindInterval;
+extern int RewindBufferSize;
 
 extern int ConsoleType;
 extern bool DirectBoot;
@@ -128,7 +135,11 @@ extern int JIT_MaxBlockSize;
 extern bool JIT_BranchOptimisations;
 extern bool JIT_LiteralOptimisations;
 extern bool JIT_FastMemory;
+extern bool JIT_BackgroundCompilation;
+extern bool JIT_CodeCache;
 #endif
+extern bool DecodeCacheEnable;
+extern bool DecodeCacheIdleLoops;
 
 extern bool ExternalBIOSEnable;
 
@@ -171,6 +182,8 @@ extern std::string LANDevice;
 extern bool DirectLAN;
 
 extern bool SavestateRelocSRAM;
+extern bool SavestateCompress;
+extern bool SavestateAsync;
 
 extern int AudioInterp;
 extern int AudioBitrate;
@@ -48,6 +48,7 @@ static constexpr std::initializer_list<int> hk_general =
     HK_FrameStep,
     HK_FastForward,
     HK_FastForwardToggle,
+    HK_Rewind,
     HK_FullscreenToggle,
     HK_Lid,
     HK_Mic,
@@ -65,6 +66,7 @@ static constexpr std::initializer_list<const char*> hk_general_labels =
     "Frame step",
     "Fast forward",
     "Toggle FPS limit",
+    "Rewind",
     "Toggle fullscreen",
     "Close/open lid",
     "Microphone",
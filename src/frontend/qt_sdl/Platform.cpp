@@ -206,7 +206,10 @@ bool GetConfigBool(ConfigEntry entry)
     case JIT_LiteralOptimizations: return Config::JIT_LiteralOptimisations != 0;
     case JIT_BranchOptimizations: return Config::JIT_BranchOptimisations != 0;
     case JIT_FastMemory: return Config::JIT_FastMemory != 0;
+    case JIT_BackgroundCompilation: return Config::JIT_BackgroundCompilation != 0;
 #endif
+    case DecodeCache_Enable: return Config::DecodeCacheEnable != 0;
+    case DecodeCache_IdleLoops: return Config::DecodeCacheIdleLoops != 0;
 
     case ExternalBIOSEnable: return Config::ExternalBIOSEnable != 0;
 
@@ -28,6 +28,7 @@
 #include "ArchiveUtil.h"
 #endif
 #include "ROMManager.h"
+#include "StateWriter.h"
 #include "Config.h"
 #include "Platform.h"
 
@@ -35,6 +36,9 @@
 #include "DSi.h"
 #include "SPI.h"
 #include "DSi_I2C.h"
+#ifdef JIT_ENABLED
+#include "ARMJIT.h"
+#endif
 
 
 namespace ROMManager
@@ -55,6 +59,7 @@ SaveManager* GBASave = nullptr;
 
 std::unique_ptr<Savestate> BackupState = nullptr;
 bool SavestateLoaded = false;
+std::unique_ptr<StateWriter> StateSaver = nullptr;
 std::string PreviousSaveFile = "";
 
 ARCodeFile* CheatFile = nullptr;
@@ -304,8 +309,24 @@ bool SavestateExists(int slot)
     return Platform::FileExists(ssfile);
 }
 
+// with SavestateRelocSRAM, every state gets its own save file named after it
+// load: whether the save memory is read from that file, instead of written to it
+void RelocateSRAM(const std::string& filename, bool load)
+{
+    if (!Config::SavestateRelocSRAM || !NDSSave)
+        return;
+
+    std::string savefile = filename.substr(LastSep(filename)+1);
+    savefile = GetAssetPath(false, Config::SaveFilePath, ".sav", savefile);
+    savefile += Platform::InstanceFileSuffix();
+    NDSSave->SetPath(savefile, load);
+}
+
 bool LoadState(const std::string& filename)
 {
+    // make sure we don't read a state that is still being written
+    FlushStateWrites();
+
     FILE* file = fopen(filename.c_str(), "rb");
     if (file == nullptr)
     { // If we couldn't open the state file...
@@ -350,6 +371,14 @@ bool LoadState(const std::string& filename)
     }
     fclose(file); // done with the file now
 
+    // compressed states are expanded here, uncompressed ones are left alone
+    if (!Savestate::Decompress(buffer))
+    {
+        Platform::Log(Platform::LogLevel::Error, "Failed to decompress state file \"%s\"\n", filename.c_str());
+        return false;
+    }
+    size = buffer.size();
+
     // Get ready to load the state from the buffer into the emulator
     std::unique_ptr<Savestate> state = std::make_unique<Savestate>(buffer.data(), size, false);
 
@@ -364,14 +393,8 @@ bool LoadState(const std::string& filename)
     assert(backup == nullptr);
 
     if (Config::SavestateRelocSRAM && NDSSave)
-    {
         PreviousSaveFile = NDSSave->GetPath();
-
-        std::string savefile = filename.substr(LastSep(filename)+1);
-        savefile = GetAssetPath(false, Config::SaveFilePath, ".sav", savefile);
-        savefile += Platform::InstanceFileSuffix();
-        NDSSave->SetPath(savefile, true);
-    }
+    RelocateSRAM(filename, true);
 
     SavestateLoaded = true;
 
@@ -394,6 +417,11 @@ bool SaveState(const std::string& filename)
         return false;
     }
 
+    // compress the sections while they're being saved, instead of in a second pass
+    // (the background writer compresses on its own thread instead, see SaveStateAsync())
+    if (Config::SavestateCompress)
+        state.CompressSections();
+
     // Write the savestate to the in-memory buffer
     NDS::DoSavestate(&state);
 
@@ -403,7 +431,7 @@ bool SaveState(const std::string& filename)
         return false;
     }
 
-    if (fwrite(state.Buffer(), state.Length(), 1, file) == 0)
+    if (!state.WriteFile(file, Config::SavestateCompress))
     { // Write the Savestate buffer to the file. If that fails...
         Platform::Log(Platform::Error,
             "Failed to write %d-byte savestate to %s\n",
@@ -416,17 +444,41 @@ bool SaveState(const std::string& filename)
 
     fclose(file);
 
-    if (Config::SavestateRelocSRAM && NDSSave)
+    RelocateSRAM(filename, false);
+
+    return true;
+}
+
+bool SaveStateAsync(const std::string& filename, std::function<void(bool)> done)
+{
+    std::unique_ptr<Savestate> state = std::make_unique<Savestate>();
+    if (state->Error)
+    { // If there was an error creating the state (and allocating its memory)...
+        return false;
+    }
+
+    // Write the savestate to the in-memory buffer
+    NDS::DoSavestate(state.get());
+
+    if (state->Error)
     {
-        std::string savefile = filename.substr(LastSep(filename)+1);
-        savefile = GetAssetPath(false, Config::SaveFilePath, ".sav", savefile);
-        savefile += Platform::InstanceFileSuffix();
-        NDSSave->SetPath(savefile, false);
+        return false;
     }
 
+    // The buffer belongs to the writer thread from now on, so emulation can resume right away
+    if (!StateSaver) StateSaver = std::make_unique<StateWriter>();
+    StateSaver->Queue(std::move(state), filename, Config::SavestateCompress, std::move(done));
+
+    RelocateSRAM(filename, false);
+
     return true;
 }
 
+void FlushStateWrites()
+{
+    if (StateSaver) StateSaver->Flush();
+}
+
 void UndoStateLoad()
 {
     if (!SavestateLoaded || !BackupState) return;
@@ -492,6 +544,26 @@ void SetBatteryLevels()
     }
 }
 
+void LoadJITCodeCache()
+{
+#ifdef JIT_ENABLED
+    if (!Config::JIT_Enable || !Config::JIT_CodeCache || CartType == -1)
+        return;
+
+    ARMJIT::LoadCodeCache(GetAssetPath(false, Config::SaveFilePath, ".jit"));
+#endif
+}
+
+void SaveJITCodeCache()
+{
+#ifdef JIT_ENABLED
+    if (!Config::JIT_Enable || !Config::JIT_CodeCache || CartType == -1)
+        return;
+
+    ARMJIT::SaveCodeCache(GetAssetPath(false, Config::SaveFilePath, ".jit"));
+#endif
+}
+
 void Reset()
 {
     NDS::SetConsoleType(Config::ConsoleType);
@@ -524,6 +596,8 @@ void Reset()
             NDS::SetupDirectBoot(BaseROMName);
         }
     }
+
+    LoadJITCodeCache();
 }
 
 
@@ -666,6 +740,8 @@ bool LoadROM(QStringList filepath, bool reset)
     else
         return false;
 
+    SaveJITCodeCache();
+
     if (NDSSave) delete NDSSave;
     NDSSave = nullptr;
 
@@ -716,6 +792,9 @@ bool LoadROM(QStringList filepath, bool reset)
         NDSSave = new SaveManager(savname);
 
         LoadCheats();
+
+        if (reset)
+            LoadJITCodeCache();
     }
 
     if (savedata) delete[] savedata;
@@ -725,6 +804,8 @@ bool LoadROM(QStringList filepath, bool reset)
 
 void EjectCart()
 {
+    SaveJITCodeCache();
+
     if (NDSSave) delete NDSSave;
     NDSSave = nullptr;
 
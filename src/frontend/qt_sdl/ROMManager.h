@@ -25,6 +25,7 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 
 namespace ROMManager
 {
@@ -39,6 +40,7 @@ void ClearBackupState();
 
 bool LoadROM(QStringList filepath, bool reset);
 void EjectCart();
+void SaveJITCodeCache();
 bool CartInserted();
 QString CartLabel();
 
@@ -52,6 +54,10 @@ std::string GetSavestateName(int slot);
 bool SavestateExists(int slot);
 bool LoadState(const std::string& filename);
 bool SaveState(const std::string& filename);
+// only serializes the state, the file is written on a background thread
+// done is called from that thread once the write has finished
+bool SaveStateAsync(const std::string& filename, std::function<void(bool)> done);
+void FlushStateWrites();
 void UndoStateLoad();
 
 void EnableCheats(bool enable);
@@ -0,0 +1,111 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+
+#include "StateWriter.h"
+#include "Platform.h"
+
+using Platform::Log;
+using Platform::LogLevel;
+
+StateWriter::StateWriter() : QThread()
+{
+    Busy = false;
+    Running = true;
+    start();
+}
+
+StateWriter::~StateWriter()
+{
+    // anything still queued gets written before we quit
+    Lock.lock();
+    Running = false;
+    JobAvailable.wakeAll();
+    Lock.unlock();
+
+    wait();
+}
+
+void StateWriter::Queue(std::unique_ptr<Savestate> state, const std::string& path, bool compress,
+                        std::function<void(bool)> done)
+{
+    Lock.lock();
+    Jobs.push_back({std::move(state), path, compress, std::move(done)});
+    JobAvailable.wakeOne();
+    Lock.unlock();
+}
+
+void StateWriter::Flush()
+{
+    Lock.lock();
+    while (Busy || !Jobs.empty())
+        JobsDone.wait(&Lock);
+    Lock.unlock();
+}
+
+void StateWriter::run()
+{
+    Lock.lock();
+    for (;;)
+    {
+        while (Running && Jobs.empty())
+            JobAvailable.wait(&Lock);
+
+        if (Jobs.empty())
+            break;
+
+        Job job = std::move(Jobs.front());
+        Jobs.pop_front();
+        Busy = true;
+        Lock.unlock();
+
+        bool res = Write(job);
+        if (job.Done) job.Done(res);
+        job.State = nullptr;
+
+        Lock.lock();
+        Busy = false;
+        if (Jobs.empty())
+            JobsDone.wakeAll();
+    }
+    Lock.unlock();
+}
+
+bool StateWriter::Write(const Job& job)
+{
+    FILE* file = fopen(job.Path.c_str(), "wb");
+    if (!file)
+    {
+        Log(LogLevel::Error, "StateWriter: failed to open %s\n", job.Path.c_str());
+        return false;
+    }
+
+    bool res = job.State->WriteFile(file, job.Compress);
+    if (fclose(file) != 0) res = false;
+
+    if (!res)
+    {
+        Log(LogLevel::Error, "StateWriter: failed to write %d-byte savestate to %s\n",
+            job.State->Length(), job.Path.c_str());
+        return false;
+    }
+
+    Log(LogLevel::Info, "StateWriter: written %s\n", job.Path.c_str());
+    return true;
+}
@@ -0,0 +1,73 @@
+/*
+    Copyright 2016-2022 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef STATEWRITER_H
+#define STATEWRITER_H
+
+#include <string>
+#include <memory>
+#include <deque>
+#include <functional>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "types.h"
+#include "Savestate.h"
+
+// writes finished savestates to disk on a separate thread
+// the emulator only has to wait for the state to be serialized to memory
+
+class StateWriter : public QThread
+{
+    Q_OBJECT
+    void run() override;
+
+public:
+    StateWriter();
+    ~StateWriter();
+
+    // takes ownership of the state. done is called from the writer thread
+    // once the file is written (or failed to be)
+    void Queue(std::unique_ptr<Savestate> state, const std::string& path, bool compress,
+               std::function<void(bool)> done);
+
+    // waits until every queued state is written
+    void Flush();
+
+private:
+    struct Job
+    {
+        std::unique_ptr<Savestate> State;
+        std::string Path;
+        bool Compress;
+        std::function<void(bool)> Done;
+    };
+
+    bool Write(const Job& job);
+
+    QMutex Lock;
+    QWaitCondition JobAvailable;
+    QWaitCondition JobsDone;
+
+    std::deque<Job> Jobs;
+    bool Busy;
+    bool Running;
+};
+
+#endif // STATEWRITER_H
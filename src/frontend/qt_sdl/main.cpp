@@ -81,6 +81,7 @@
 #include "OSD.h"
 
 #include "NDS.h"
+#include "Profiler.h"
 #include "NDSCart.h"
 #include "GBACart.h"
 #include "GPU.h"
@@ -92,6 +93,7 @@
 #include "DSi_I2C.h"
 
 #include "Savestate.h"
+#include "Rewind.h"
 
 #include "main_shaders.h"
 
@@ -309,6 +311,31 @@ void EmuThread::deinitOpenGL()
     lastScreenWidth = lastScreenHeight = -1;
 }
 
+void ShowProfileStats(u32 nframes)
+{
+    Profiler::CounterStats stats[Profiler::Counter_MAX];
+    if (!NDS::GetProfileStats(stats)) return;
+    NDS::ResetProfileStats();
+
+    // show the most expensive subsystems, in milliseconds per frame
+    u32 order[Profiler::Counter_MAX];
+    for (u32 i = 0; i < Profiler::Counter_MAX; i++) order[i] = i;
+    std::sort(order, order + Profiler::Counter_MAX,
+              [&](u32 a, u32 b) { return stats[a].Time > stats[b].Time; });
+
+    char msg[256];
+    int len = sprintf(msg, "Profile (ms/frame):");
+    for (int i = 0; i < 4; i++)
+    {
+        u32 c = order[i];
+        if (stats[c].Time == 0) break;
+        len += sprintf(&msg[len], " %s %.2f", Profiler::GetCounterName(c),
+                       stats[c].Time / (1000000.0 * nframes));
+    }
+
+    OSD::AddMessage(0xA0C0FF, msg);
+}
+
 void EmuThread::run()
 {
     u32 mainScreenPos[3];
@@ -343,6 +370,7 @@ void EmuThread::run()
     Input::Init();
 
     u32 nframes = 0;
+    u32 nprofframes = 0;
     double perfCountsSec = 1.0 / SDL_GetPerformanceFrequency();
     double lastTime = SDL_GetPerformanceCounter() * perfCountsSec;
     double frameLimitError = 0.0;
@@ -503,9 +531,24 @@ void EmuThread::run()
             }
 
 
+            // when fast-forwarding, only draw the frames which are presented
+            // (the one where winUpdateCount reaches winUpdateFreq, see below)
+            bool skiprender = Input::HotkeyDown(HK_FastForward) || !Config::LimitFPS;
+            NDS::SetRenderSkip(skiprender ? (winUpdateFreq - 1) : 0, winUpdateCount);
+
+            // no point in hiding input lag while fast-forwarding
+            NDS::SetRunAhead(skiprender ? 0 : Config::RunAheadFrames);
+
+            // rewinding: go back to the last snapshot, then run one frame from there to show it
+            Rewind::SetConfig(Config::RewindEnable ? Config::RewindInterval : 0, Config::RewindBufferSize << 20);
+            bool rewinding = Input::HotkeyDown(HK_Rewind) && Rewind::StepBack();
+
             // emulate
             u32 nlines = NDS::RunFrame();
 
+            if (!rewinding)
+                Rewind::FrameEnd();
+
             if (ROMManager::NDSSave)
                 ROMManager::NDSSave->CheckFlush();
 
@@ -531,9 +574,10 @@ void EmuThread::run()
             if (EmuRunning == 0) break;
 
             winUpdateCount++;
-            if (winUpdateCount >= winUpdateFreq && !oglContext)
+            if (winUpdateCount >= winUpdateFreq)
             {
-                emit windowUpdate();
+                if (!oglContext)
+                    emit windowUpdate();
                 winUpdateCount = 0;
             }
 
@@ -585,6 +629,15 @@ void EmuThread::run()
                 lastTime = curtime;
             }
 
+            // OSD messages last 2.5 seconds, refresh the profile a bit faster than that
+            nprofframes++;
+            if (nprofframes >= 120)
+            {
+                if (Config::ShowProfileStats)
+                    ShowProfileStats(nprofframes);
+                nprofframes = 0;
+            }
+
             nframes++;
             if (nframes >= 30)
             {
@@ -597,9 +650,16 @@ void EmuThread::run()
 
                 float fpstarget = 1.0/frametimeStep;
 
-                winUpdateFreq = fps / (u32)round(fpstarget);
-                if (winUpdateFreq < 1)
-                    winUpdateFreq = 1;
+                u32 freq = fps / (u32)round(fpstarget);
+                if (freq < 1)
+                    freq = 1;
+
+                // start counting over, the render skip pattern follows on the next frame
+                if (freq != winUpdateFreq)
+                {
+                    winUpdateFreq = freq;
+                    winUpdateCount = 0;
+                }
 
                 int inst = Platform::InstanceID();
                 if (inst == 0)
@@ -613,6 +673,7 @@ void EmuThread::run()
         {
             // paused
             nframes = 0;
+            nprofframes = 0;
             lastTime = SDL_GetPerformanceCounter() * perfCountsSec;
             lastMeasureTime = lastTime;
 
@@ -648,6 +709,8 @@ void EmuThread::run()
 
     EmuStatus = 0;
 
+    ROMManager::SaveJITCodeCache();
+
     GPU::DeInitRenderer();
     NDS::DeInit();
     //Platform::LAN_DeInit();
@@ -1590,6 +1653,14 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
             actSavestateSRAMReloc = submenu->addAction("Separate savefiles");
             actSavestateSRAMReloc->setCheckable(true);
             connect(actSavestateSRAMReloc, &QAction::triggered, this, &MainWindow::onChangeSavestateSRAMReloc);
+
+            actSavestateCompress = submenu->addAction("Compress savestate files");
+            actSavestateCompress->setCheckable(true);
+            connect(actSavestateCompress, &QAction::triggered, this, &MainWindow::onChangeSavestateCompress);
+
+            actSavestateAsync = submenu->addAction("Write savestates in background");
+            actSavestateAsync->setCheckable(true);
+            connect(actSavestateAsync, &QAction::triggered, this, &MainWindow::onChangeSavestateAsync);
         }
 
         menu->addSeparator();
@@ -1787,6 +1858,8 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     actRAMInfo->setEnabled(false);
 
     actSavestateSRAMReloc->setChecked(Config::SavestateRelocSRAM);
+    actSavestateCompress->setChecked(Config::SavestateCompress);
+    actSavestateAsync->setChecked(Config::SavestateAsync);
 
     actScreenRotation[Config::ScreenRotation]->setChecked(true);
 
@@ -2540,7 +2613,24 @@ void MainWindow::onSaveState()
         filename = qfilename.toStdString();
     }
 
-    if (ROMManager::SaveState(filename))
+    if (Config::SavestateAsync)
+    {
+        // the state is only serialized here, completion is reported from the writer thread
+        auto done = [slot](bool success)
+        {
+            char msg[64];
+            if (!success)      sprintf(msg, "State save failed");
+            else if (slot > 0) sprintf(msg, "State saved to slot %d", slot);
+            else               sprintf(msg, "State saved to file");
+            OSD::AddMessage(success ? 0 : 0xFFA0A0, msg);
+        };
+
+        if (ROMManager::SaveStateAsync(filename, done))
+            actLoadState[slot]->setEnabled(true);
+        else
+            OSD::AddMessage(0xFFA0A0, "State save failed");
+    }
+    else if (ROMManager::SaveState(filename))
     {
         char msg[64];
         if (slot > 0) sprintf(msg, "State saved to slot %d", slot);
@@ -2974,6 +3064,16 @@ void MainWindow::onChangeSavestateSRAMReloc(bool checked)
     Config::SavestateRelocSRAM = checked?1:0;
 }
 
+void MainWindow::onChangeSavestateCompress(bool checked)
+{
+    Config::SavestateCompress = checked;
+}
+
+void MainWindow::onChangeSavestateAsync(bool checked)
+{
+    Config::SavestateAsync = checked;
+}
+
 void MainWindow::onChangeScreenSize()
 {
     int factor = ((QAction*)sender())->data().toInt();
@@ -3275,6 +3375,9 @@ int main(int argc, char** argv)
     );
     SANITIZE(Config::ScreenVSyncInterval, 1, 20);
     SANITIZE(Config::GL_ScaleFactor, 1, 16);
+    SANITIZE(Config::RunAheadFrames, 0, 4);
+    SANITIZE(Config::RewindInterval, 1, 600);
+    SANITIZE(Config::RewindBufferSize, 1, 1024);
     SANITIZE(Config::AudioInterp, 0, 3);
     SANITIZE(Config::AudioVolume, 0, 256);
     SANITIZE(Config::MicInputType, 0, (int)micInputType_MAX);
@@ -3338,6 +3441,8 @@ int main(int argc, char** argv)
     emuThread->wait();
     delete emuThread;
 
+    ROMManager::FlushStateWrites();
+
     Input::CloseJoystick();
 
     AudioInOut::DeInit();
@@ -313,6 +313,8 @@ private slots:
     void onInterfaceSettingsFinished(int res);
     void onUpdateMouseTimer();
     void onChangeSavestateSRAMReloc(bool checked);
+    void onChangeSavestateCompress(bool checked);
+    void onChangeSavestateAsync(bool checked);
     void onChangeScreenSize();
     void onChangeScreenRotation(QAction* act);
     void onChangeScreenGap(QAction* act);
@@ -402,6 +404,8 @@ public:
     QAction* actPathSettings;
     QAction* actInterfaceSettings;
     QAction* actSavestateSRAMReloc;
+    QAction* actSavestateCompress;
+    QAction* actSavestateAsync;
     QAction* actScreenSize[4];
     QActionGroup* grpScreenRotation;
     QAction* actScreenRotation[4];